@@ -0,0 +1,291 @@
+/*
+ * Automation.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Parameter automation lanes: breakpoints on a (slot, port) against a
+ * timeline counted in frames from the start of playback.
+ *
+ * A lane holds up to kMaxPoints breakpoints in preallocated arrays and either
+ * steps to each breakpoint's value or ramps linearly between them. The lanes
+ * are published like the chain's slots: edits copy the set, swap it in and
+ * wait out the audio thread.
+ *
+ * Playback: PluginChain asks apply() for the values at the start of each
+ * sub-block and for where the next one has to start. Plugins are then run up
+ * to the next breakpoint, so a step lands on its frame, or for kRampStep
+ * frames while a ramp is under way. No sub-block is shorter than kMinSplit,
+ * so a dense lane cannot degrade the chain into single-frame runs.
+ *
+ * Recording: setValue() on the chain also queues the value with its
+ * CLOCK_MONOTONIC time while recording. The audio thread drains the queue
+ * each block, places every value at the frame it arrived at (one block late,
+ * as MIDI is) and passes it back as a recorded point through a second
+ * single-producer ring; it never writes a published lane. The writer side
+ * merges those points into a copy of the set with merge() and republishes
+ * it, so a point recorded while an edit is in flight waits in the ring for
+ * the next merge instead of being lost with the set it was written to.
+ * Recording punches in: points at or after a recorded frame are replaced.
+ * An armed lane is not played back while recording, the knob drives it.
+ */
+
+#ifndef OPIQO_AUTOMATION_H
+#define OPIQO_AUTOMATION_H
+
+#include "LV2Plugin.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+class Automation {
+public:
+    static constexpr int kMaxLanes = 16;
+    static constexpr uint32_t kMaxPoints = 512;
+    static constexpr uint32_t kMinSplit = 16;      // frames
+    static constexpr uint32_t kRampStep = 32;      // frames between ramp updates
+    static constexpr uint32_t kQueue = 256;        // power of two
+    static constexpr uint32_t kRecorded = 1024;    // power of two
+
+    struct Lane {
+        int32_t slot = 0;           // 1-based
+        uint32_t port = 0;
+        bool ramp = false;
+        bool armed = false;
+        std::atomic<uint32_t> count{0};
+        uint64_t frame[kMaxPoints];
+        float value[kMaxPoints];
+
+        Lane& operator=(const Lane& o) {
+            slot = o.slot;
+            port = o.port;
+            ramp = o.ramp;
+            armed = o.armed;
+            const uint32_t n = o.count.load(std::memory_order_acquire);
+            std::copy(o.frame, o.frame + n, frame);
+            std::copy(o.value, o.value + n, value);
+            count.store(n, std::memory_order_release);
+            return *this;
+        }
+    };
+
+    struct Lanes {
+        uint64_t generation = 0;
+        int count = 0;
+        Lane lane[kMaxLanes];
+
+        Lane* find(int slot, uint32_t port) {
+            for (int i = 0; i < count; ++i)
+                if (lane[i].slot == slot && lane[i].port == port) return &lane[i];
+            return nullptr;
+        }
+    };
+
+    // Transport, written from any thread
+    std::atomic<bool> playing{false};
+    std::atomic<bool> recording{false};
+
+    ~Automation() {
+        delete lanes_.exchange(nullptr);
+    }
+
+    // Move the playhead, applied at the next block
+    void locate(uint64_t frame) {
+        locate_.store(frame, std::memory_order_relaxed);
+        relocate_.store(true, std::memory_order_release);
+    }
+
+    uint64_t position() const { return shown_.load(std::memory_order_relaxed); }
+
+    // Writer side, serialised by the caller; wait out the audio thread
+    // before freeing the returned set
+    Lanes* swap(Lanes* next) { return lanes_.exchange(next); }
+
+    // A copy of the current set to edit
+    Lanes* copy() const {
+        auto* next = new Lanes();
+        const Lanes* cur = lanes_.load(std::memory_order_acquire);
+        if (cur) {
+            next->generation = cur->generation + 1;
+            next->count = cur->count;
+            for (int i = 0; i < cur->count; ++i) next->lane[i] = cur->lane[i];
+        }
+        return next;
+    }
+
+    // Writer side, serialised by the caller: append the points recorded so
+    // far to their armed lanes in `lanes`, false if there were none
+    bool merge(Lanes& lanes) {
+        uint32_t tail = rec_tail_.load(std::memory_order_relaxed);
+        const uint32_t head = rec_head_.load(std::memory_order_acquire);
+        if (tail == head) return false;
+        for (; tail != head; ++tail) {
+            const Point& p = recorded_[tail & (kRecorded - 1)];
+            Lane* lane = lanes.find(p.slot, p.port);
+            if (lane && lane->armed) append(*lane, p.frame, p.value);
+        }
+        rec_tail_.store(tail, std::memory_order_release);
+        return true;
+    }
+
+    // Recorded points waiting for merge()
+    uint32_t recordedPending() const {
+        return rec_head_.load(std::memory_order_acquire) - rec_tail_.load(std::memory_order_relaxed);
+    }
+
+    // Any thread: a parameter change to record, dropped unless recording
+    void record(int slot, uint32_t port, float value, int64_t time_ns) {
+        if (!recording.load(std::memory_order_relaxed)) return;
+        std::lock_guard<std::mutex> lock(producer_);
+        const uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) >= kQueue) return;
+        queue_[head & (kQueue - 1)] = {time_ns, slot, port, value};
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    // ---------------------------------------------------------------------
+    // Audio thread
+    // ---------------------------------------------------------------------
+
+    // Start of a block spanning [start_ns, start_ns + numFrames / rate):
+    // apply a pending locate and record the queued values
+    void begin(int64_t start_ns, uint32_t numFrames, double rate) {
+        if (relocate_.exchange(false, std::memory_order_acquire)) {
+            position_ = locate_.load(std::memory_order_relaxed);
+            seen_ = UINT64_MAX;
+        }
+
+        Lanes* lanes = lanes_.load(std::memory_order_acquire);
+        const bool rec = recording.load(std::memory_order_relaxed);
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        const uint32_t head = head_.load(std::memory_order_acquire);
+        for (; tail != head; ++tail) {
+            const Event& e = queue_[tail & (kQueue - 1)];
+            Lane* lane = lanes && rec ? lanes->find(e.slot, e.port) : nullptr;
+            if (!lane || !lane->armed) continue;
+
+            uint32_t offset = 0;
+            if (e.time_ns > start_ns && numFrames)
+                offset = std::min(numFrames - 1, (uint32_t)((e.time_ns - start_ns) * rate / 1e9));
+            const uint32_t rec_head = rec_head_.load(std::memory_order_relaxed);
+            if (rec_head - rec_tail_.load(std::memory_order_acquire) >= kRecorded) continue;
+            recorded_[rec_head & (kRecorded - 1)] = {e.slot, e.port, position_ + offset, e.value};
+            rec_head_.store(rec_head + 1, std::memory_order_release);
+        }
+        tail_.store(tail, std::memory_order_release);
+    }
+
+    // The lanes to play this block, null when there is nothing to play
+    Lanes* active() {
+        Lanes* lanes = lanes_.load(std::memory_order_acquire);
+        if (!playing.load(std::memory_order_relaxed) || !lanes || lanes->count == 0) return nullptr;
+        if (lanes->generation != seen_) {
+            // New set or a locate: find every cursor again
+            seen_ = lanes->generation;
+            for (int i = 0; i < lanes->count; ++i) cursor_[i] = seek(lanes->lane[i], position_);
+        }
+        return lanes;
+    }
+
+    // Write every playing lane's value at frame `offset` of the block into
+    // its plugin and return the frame the next sub-block starts at, no
+    // later than numFrames
+    uint32_t apply(Lanes& lanes, uint32_t offset, uint32_t numFrames, LV2Plugin* const* plugins) {
+        const uint64_t now = position_ + offset;
+        const bool rec = recording.load(std::memory_order_relaxed);
+        uint64_t next = position_ + numFrames;
+
+        for (int i = 0; i < lanes.count; ++i) {
+            Lane& lane = lanes.lane[i];
+            const uint32_t count = lane.count.load(std::memory_order_acquire);
+            if (count == 0 || (rec && lane.armed)) continue;
+
+            uint32_t c = std::min(cursor_[i], count);
+            while (c < count && lane.frame[c] <= now) ++c;
+            cursor_[i] = c;
+
+            float value;
+            if (c == 0) {
+                value = lane.value[0];
+                next = std::min(next, lane.frame[0]);
+            } else if (c == count) {
+                value = lane.value[count - 1];
+            } else if (lane.ramp) {
+                const float t = (float)(now - lane.frame[c - 1]) /
+                                (float)(lane.frame[c] - lane.frame[c - 1]);
+                value = lane.value[c - 1] + (lane.value[c] - lane.value[c - 1]) * t;
+                next = std::min(next, std::min(lane.frame[c], now + kRampStep));
+            } else {
+                value = lane.value[c - 1];
+                next = std::min(next, lane.frame[c]);
+            }
+
+            LV2Plugin* p = plugins[lane.slot - 1];     // slot checked by the writer
+            if (p) p->setControlDirect(lane.port, value);
+        }
+
+        next = std::max(next, now + kMinSplit);
+        return (uint32_t)std::min<uint64_t>(next - position_, numFrames);
+    }
+
+    // End of a block of numFrames
+    void advance(uint32_t numFrames) {
+        if (playing.load(std::memory_order_relaxed)) position_ += numFrames;
+        shown_.store(position_, std::memory_order_relaxed);
+    }
+
+private:
+    struct Event {
+        int64_t time_ns;
+        int32_t slot;
+        uint32_t port;
+        float value;
+    };
+
+    struct Point {
+        int32_t slot;
+        uint32_t port;
+        uint64_t frame;
+        float value;
+    };
+
+    static uint32_t seek(const Lane& lane, uint64_t frame) {
+        const uint32_t count = lane.count.load(std::memory_order_acquire);
+        return (uint32_t)(std::upper_bound(lane.frame, lane.frame + count, frame) - lane.frame);
+    }
+
+    // Punch in at `frame`, dropping the points it supersedes
+    static void append(Lane& lane, uint64_t frame, float value) {
+        uint32_t count = lane.count.load(std::memory_order_relaxed);
+        while (count > 0 && lane.frame[count - 1] >= frame) --count;
+        if (count == kMaxPoints) return;
+        lane.frame[count] = frame;
+        lane.value[count] = value;
+        lane.count.store(count + 1, std::memory_order_release);
+    }
+
+    std::atomic<Lanes*> lanes_{nullptr};
+    std::atomic<uint64_t> locate_{0};
+    std::atomic<bool> relocate_{false};
+    std::atomic<uint64_t> shown_{0};
+
+    // Audio thread state
+    uint64_t position_ = 0;
+    uint64_t seen_ = UINT64_MAX;   // generation the cursors belong to
+    uint32_t cursor_[kMaxLanes] = {};
+
+    // Parameter queue, producers serialised by producer_
+    std::mutex producer_;
+    Event queue_[kQueue];
+    std::atomic<uint32_t> head_{0};
+    std::atomic<uint32_t> tail_{0};
+
+    // Recorded points, audio thread to writer
+    Point recorded_[kRecorded];
+    std::atomic<uint32_t> rec_head_{0};
+    std::atomic<uint32_t> rec_tail_{0};
+};
+
+#endif //OPIQO_AUTOMATION_H
@@ -0,0 +1,43 @@
+/*
+ * CallbackStats.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Running cost of a duplex callback, shared by both engines (PluginChain in
+ * FullDuplexPass.h, jalv in jalv.h) so the same plugin can be compared
+ * through either process path on the same device.
+ */
+
+#ifndef OPIQO_CALLBACKSTATS_H
+#define OPIQO_CALLBACKSTATS_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Written by the audio thread only and read from anywhere (UI, benchmarks,
+ * regression checks).
+ */
+struct CallbackStats {
+    std::atomic<int64_t> last_ns{0};
+    std::atomic<int64_t> max_ns{0};
+    std::atomic<int64_t> total_ns{0};
+    std::atomic<uint64_t> callbacks{0};
+
+    void record(int64_t ns) {
+        last_ns.store(ns, std::memory_order_relaxed);
+        if (ns > max_ns.load(std::memory_order_relaxed))
+            max_ns.store(ns, std::memory_order_relaxed);
+        total_ns.fetch_add(ns, std::memory_order_relaxed);
+        callbacks.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void reset() {
+        last_ns.store(0, std::memory_order_relaxed);
+        max_ns.store(0, std::memory_order_relaxed);
+        total_ns.store(0, std::memory_order_relaxed);
+        callbacks.store(0, std::memory_order_relaxed);
+    }
+};
+
+#endif //OPIQO_CALLBACKSTATS_H
@@ -17,56 +17,90 @@
 #ifndef SAMPLES_FULLDUPLEXPASS_H
 #define SAMPLES_FULLDUPLEXPASS_H
 
-#include "LV2Plugin.hpp"
+#include "CallbackStats.h"
+#include "InputStage.h"
+#include "Limiter.h"
+#include "MidiInput.h"
+#include "PluginChain.h"
+
+#include <chrono>
 
 class FullDuplexPass : public oboe::FullDuplexStream {
 public:
-    LV2Plugin* plugin, *plugin1, *plugin2, *plugin3, *plugin4;
+    PluginChain* chain = nullptr;
+    InputStage* input = nullptr;
+    Limiter* limiter = nullptr;
+    MidiInput* midi = nullptr;
+    double sampleRate = 48000;
     LilvInstance *instance;
+    CallbackStats stats;
+
     virtual oboe::DataCallbackResult
     onBothStreamsReady(
             const void *inputData,
             int   numInputFrames,
             void *outputData,
             int   numOutputFrames) {
-        // Copy the input samples to the output with a little arbitrary gain change.
+        const auto start = std::chrono::steady_clock::now();
 
         // This code assumes the data format for both streams is Float.
-        const float *inputFloats = static_cast<const float *>(inputData);
-        float *outputFloats = static_cast<float *>(outputData);
-
         // It also assumes the channel count for each stream is the same.
-        int32_t samplesPerFrame = getOutputStream()->getChannelCount();
+        processDuplex(static_cast<const float *>(inputData), numInputFrames,
+                      static_cast<float *>(outputData), numOutputFrames,
+                      getOutputStream()->getChannelCount());
+
+        stats.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count());
+        return oboe::DataCallbackResult::Continue;
+    }
+
+    /**
+     * The stream independent part of the callback, so it can be driven with
+     * scripted buffer sizes off-device.
+     */
+    void processDuplex(const float *inputFloats, int numInputFrames,
+                       float *outputFloats, int numOutputFrames,
+                       int32_t samplesPerFrame) {
         int32_t numInputSamples = numInputFrames * samplesPerFrame;
         int32_t numOutputSamples = numOutputFrames * samplesPerFrame;
 
         // It is possible that there may be fewer input than output samples.
         int32_t samplesToProcess = std::min(numInputSamples, numOutputSamples);
-        for (int32_t i = 0; i < samplesToProcess; i++) {
-//            *outputFloats++ = *inputFloats++ * 0.95; // do some arbitrary processing
-//             inputFloats += samplesPerFrame;
-//             outputFloats += samplesPerFrame;
+
+        // The input buffer is ours for the callback, condition it in place
+        bool silent = false;
+        if (input)
+            silent = input->process(const_cast<float *>(inputFloats), samplesToProcess);
+
+        // MIDI that arrived during the previous block, at the offsets it
+        // arrived at. Plugins run over the interleaved buffer, so offsets
+        // are counted in samples.
+        MidiEvent events[MidiInput::kMaxPerBlock];
+        uint32_t midiCount = 0;
+        if (samplesPerFrame > 0) {
+            const int32_t frames = samplesToProcess / samplesPerFrame;
+            const int64_t blockStart = MidiInput::now() - (int64_t)(1e9 * frames / sampleRate);
+            if (midi)
+                midiCount = midi->collect(blockStart, samplesToProcess,
+                                          sampleRate * samplesPerFrame, events,
+                                          MidiInput::kMaxPerBlock);
+            // Knob moves being recorded, placed the same way
+            if (chain)
+                chain->automation().begin(blockStart, frames, sampleRate);
         }
 
-        if (plugin1)
-            plugin1->process(const_cast<float *>(inputFloats), outputFloats, samplesToProcess);
-        if (plugin2)
-            plugin2->process(const_cast<float *>(inputFloats), outputFloats, samplesToProcess);
-        if (plugin3)
-            plugin3->process(const_cast<float *>(inputFloats), outputFloats, samplesToProcess);
-        if (plugin4)
-            plugin4->process(const_cast<float *>(inputFloats), outputFloats, samplesToProcess);
+        if (chain)
+            chain->process(const_cast<float *>(inputFloats), outputFloats, samplesToProcess,
+                           samplesPerFrame, silent, events, midiCount);
+
+        // Safety stage after the last slot
+        if (limiter)
+            limiter->process(outputFloats, samplesToProcess);
 
-//        lilv_instance_connect_port(instance, 0, const_cast<float *>(outputFloats));
-//        lilv_instance_connect_port(instance, 1, (void *) inputFloats);
-//        lilv_instance_run(instance, samplesToProcess);
         // If there are fewer input samples then clear the rest of the buffer.
-        int32_t samplesLeft = numOutputSamples - numInputSamples;
-        for (int32_t i = 0; i < samplesLeft; i++) {
-            *outputFloats++ = 0.0; // silence
+        for (int32_t i = samplesToProcess; i < numOutputSamples; i++) {
+            outputFloats[i] = 0.0; // silence
         }
-
-        return oboe::DataCallbackResult::Continue;
     }
 };
 #endif //SAMPLES_FULLDUPLEXPASS_H
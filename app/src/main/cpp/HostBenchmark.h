@@ -0,0 +1,123 @@
+/*
+ * HostBenchmark.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Offline measurement of host overhead per slot.
+ *
+ * Builds chains of 1, 2, 4 ... up to maxSlots (at most PluginChain::kSlots)
+ * instances of one plugin (normally the reference unity plugin, so
+ * lilv_instance_run is close to a memcpy) in a PluginChain of its own and
+ * runs it through PluginChain::process() on an interleaved stereo block,
+ * as the duplex callback does. Each slot's plugin has a HostProfile
+ * attached for its own stages; whatever else process() took (slot mix at
+ * half wet, meters, latency compensation, the idle check) is reported as
+ * the chain stage. Reports the mean cost of each stage per slot and cycle.
+ * Runs on the calling thread, never on the audio callback.
+ */
+
+#ifndef OPIQO_HOSTBENCHMARK_H
+#define OPIQO_HOSTBENCHMARK_H
+
+#include "HostProfile.h"
+#include "LV2Plugin.hpp"
+#include "PluginChain.h"
+#include "json.hpp"
+
+#include <algorithm>
+#include <vector>
+
+class HostBenchmark {
+public:
+    static constexpr const char* kReferenceUri = "http://acoustixaudio.org/plugins/opiqo-ref#unity";
+
+    HostBenchmark(LilvWorld* world, double sample_rate, int frames, int cycles)
+        : world_(world), sample_rate_(sample_rate), frames_(frames), cycles_(cycles) {}
+
+    // Returns {"uri", "frames", "cycles", "results": [{"slots", "<stage>", ...}]}
+    nlohmann::json run(const char* uri, int maxSlots) {
+        nlohmann::json report = {
+                {"uri", uri}, {"frames", frames_}, {"cycles", cycles_},
+                {"results", nlohmann::json::array()}
+        };
+
+        for (int slots = 1; slots <= std::min(maxSlots, PluginChain::kSlots); slots *= 2) {
+            nlohmann::json row;
+            if (!measure(uri, slots, row)) {
+                report["error"] = "failed to instantiate " + std::to_string(slots) + " slots";
+                break;
+            }
+            report["results"].push_back(row);
+        }
+        return report;
+    }
+
+private:
+    static constexpr int kChannels = 2;
+    static constexpr int kWarmup = 64;
+
+    bool measure(const char* uri, int slots, nlohmann::json& row) {
+        PluginChain chain;
+        chain.modulation().prepare(sample_rate_);
+        std::vector<HostProfile> profiles(slots);
+        PluginChain::Slots rig;
+        for (int i = 0; i < slots; ++i) {
+            auto* plugin = new LV2Plugin(world_, uri, sample_rate_, frames_ * kChannels);
+            if (!plugin->initialize()) {
+                delete plugin;
+                chain.replaceAll(rig);
+                return false;
+            }
+            plugin->start();
+            plugin->setProfile(&profiles[i]);
+            rig.plugin[i] = plugin;
+            chain.setMix(i + 1, 0.5f);
+        }
+        chain.replaceAll(rig);
+
+        const int samples = frames_ * kChannels;
+        std::vector<float> in(samples), out(samples);
+        HostProfile outer;
+
+        for (int c = 0; c < kWarmup + cycles_; ++c) {
+            if (c == kWarmup) {
+                outer.reset();
+                for (auto& p : profiles) p.reset();
+            }
+
+            // process() uses its input as scratch
+            std::fill(in.begin(), in.end(), 0.25f);
+            const uint64_t t = HostProfile::now();
+            chain.process(in.data(), out.data(), samples, kChannels);
+            outer.lap(HostProfile::Run, t);
+            outer.endCycle();
+        }
+
+        row["slots"] = slots;
+        double overhead = 0.0, plugins = 0.0;
+        for (int s = 0; s < HostProfile::kStages; ++s) {
+            if (s == HostProfile::Chain) continue;
+            double ns = 0.0;
+            for (auto& p : profiles) ns += p.mean((HostProfile::Stage)s);
+            plugins += ns;
+            ns /= slots;
+            row[HostProfile::stageName(s)] = ns;
+            if (s != HostProfile::Run) overhead += ns;
+        }
+        // Everything process() did outside the plugins
+        const double around = std::max(0.0, outer.mean(HostProfile::Run) - plugins) / slots;
+        row[HostProfile::stageName(HostProfile::Chain)] = around;
+        row["overhead"] = overhead + around;
+
+        // The chain destroys its plugins, the profiles go with this frame
+        chain.replaceAll(PluginChain::Slots());
+        return true;
+    }
+
+    LilvWorld* world_;
+    double sample_rate_;
+    int frames_;
+    int cycles_;
+};
+
+#endif //OPIQO_HOSTBENCHMARK_H
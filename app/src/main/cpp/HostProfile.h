@@ -0,0 +1,80 @@
+/*
+ * HostProfile.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Per-slot breakdown of where a process cycle goes: the plugin's own
+ * lilv_instance_run versus the host work around it.
+ *
+ * Profiling is off unless a HostProfile is attached to a plugin, in which
+ * case LV2Plugin::process() takes a timestamp between stages and adds the
+ * difference to the stage total. Totals are relaxed atomics written only by
+ * the audio thread, so any thread may read them while audio runs.
+ */
+
+#ifndef OPIQO_HOSTPROFILE_H
+#define OPIQO_HOSTPROFILE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+struct HostProfile {
+    enum Stage {
+        Connect = 0,    // control staging and audio port connection
+        AtomIn,         // UI→DSP atoms into input sequences
+        Run,            // lilv_instance_run
+        Worker,         // worker response delivery
+        AtomOut,        // output sequences scanned into rings
+        Chain,          // slot mix, meters, latency and idle checks around the plugins
+        kStages
+    };
+
+    static const char* stageName(int stage) {
+        static const char* const names[kStages] = {
+            "connect", "atom_in", "run", "worker", "atom_out", "chain"
+        };
+        return stage >= 0 && stage < kStages ? names[stage] : "?";
+    }
+
+    static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Add the time since start to stage and return the new timestamp
+    uint64_t lap(Stage stage, uint64_t start) {
+        const uint64_t t = now();
+        ns[stage].fetch_add(t - start, std::memory_order_relaxed);
+        return t;
+    }
+
+    void endCycle() {
+        cycles.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Mean nanoseconds per cycle spent in stage
+    double mean(Stage stage) const {
+        const uint64_t n = cycles.load(std::memory_order_relaxed);
+        return n ? (double)ns[stage].load(std::memory_order_relaxed) / (double)n : 0.0;
+    }
+
+    // Mean host overhead per cycle, everything except Run
+    double meanOverhead() const {
+        double total = 0.0;
+        for (int s = 0; s < kStages; ++s) {
+            if (s != Run) total += mean((Stage)s);
+        }
+        return total;
+    }
+
+    void reset() {
+        for (auto& n : ns) n.store(0, std::memory_order_relaxed);
+        cycles.store(0, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> ns[kStages] = {};
+    std::atomic<uint64_t> cycles{0};
+};
+
+#endif //OPIQO_HOSTPROFILE_H
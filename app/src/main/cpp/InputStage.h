@@ -0,0 +1,211 @@
+/*
+ * InputStage.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Built-in conditioning of the input before the plugin chain: DC blocker,
+ * optional high-pass and a downward expander/gate with lookahead.
+ *
+ * The filters are per-channel recursions over the interleaved buffer (each
+ * sample depends on the last, so they stay scalar); the high-pass replaces
+ * the DC blocker when it is on. The gate works in groups of kGroup frames:
+ * the four-lane peak of the incoming group drives the gain that is ramped
+ * over the group leaving the lookahead delay, so the gate is already open
+ * when a transient reaches the output. The delay is only in the path while
+ * the gate is on, and latency() reports it.
+ *
+ * process() returns true when the gate was shut for the whole block, i.e.
+ * the block is exact silence. PluginChain uses that to idle slots whose
+ * output has died away.
+ */
+
+#ifndef OPIQO_INPUTSTAGE_H
+#define OPIQO_INPUTSTAGE_H
+
+#include "Simd.h"
+#include "SlotMix.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+class InputStage {
+public:
+    static constexpr int kMaxChannels = 2;
+    static constexpr int kGroup = 16;           // frames per gate gain step
+
+    // Settings, written from any thread
+    std::atomic<bool> dc_block{true};
+    std::atomic<bool> high_pass{false};
+    std::atomic<float> high_pass_hz{80.0f};
+    std::atomic<bool> gate{false};
+    std::atomic<float> threshold_db{-60.0f};
+    std::atomic<float> ratio{8.0f};             // expansion below threshold
+    std::atomic<float> attack_ms{1.0f};
+    std::atomic<float> release_ms{100.0f};
+
+    // Not real-time: size the lookahead for the stream about to start
+    void prepare(double rate, int channels, float lookahead_ms = 2.0f) {
+        rate_ = rate;
+        channels_ = std::clamp(channels, 1, kMaxChannels);
+        lookahead_ = std::max(kGroup, (int)std::lround(rate * lookahead_ms / 1000.0));
+        delay_.assign((size_t)lookahead_ * channels_, 0.0f);
+        pos_ = 0;
+        gain_ = 0.0f;
+        env_ = 0.0f;
+        gate_on_ = false;
+        hp_hz_ = 0.0f;
+        for (auto& f : filter_) f = Filter();
+    }
+
+    // Frames of delay the stage adds right now
+    int latency() const {
+        return gate.load(std::memory_order_relaxed) ? lookahead_ : 0;
+    }
+
+    // ---------------------------------------------------------------------
+    // Audio thread
+    // ---------------------------------------------------------------------
+
+    // In place over numSamples interleaved samples. True if the block is
+    // gated to silence.
+    bool process(float* buf, int numSamples) {
+        if (delay_.empty() || numSamples <= 0) return false;
+
+        if (high_pass.load(std::memory_order_relaxed)) {
+            highPass(buf, numSamples);
+        } else if (dc_block.load(std::memory_order_relaxed)) {
+            dcBlock(buf, numSamples);
+        }
+
+        const bool on = gate.load(std::memory_order_relaxed);
+        if (on != gate_on_) {
+            // Entering or leaving the delay path, start from a clean line
+            std::fill(delay_.begin(), delay_.end(), 0.0f);
+            pos_ = 0;
+            gain_ = 0.0f;
+            env_ = 0.0f;
+            gate_on_ = on;
+        }
+        if (!on) return false;
+        return expand(buf, numSamples);
+    }
+
+private:
+    static constexpr float kFloor = 1e-4f;      // -80 dB, below this the gate shuts
+    static constexpr float kDcHz = 10.0f;
+
+    struct Filter {
+        float x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+    };
+
+    void dcBlock(float* buf, int numSamples) {
+        const float r = 1.0f - (float)(2.0 * M_PI * kDcHz / rate_);
+        for (int c = 0; c < channels_; ++c) {
+            Filter& f = filter_[c];
+            for (int i = c; i < numSamples; i += channels_) {
+                const float x = buf[i];
+                const float y = x - f.x1 + r * f.y1;
+                f.x1 = x;
+                f.y1 = y;
+                buf[i] = y;
+            }
+        }
+    }
+
+    // Butterworth high-pass, coefficients refreshed when the cutoff moves
+    void highPass(float* buf, int numSamples) {
+        const float hz = std::clamp(high_pass_hz.load(std::memory_order_relaxed),
+                                    10.0f, (float)rate_ * 0.45f);
+        if (hz != hp_hz_) {
+            hp_hz_ = hz;
+            const double w = 2.0 * M_PI * hz / rate_;
+            const double alpha = std::sin(w) / (2.0 * M_SQRT1_2);
+            const double cw = std::cos(w);
+            const double a0 = 1.0 + alpha;
+            b0_ = (float)((1.0 + cw) / 2.0 / a0);
+            b1_ = (float)(-(1.0 + cw) / a0);
+            a1_ = (float)(-2.0 * cw / a0);
+            a2_ = (float)((1.0 - alpha) / a0);
+        }
+
+        for (int c = 0; c < channels_; ++c) {
+            Filter& f = filter_[c];
+            for (int i = c; i < numSamples; i += channels_) {
+                const float x = buf[i];
+                const float y = b0_ * x + b1_ * f.x1 + b0_ * f.x2 - a1_ * f.y1 - a2_ * f.y2;
+                f.x2 = f.x1;
+                f.x1 = x;
+                f.y2 = f.y1;
+                f.y1 = y;
+                buf[i] = y;
+            }
+        }
+    }
+
+    bool expand(float* buf, int numSamples) {
+        const float threshold = std::pow(10.0f, threshold_db.load(std::memory_order_relaxed) / 20.0f);
+        const float exponent = std::max(1.0f, ratio.load(std::memory_order_relaxed)) - 1.0f;
+        const float group_s = (float)kGroup / (float)rate_;
+        const float attack = 1.0f - std::exp(-group_s * 1000.0f /
+                std::max(0.01f, attack_ms.load(std::memory_order_relaxed)));
+        const float release = std::exp(-group_s * 1000.0f /
+                std::max(1.0f, release_ms.load(std::memory_order_relaxed)));
+
+        const int step = kGroup * channels_;
+        const int line = (int)delay_.size();
+        bool closed = true;
+        float held[kGroup * kMaxChannels];
+
+        for (int off = 0; off < numSamples; off += step) {
+            const int n = std::min(step, numSamples - off);
+            float* group = buf + off;
+
+            // Detector sees the input lookahead frames before the output does
+            env_ = std::max(simd::peak(group, n), env_ * release);
+            float target = 1.0f;
+            if (env_ < threshold) {
+                target = std::pow(env_ / threshold, exponent);
+                if (target < kFloor) target = 0.0f;
+            }
+            const float from = gain_;
+            gain_ = target > gain_ ? gain_ + (target - gain_) * attack : target;
+            if (from != 0.0f || gain_ != 0.0f) closed = false;
+
+            // Swap the group through the delay line
+            const int first = std::min(n, line - pos_);
+            memcpy(held, delay_.data() + pos_, sizeof(float) * first);
+            memcpy(delay_.data() + pos_, group, sizeof(float) * first);
+            if (first < n) {
+                memcpy(held + first, delay_.data(), sizeof(float) * (n - first));
+                memcpy(delay_.data(), group + first, sizeof(float) * (n - first));
+            }
+            pos_ = (pos_ + n) % line;
+
+            if (from == 0.0f && gain_ == 0.0f) {
+                memset(group, 0, sizeof(float) * n);
+            } else {
+                slotmix::apply(held, held, group, n, channels_,
+                               MixGains::gain(from), MixGains::gain(gain_));
+            }
+        }
+        return closed;
+    }
+
+    double rate_ = 48000;
+    int channels_ = 1;
+    int lookahead_ = 0;
+
+    // Audio thread state
+    Filter filter_[kMaxChannels];
+    float hp_hz_ = 0.0f;
+    float b0_ = 1, b1_ = 0, a1_ = 0, a2_ = 0;
+    std::vector<float> delay_;
+    int pos_ = 0;
+    float env_ = 0.0f;
+    float gain_ = 0.0f;
+    bool gate_on_ = false;
+};
+
+#endif //OPIQO_INPUTSTAGE_H
@@ -0,0 +1,291 @@
+/*
+ * InstancePool.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Warm plugin instances, ready to be put into a slot without waiting.
+ *
+ * A background thread builds instances ahead of need: initialized,
+ * activated and run for kWarmupBlocks silent blocks at the current sample
+ * rate. take() hands one over at once when there is one, and the slot skips
+ * the synchronous construct + initialize() on the UI thread.
+ *
+ * What is built:
+ *   - prefetch(): a plugin the picker has highlighted, the most likely next
+ *     pick, ahead of anything else queued;
+ *   - after every take(), a replacement for that plugin, so the N most
+ *     recently used plugins keep a warm instance each.
+ *
+ * The pool holds at most `capacity` instances; past it the least recently
+ * used one is destroyed. The limit is a count, not bytes: the heap an
+ * instance holds cannot be told apart from what other threads allocate
+ * meanwhile, nor from plugin allocators malloc hooks never see. Stats
+ * report the process-wide heap growth seen while each pooled instance was
+ * built, a hint for choosing the capacity and nothing more. A sample rate
+ * change drops every instance built for the old rate.
+ *
+ * Sandboxed plugins are never pooled, their instance lives in another
+ * process.
+ */
+
+#ifndef OPIQO_INSTANCEPOOL_H
+#define OPIQO_INSTANCEPOOL_H
+
+#include "LV2Plugin.hpp"
+#include "ThreadManager.h"
+#include "logging_macros.h"
+
+#include <malloc.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class InstancePool {
+public:
+    static constexpr size_t kDefaultCapacity = 4;
+    static constexpr size_t kMaxQueued = 4;
+    static constexpr int kWarmupBlocks = 4;
+    static constexpr int kWarmupFrames = 256;
+
+    struct Stats {
+        uint64_t pooled = 0;
+        uint64_t bytes = 0;         // heap growth while building them, see above
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t built = 0;
+        uint64_t evicted = 0;
+    };
+
+    // Builds an uninitialized plugin for `uri` at `rate`, on the pool's thread
+    using Factory = std::function<LV2Plugin*(const std::string& uri, double rate)>;
+
+    explicit InstancePool(Factory factory) : factory_(std::move(factory)) {}
+
+    ~InstancePool() {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            running_ = false;
+            queue_.clear();
+        }
+        wake_.notify_all();
+        if (thread_.joinable()) thread_.join();
+        clear();
+    }
+
+    InstancePool(const InstancePool&) = delete;
+    InstancePool& operator=(const InstancePool&) = delete;
+
+    // Most instances kept warm, applied at once
+    void setCapacity(size_t capacity) {
+        std::vector<Entry> evicted;
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            capacity_ = capacity;
+            trim(evicted);
+        }
+        destroy(evicted);
+    }
+
+    // The picker highlighted `uri`: build an instance if none is warm
+    void prefetch(const std::string& uri, double rate) {
+        request(uri, rate, true);
+    }
+
+    // A warm instance of `uri` at `rate`, or null. Either way the plugin is
+    // now recently used and one is built for next time.
+    LV2Plugin* take(const std::string& uri, double rate) {
+        LV2Plugin* plugin = nullptr;
+        std::vector<Entry> dropped;
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            retune(rate, dropped);
+            auto it = find(uri);
+            if (it != pool_.end()) {
+                plugin = it->plugin;
+                bytes_ -= it->bytes;
+                pool_.erase(it);
+                ++hits_;
+            } else {
+                ++misses_;
+            }
+        }
+        destroy(dropped);
+        request(uri, rate, false);
+        return plugin;
+    }
+
+    // Destroy every pooled instance
+    void clear() {
+        std::vector<Entry> all;
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            all.assign(pool_.begin(), pool_.end());
+            pool_.clear();
+            bytes_ = 0;
+        }
+        destroy(all);
+    }
+
+    Stats stats() {
+        std::lock_guard<std::mutex> lock(lock_);
+        Stats s;
+        s.pooled = pool_.size();
+        s.bytes = bytes_;
+        s.hits = hits_;
+        s.misses = misses_;
+        s.built = built_;
+        s.evicted = evicted_;
+        return s;
+    }
+
+private:
+    struct Entry {
+        std::string uri;
+        LV2Plugin* plugin = nullptr;
+        size_t bytes = 0;           // heap growth while it was built
+    };
+
+    // Under lock_: front is the most recently used
+    std::list<Entry>::iterator find(const std::string& uri) {
+        return std::find_if(pool_.begin(), pool_.end(), [&](const Entry& e) { return e.uri == uri; });
+    }
+
+    // Under lock_: a new rate makes every pooled instance useless
+    void retune(double rate, std::vector<Entry>& dropped) {
+        if (rate == rate_) return;
+        rate_ = rate;
+        dropped.insert(dropped.end(), pool_.begin(), pool_.end());
+        pool_.clear();
+        queue_.clear();
+        bytes_ = 0;
+    }
+
+    // Under lock_: evict from the back until within the capacity
+    void trim(std::vector<Entry>& evicted) {
+        while (!pool_.empty() && pool_.size() > capacity_) {
+            bytes_ -= pool_.back().bytes;
+            evicted.push_back(pool_.back());
+            pool_.pop_back();
+            ++evicted_;
+        }
+    }
+
+    void request(const std::string& uri, double rate, bool speculative) {
+        std::vector<Entry> dropped;
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            retune(rate, dropped);
+            auto it = find(uri);
+            if (it != pool_.end()) {
+                // Already warm, just recently used again
+                pool_.splice(pool_.begin(), pool_, it);
+            } else if (capacity_ > 0 && uri != building_ &&
+                       std::find(queue_.begin(), queue_.end(), uri) == queue_.end()) {
+                if (speculative)
+                    queue_.push_front(uri);
+                else
+                    queue_.push_back(uri);
+                // Highlights go stale quickly: forget the oldest
+                if (queue_.size() > kMaxQueued) queue_.pop_back();
+                if (!thread_.joinable())
+                    thread_ = ThreadManager::get().spawn(ThreadManager::Role::Background,
+                                                         "instance-pool", &InstancePool::run, this);
+            }
+        }
+        destroy(dropped);
+        wake_.notify_one();
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(lock_);
+        while (running_) {
+            wake_.wait(lock, [this] { return !running_ || !queue_.empty(); });
+            if (!running_) break;
+            building_ = queue_.front();
+            queue_.pop_front();
+            const std::string uri = building_;
+            const double rate = rate_;
+            lock.unlock();
+
+            Entry e = build(uri, rate);
+
+            std::vector<Entry> evicted;
+            lock.lock();
+            building_.clear();
+            if (e.plugin && rate == rate_ && capacity_ > 0 && find(uri) == pool_.end()) {
+                pool_.push_front(e);
+                bytes_ += e.bytes;
+                ++built_;
+                trim(evicted);
+            } else if (e.plugin) {
+                evicted.push_back(e);
+            }
+            lock.unlock();
+            destroy(evicted);
+            lock.lock();
+        }
+    }
+
+    Entry build(const std::string& uri, double rate) {
+        Entry e;
+        e.uri = uri;
+        const size_t before = heap();
+        LV2Plugin* plugin = factory_(uri, rate);
+        if (!plugin || !plugin->initialize()) {
+            LOGE("[InstancePool] Failed to build %s", uri.c_str());
+            delete plugin;
+            return e;
+        }
+        plugin->start();
+        std::vector<float> in(kWarmupFrames, 0.0f), out(kWarmupFrames, 0.0f);
+        for (int b = 0; b < kWarmupBlocks; ++b) plugin->process(in.data(), out.data(), kWarmupFrames);
+
+        const size_t after = heap();
+        e.plugin = plugin;
+        e.bytes = after > before ? after - before : 0;
+        LOGD("[InstancePool] %s warm, %zu KiB", uri.c_str(), e.bytes >> 10);
+        return e;
+    }
+
+    // Heap in use by the whole process, small blocks and mmapped ones
+    static size_t heap() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+        const struct mallinfo2 m = mallinfo2();
+#else
+        const struct mallinfo m = mallinfo();
+#endif
+        return (size_t)m.uordblks + (size_t)m.hblkhd;
+    }
+
+    static void destroy(std::vector<Entry>& entries) {
+        for (auto& e : entries) {
+            e.plugin->closePlugin();
+            delete e.plugin;
+        }
+        entries.clear();
+    }
+
+    Factory factory_;
+    std::mutex lock_;
+    std::condition_variable wake_;
+    std::thread thread_;
+    bool running_ = true;
+
+    std::list<Entry> pool_;
+    std::deque<std::string> queue_;
+    std::string building_;
+    double rate_ = 0;
+    size_t capacity_ = kDefaultCapacity;
+    size_t bytes_ = 0;
+    uint64_t hits_ = 0, misses_ = 0, built_ = 0, evicted_ = 0;
+};
+
+#endif //OPIQO_INSTANCEPOOL_H
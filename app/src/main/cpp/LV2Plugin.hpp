@@ -20,6 +20,12 @@
 #pragma once
 
 #include "lv2_ringbuffer.h"
+#include "HostProfile.h"
+#include "MidiInput.h"
+#include "PluginLog.h"
+#include "RtLog.h"
+#include "SandboxHost.h"
+#include "ThreadManager.h"
 #include <lilv/lilv.h>
 
 #include <lv2/urid/urid.h>
@@ -35,11 +41,15 @@
 #include <lv2/resize-port/resize-port.h>
 #include <lv2/midi/midi.h>
 
+#include <dlfcn.h>
+
 #include <atomic>
 #include <algorithm>
+#include <cmath>
 #include <cstdint>
 #include <cstring>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <unordered_map>
@@ -68,6 +78,9 @@ public:
     virtual const LilvPort* getPort() const = 0;
     virtual void reset() = 0;
 
+    // A copy for another instance of the same plugin, caller owns it
+    virtual PluginControl* clone() const = 0;
+
     // Factory: caller owns returned pointer
     static PluginControl* create(LilvWorld* world, const LilvPlugin* plugin,
                                   const LilvPort* port, const LilvNode* audio_class,
@@ -125,6 +138,7 @@ public:
     const char* getSymbol() const override { return symbol_.c_str(); }
     const LilvPort* getPort() const override { return port_; }
     void reset() override { value_ = defvalue_; }
+    PluginControl* clone() const override { return new ControlPortFloat(*this); }
     
     float* getValuePtr() { return &value_; }
 
@@ -179,6 +193,7 @@ public:
     const char* getSymbol() const override { return symbol_.c_str(); }
     const LilvPort* getPort() const override { return port_; }
     void reset() override { value_ = defvalue_; }
+    PluginControl* clone() const override { return new ToggleControl(*this); }
     
     float getAsFloat() const { return value_ ? 1.0f : 0.0f; }
 
@@ -222,6 +237,7 @@ public:
     const char* getSymbol() const override { return symbol_.c_str(); }
     const LilvPort* getPort() const override { return port_; }
     void reset() override { armed_ = false; }
+    PluginControl* clone() const override { return new TriggerControl(*this); }
     
     bool isArmed() { return armed_; }
     float getAsFloat() const { return armed_ ? 1.0f : 0.0f; }
@@ -291,11 +307,17 @@ public:
     const char* getSymbol() const override { return symbol_.c_str(); }
     const LilvPort* getPort() const override { return port_; }
     void reset() override { atom_state_->ui_to_dsp.clear(); }
+
+    // Same port, its own (empty) atom state
+    PluginControl* clone() const override { return new AtomPortControl(port_, symbol_); }
     
     AtomState* getAtomState() { return atom_state_; }
     void setMessageType(uint32_t type_urid) { atom_state_->ui_to_dsp_type = type_urid; }
 
 private:
+    AtomPortControl(const LilvPort* port, std::string symbol)
+        : port_(port), atom_state_(new AtomState()), symbol_(std::move(symbol)) {}
+
     const LilvPort* port_;
     AtomState* atom_state_;
     std::string symbol_;
@@ -320,6 +342,7 @@ public:
           max_block_length_(max_block_length), instance_(nullptr),
           required_atom_size_(8192), shutdown_(false) {
         if (world_ && plugin_uri) {
+            std::lock_guard<std::mutex> lock(worldLock());
             const LilvPlugins* plugins = lilv_world_get_all_plugins(world_);
             LilvNode* uri = lilv_new_uri(world_, plugin_uri);
             if (uri) {
@@ -333,22 +356,35 @@ public:
         closePlugin();
     }
 
+    // Lilv and its world are not thread safe: anything that queries or
+    // changes the world takes this lock, so plugins can be loaded from
+    // several threads at once (see SessionLoader.h)
+    static std::mutex& worldLock() {
+        static std::mutex lock;
+        return lock;
+    }
+
     // Initialize plugin: discover ports, create controls, instantiate instance
     bool initialize() {
         if (!world_ || !plugin_) return false;
 
-        // Create port class nodes
-        audio_class_ = lilv_new_uri(world_, LV2_CORE__AudioPort);
-        control_class_ = lilv_new_uri(world_, LV2_CORE__ControlPort);
-        atom_class_ = lilv_new_uri(world_, LV2_ATOM__AtomPort);
-        input_class_ = lilv_new_uri(world_, LV2_CORE__InputPort);
-        rsz_minimumSize_ = lilv_new_uri(world_, LV2_RESIZE_PORT__minimumSize);
+        {
+            std::lock_guard<std::mutex> lock(worldLock());
 
-        init_urids();
-        init_features();
-        
-        if (!check_resize_port_requirements()) return false;
-        if (!init_ports()) return false;
+            // Create port class nodes
+            audio_class_ = lilv_new_uri(world_, LV2_CORE__AudioPort);
+            control_class_ = lilv_new_uri(world_, LV2_CORE__ControlPort);
+            atom_class_ = lilv_new_uri(world_, LV2_ATOM__AtomPort);
+            input_class_ = lilv_new_uri(world_, LV2_CORE__InputPort);
+            rsz_minimumSize_ = lilv_new_uri(world_, LV2_RESIZE_PORT__minimumSize);
+
+            init_urids();
+            init_features();
+
+            if (!check_resize_port_requirements()) return false;
+            if (!init_ports()) return false;
+        }
+        if (sandbox_) return init_sandbox();
         if (!init_instance()) return false;
 
         return true;
@@ -366,11 +402,21 @@ public:
     }
 
     void closePlugin() {
+        sandbox_.reset();
         stop_worker();
 
         if (instance_) {
             lilv_instance_deactivate(instance_);
-            lilv_instance_free(instance_);
+            if (library_) {
+                // Instantiated by instantiate(), not by lilv
+                if (instance_->lv2_descriptor->cleanup)
+                    instance_->lv2_descriptor->cleanup(instance_->lv2_handle);
+                free(instance_);
+                dlclose(library_);
+                library_ = nullptr;
+            } else {
+                lilv_instance_free(instance_);
+            }
             instance_ = nullptr;
         }
 
@@ -380,6 +426,8 @@ public:
             delete p.atom_state;
         }
         ports_.clear();
+        pending_controls_.reset();
+        control_dirty_.reset();
         
         for (auto* control : controls_) {
             delete control;
@@ -387,21 +435,43 @@ public:
         controls_.clear();
 
         // Free Lilv nodes (but NOT world or plugin—caller owns those)
+        std::lock_guard<std::mutex> lock(worldLock());
         if (audio_class_) lilv_node_free(audio_class_);
         if (control_class_) lilv_node_free(control_class_);
         if (atom_class_) lilv_node_free(atom_class_);
         if (input_class_) lilv_node_free(input_class_);
         if (rsz_minimumSize_) lilv_node_free(rsz_minimumSize_);
+        audio_class_ = control_class_ = atom_class_ = input_class_ = rsz_minimumSize_ = nullptr;
     }
 
     // RT-safe audio processing with atom message handling
     bool process(float* inputBuffer, float* outputBuffer, int numFrames) {
-        if (shutdown_.load(std::memory_order_acquire) || !instance_)
+        // MIDI set for this cycle is used by it or dropped, whichever way
+        // it returns, never replayed by the next
+        const uint32_t midiCount = midi_in_count_;
+        midi_in_count_ = 0;
+
+        if (shutdown_.load(std::memory_order_acquire) || (!instance_ && !sandbox_))
             return false;
 
         if (!inputBuffer || !outputBuffer || numFrames <= 0)
             return false;
 
+        HostProfile* prof = profile_;
+        uint64_t t = prof ? HostProfile::now() : 0;
+
+        // Apply control values staged from other threads, only to the ports
+        // they changed: the others keep what modulation and automation wrote
+        if (controls_dirty_.exchange(false, std::memory_order_acquire)) {
+            for (auto& p : ports_) {
+                if (p.is_control && p.is_input &&
+                    control_dirty_[p.index].exchange(false, std::memory_order_acquire))
+                    p.control = pending_controls_[p.index].load(std::memory_order_relaxed);
+            }
+        }
+
+        if (sandbox_) return process_sandboxed(inputBuffer, outputBuffer, numFrames, midiCount, prof, t);
+
         // --- Step A: Connect audio port buffers ---
         uint32_t input_index = 0, output_index = 0;
         for (auto& p : ports_) {
@@ -412,16 +482,18 @@ public:
             lilv_instance_connect_port(instance_, p.index, target);
         }
 
-        // --- Step B: Process incoming UI→DSP atom messages ---
+        if (prof) t = prof->lap(HostProfile::Connect, t);
+
+        // --- Step B: Process incoming UI→DSP atom messages and MIDI ---
         for (auto& p : ports_) {
             if (!p.is_atom || !p.is_input) continue;
-            
+
+            p.atom->atom.type = urids_.atom_Sequence;
+            lv2_atom_sequence_clear(p.atom);
+
             // Check for pending UI message
             if (p.atom_state->ui_to_dsp_pending.exchange(false, std::memory_order_acquire)) {
                 // Wrap UI data in LV2_Atom_Event and append to sequence
-                p.atom->atom.type = urids_.atom_Sequence;
-                p.atom->atom.size = 0;
-                
                 const uint32_t body_size = p.atom_state->ui_to_dsp.size();
                 uint8_t evbuf[sizeof(LV2_Atom_Event) + body_size];
                 LV2_Atom_Event* ev = (LV2_Atom_Event*)evbuf;
@@ -434,19 +506,25 @@ public:
                 
                 lv2_atom_sequence_append_event(p.atom, p.atom_buf_size, ev);
             }
+
+            if (p.is_midi) append_midi(p, midiCount);
         }
 
+        if (prof) t = prof->lap(HostProfile::AtomIn, t);
+
         // --- Step C: Run plugin ---
         lilv_instance_run(instance_, numFrames);
+        if (prof) t = prof->lap(HostProfile::Run, t);
 
         // --- Step D: Deliver worker responses ---
         if (host_worker_.iface) deliver_worker_responses();
+        if (prof) t = prof->lap(HostProfile::Worker, t);
 
         // --- Step E: Read outgoing DSP→UI atom messages ---
         for (auto& p : ports_) {
             // Reset input atom port for next cycle
             if (p.is_atom && p.is_input) {
-                p.atom->atom.size = 0;
+                lv2_atom_sequence_clear(p.atom);
             }
 
             // Copy output atoms to ringbuffer
@@ -457,10 +535,11 @@ public:
                     if (seq->atom.type == 0) break;
                     
                     const uint32_t total = sizeof(LV2_Atom) + ev->body.size;
-                    if (lv2_ringbuffer_write_space(p.atom_state->dsp_to_ui) >= total) {
-                        lv2_ringbuffer_write(p.atom_state->dsp_to_ui,
-                                           (const char*)&ev->body, total);
-                    }
+                    lv2_ringbuffer_t* rb = p.atom_state->dsp_to_ui;
+                    if (lv2_ringbuffer_write_padded(rb, (const char*)&ev->body, total))
+                        lv2_ringbuffer_note_fill(rb);
+                    else
+                        lv2_ringbuffer_note_dropped(rb);
                 }
                 
                 // Reset output buffer for next process cycle
@@ -469,9 +548,97 @@ public:
             }
         }
 
+        if (prof) {
+            prof->lap(HostProfile::AtomOut, t);
+            prof->endCycle();
+        }
         return true;
     }
 
+    // Run this plugin in a separate process, call before initialize().
+    // Ports are still discovered here, only the instance lives elsewhere.
+    void setSandbox(SandboxHost::Config config) {
+        sandbox_ = std::make_unique<SandboxHost>(std::move(config));
+    }
+
+    bool isSandboxed() const { return sandbox_ != nullptr; }
+
+    // Queue a UI→DSP atom for an input atom port, picked up next cycle
+    bool queueAtom(uint32_t portIndex, uint32_t type, const void* body, uint32_t size) {
+        for (auto& p : ports_) {
+            if (p.index != portIndex || !p.is_atom || !p.is_input) continue;
+            p.atom_state->ui_to_dsp.assign((const uint8_t*)body, (const uint8_t*)body + size);
+            p.atom_state->ui_to_dsp_type = type;
+            p.atom_state->ui_to_dsp_pending.store(true, std::memory_order_release);
+            return true;
+        }
+        return false;
+    }
+
+    // MIDI for the next process() only: frame-stamped, in order, and owned
+    // by the caller until then (see MidiInput.h)
+    void setMidiInput(const MidiEvent* events, uint32_t count) {
+        midi_in_ = events;
+        midi_in_count_ = count;
+    }
+
+    bool hasMidiInput() const {
+        for (const auto& p : ports_) {
+            if (p.is_atom && p.is_input && p.is_midi) return true;
+        }
+        return false;
+    }
+
+    bool reportsLatency() const { return latency_port_ >= 0; }
+
+    // Frames of latency the plugin reported in its last run, 0 if it has no
+    // latency port
+    uint32_t latency() const {
+        if (latency_port_ < 0) return 0;
+        const float frames = ports_[latency_port_].control;
+        return frames > 0.0f ? (uint32_t)std::lrint(frames) : 0;
+    }
+
+    // An effect the host may stop running while its input is silent: it has
+    // an audio input and nothing else (atoms, MIDI) that could make sound
+    bool canIdle() const {
+        bool audio_in = false;
+        for (const auto& p : ports_) {
+            if (p.is_atom && p.is_input) return false;
+            if (p.is_audio && p.is_input) audio_in = true;
+        }
+        return audio_in;
+    }
+
+    const char* uri() const {
+        return plugin_ ? lilv_node_as_uri(lilv_plugin_get_uri(plugin_)) : "";
+    }
+
+    // The last path segment of the URI ("opiqo-ref#unity"), short enough
+    // for an RT_LOG string argument
+    const char* shortName() const {
+        const char* u = uri();
+        const char* slash = strrchr(u, '/');
+        return slash && slash[1] ? slash + 1 : u;
+    }
+
+    // Copy output control port values after a cycle, RT-safe
+    uint32_t readOutputControls(uint32_t* index, float* value, uint32_t max) const {
+        uint32_t n = 0;
+        for (const auto& p : ports_) {
+            if (n == max) break;
+            if (!p.is_control || p.is_input) continue;
+            index[n] = p.index;
+            value[n] = p.control;
+            ++n;
+        }
+        return n;
+    }
+
+    // Attach a stage profile (nullptr detaches), not owned by the plugin.
+    // Set it before the plugin is published to the audio thread.
+    void setProfile(HostProfile* profile) { profile_ = profile; }
+
     // Control access
     PluginControl* getControl(const char* symbol) {
         for (auto* control : controls_) {
@@ -481,6 +648,26 @@ public:
         return nullptr;
     }
 
+    // Stage a control input value from any thread, applied at the next process()
+    bool setControlValue(uint32_t index, float value) {
+        if (index >= ports_.size() || !pending_controls_) return false;
+        if (!ports_[index].is_control || !ports_[index].is_input) return false;
+        pending_controls_[index].store(value, std::memory_order_relaxed);
+        control_dirty_[index].store(true, std::memory_order_release);
+        controls_dirty_.store(true, std::memory_order_release);
+        return true;
+    }
+
+    // Audio thread only, between process() calls: write a control input
+    // straight into the port (used by the modulation matrix)
+    void setControlDirect(uint32_t index, float value) {
+        if (index < ports_.size() && ports_[index].is_control && ports_[index].is_input)
+            ports_[index].control = value;
+    }
+
+    // What the plugin has sent through log:log
+    PluginLog::Stats logStats() const { return log_.stats(); }
+
     uint32_t getPortCount() const { return ports_.size(); }
     const LilvPort* getPort(uint32_t index) const {
         if (index >= ports_.size()) return nullptr;
@@ -499,7 +686,62 @@ public:
         return nullptr;
     }
 
-    // Helper to read atoms from ringbuffer
+    // Same ring by port index, for callers that already hold the index
+    lv2_ringbuffer_t* getAtomOutputRingbuffer(uint32_t portIndex) {
+        for (auto& p : ports_) {
+            if (p.index == portIndex && p.is_atom && !p.is_input)
+                return p.atom_state->dsp_to_ui;
+        }
+        return nullptr;
+    }
+
+    // Batched read without copying: calls fn(const LV2_Atom*) on each
+    // message in place and releases every run of messages with a single
+    // read_advance(). Messages are padded to 8 bytes in the ring, so each
+    // one is aligned in place. Only a message that straddles the end of the
+    // ring is copied (into scratch); one larger than scratch is skipped and
+    // counted as dropped.
+    template <typename Fn>
+    static size_t readAtomMessages(lv2_ringbuffer_t* rb, Fn&& fn) {
+        if (!rb) return 0;
+
+        size_t count = 0;
+        lv2_ringbuffer_data_t vec[2];
+        while (lv2_ringbuffer_get_read_vector(rb, vec) >= sizeof(LV2_Atom)) {
+            size_t consumed = 0;
+            while (vec[0].len - consumed >= sizeof(LV2_Atom)) {
+                const auto* atom = (const LV2_Atom*)(vec[0].buf + consumed);
+                const size_t total = lv2_ringbuffer_padded(sizeof(LV2_Atom) + atom->size);
+                if (total > vec[0].len - consumed) break;
+                fn(atom);
+                consumed += total;
+                ++count;
+            }
+            if (consumed) {
+                lv2_ringbuffer_read_advance(rb, consumed);
+                continue;
+            }
+
+            // The next message wraps around the end of the ring
+            alignas(8) uint8_t scratch[1024];
+            LV2_Atom head;
+            lv2_ringbuffer_peek(rb, (char*)&head, sizeof(head));
+            const size_t total = lv2_ringbuffer_padded(sizeof(LV2_Atom) + head.size);
+            if (total > sizeof(scratch)) {
+                if (lv2_ringbuffer_read_space(rb) < total) break;
+                lv2_ringbuffer_read_advance(rb, total);
+                lv2_ringbuffer_note_dropped(rb);
+                continue;
+            }
+            if (!readAtomMessage(rb, scratch, sizeof(scratch))) break;
+            fn((const LV2_Atom*)scratch);
+            ++count;
+        }
+        return count;
+    }
+
+    // Helper to read atoms from ringbuffer; the padding is released with
+    // the atom but not copied
     static size_t readAtomMessage(lv2_ringbuffer_t* rb, uint8_t* outBuffer, size_t maxSize) {
         if (!rb || !outBuffer || maxSize < sizeof(LV2_Atom)) return 0;
         
@@ -509,40 +751,186 @@ public:
         lv2_ringbuffer_peek(rb, (char*)&atom_header, sizeof(LV2_Atom));
         
         const uint32_t total = sizeof(LV2_Atom) + atom_header.size;
-        if (total > maxSize || lv2_ringbuffer_read_space(rb) < total) return 0;
+        const size_t padded = lv2_ringbuffer_padded(total);
+        if (total > maxSize || lv2_ringbuffer_read_space(rb) < padded) return 0;
         
         lv2_ringbuffer_read(rb, (char*)outBuffer, total);
+        lv2_ringbuffer_read_advance(rb, padded - total);
         return total;
     }
 
     // State management
     bool saveState(const std::string& filePath) {
         if (!instance_ || !plugin_) return false;
-        
-        LilvState* state = lilv_state_new_from_instance(plugin_, instance_,
-                                                        &um_, reinterpret_cast<const char *>(&unm_), nullptr, nullptr,
-                                                        nullptr,
-                                                        reinterpret_cast<LilvGetPortValueFunc>(set_port_value), this,
-                                                        0, nullptr);
+        std::lock_guard<std::mutex> lock(worldLock());
+
+        const LV2_Feature* feats[] = { &features_.map_path_feature,
+                                       &features_.make_path_feature,
+                                       &features_.free_path_feature,
+                                       log_.feature(), nullptr };
+        LilvState* state = lilv_state_new_from_instance(plugin_, instance_, &um_,
+                                                        nullptr, nullptr, nullptr, nullptr,
+                                                        get_port_value, this, 0, feats);
         if (!state) return false;
-        
-        int result = lilv_state_save(world_, &um_, &unm_, state, filePath.c_str(), nullptr, nullptr);
+
+        // lilv wants the directory and the file name apart
+        const size_t slash = filePath.find_last_of('/');
+        const std::string dir = slash == std::string::npos ? "." : filePath.substr(0, slash);
+        const std::string file = slash == std::string::npos ? filePath : filePath.substr(slash + 1);
+        int result = lilv_state_save(world_, &um_, &unm_, state, nullptr, dir.c_str(), file.c_str());
         lilv_state_free(state);
-        
+
         return result == 0;
     }
 
+    // A state property as the plugin's state:interface stores it. Pointers
+    // are only valid for the call they are passed to.
+    struct StateProperty {
+        const char* key;            // URI
+        const char* type;           // URI
+        uint32_t flags;             // LV2_State_Flags
+        const void* value;
+        uint32_t size;
+    };
+
+    // Call fn(const StateProperty&) for each property the plugin saves.
+    // False if it has no state:interface (or runs in a sandbox).
+    template <typename Fn>
+    bool saveProperties(Fn&& fn) {
+        const auto* iface = stateInterface();
+        if (!iface || !iface->save) return false;
+
+        struct Store {
+            LV2Plugin* self;
+            Fn& fn;
+        } store{this, fn};
+        auto cb = [](LV2_State_Handle h, uint32_t key, const void* value, size_t size,
+                     uint32_t type, uint32_t flags) -> LV2_State_Status {
+            auto* s = static_cast<Store*>(h);
+            const char* key_uri = unmap_uri(s->self, key);
+            const char* type_uri = unmap_uri(s->self, type);
+            if (!key_uri || !type_uri) return LV2_STATE_ERR_UNKNOWN;
+            s->fn(StateProperty{key_uri, type_uri, flags, value, (uint32_t)size});
+            return LV2_STATE_SUCCESS;
+        };
+        return iface->save(instance_->lv2_handle, cb, &store,
+                           LV2_STATE_IS_POD | LV2_STATE_IS_PORTABLE, stateFeatures()) ==
+               LV2_STATE_SUCCESS;
+    }
+
+    // Hand `props` to the plugin's state:interface restore(). Not while the
+    // plugin is running on the audio thread.
+    bool restoreProperties(const StateProperty* props, uint32_t count) {
+        const auto* iface = stateInterface();
+        if (!iface || !iface->restore) return false;
+
+        struct Retrieve {
+            LV2Plugin* self;
+            const StateProperty* props;
+            uint32_t count;
+        } retrieve{this, props, count};
+        auto cb = [](LV2_State_Handle h, uint32_t key, size_t* size, uint32_t* type,
+                     uint32_t* flags) -> const void* {
+            auto* r = static_cast<Retrieve*>(h);
+            const char* key_uri = unmap_uri(r->self, key);
+            for (uint32_t i = 0; key_uri && i < r->count; ++i) {
+                const StateProperty& p = r->props[i];
+                if (strcmp(p.key, key_uri) != 0) continue;
+                if (size) *size = p.size;
+                if (type) *type = r->self->map_uri(p.type);
+                if (flags) *flags = p.flags;
+                return p.value;
+            }
+            return nullptr;
+        };
+        return iface->restore(instance_->lv2_handle, cb, &retrieve, 0, stateFeatures()) ==
+               LV2_STATE_SUCCESS;
+    }
+
+    // Duplicate this plugin without a state file and without asking Lilv
+    // again. prepareClone(), on any thread but the audio thread and while
+    // this plugin keeps running, copies the port tables, the URID map (so
+    // URIDs in the captured state keep their meaning), the resolved library
+    // and the current controls and state properties into a new plugin that
+    // is not instantiated yet. finishClone(), e.g. on a background thread,
+    // instantiates and restores it; it then takes start() like any other.
+    LV2Plugin* prepareClone() {
+        if (!instance_ || sandbox_) return nullptr;
+        auto* copy = new LV2Plugin(world_, plugin_, sample_rate_, max_block_length_);
+        copy->urid_map_ = urid_map_;
+        copy->urid_unmap_ = urid_unmap_;
+        copy->init_urids();
+        copy->init_features();
+        copy->required_atom_size_ = required_atom_size_;
+        copy->uri_ = uri_;
+        copy->lib_path_ = lib_path_;
+        copy->bundle_path_ = bundle_path_;
+        copy->features_checked_ = features_checked_;
+        copy->copy_ports(*this);
+
+        std::vector<uint32_t> index(ports_.size());
+        std::vector<float> value(ports_.size());
+        const uint32_t n = readInputControls(index.data(), value.data(), (uint32_t)ports_.size());
+        for (uint32_t i = 0; i < n; ++i) {
+            copy->ports_[index[i]].control = value[i];
+            copy->pending_controls_[index[i]].store(value[i], std::memory_order_relaxed);
+        }
+
+        auto state = std::make_unique<CloneState>();
+        saveProperties([&](const StateProperty& prop) {
+            state->strings.emplace_back(prop.key);
+            state->strings.emplace_back(prop.type);
+            state->values.emplace_back((const uint8_t*)prop.value, (const uint8_t*)prop.value + prop.size);
+            state->props.push_back({nullptr, nullptr, prop.flags, nullptr, prop.size});
+        });
+        // Vectors are done growing, point into them
+        for (size_t i = 0; i < state->props.size(); ++i) {
+            state->props[i].key = state->strings[2 * i].c_str();
+            state->props[i].type = state->strings[2 * i + 1].c_str();
+            state->props[i].value = state->values[i].data();
+        }
+        copy->clone_state_ = std::move(state);
+        return copy;
+    }
+
+    bool finishClone() {
+        if (!plugin_ || instance_) return false;
+        if (!init_instance()) return false;
+        if (clone_state_ && !clone_state_->props.empty())
+            restoreProperties(clone_state_->props.data(), (uint32_t)clone_state_->props.size());
+        clone_state_.reset();
+        return true;
+    }
+
+    // Current value of every control input, for presets
+    uint32_t readInputControls(uint32_t* index, float* value, uint32_t max) const {
+        uint32_t n = 0;
+        for (const auto& p : ports_) {
+            if (n == max) break;
+            if (!p.is_control || !p.is_input) continue;
+            index[n] = p.index;
+            value[n] = pending_controls_ ? pending_controls_[p.index].load(std::memory_order_relaxed)
+                                         : p.control;
+            ++n;
+        }
+        return n;
+    }
+
     bool loadState(const std::string& filePath) {
         if (!instance_) return false;
         
-        LilvState* state = lilv_state_new_from_file(world_, &um_, nullptr, filePath.c_str());
+        LilvState* state;
+        {
+            std::lock_guard<std::mutex> lock(worldLock());
+            state = lilv_state_new_from_file(world_, &um_, nullptr, filePath.c_str());
+        }
         if (!state) return false;
         
         LV2_Feature* feats[] = { &features_.um_f, &features_.unm_f,
                                 &features_.map_path_feature,
                                 &features_.make_path_feature,
                                 &features_.free_path_feature,
-                                nullptr };
+                                log_.feature(), nullptr };
         
         lilv_state_restore(state, instance_, set_port_value, this, 0, feats);
         lilv_state_free(state);
@@ -680,17 +1068,59 @@ private:
     LV2_State_Map_Path map_path_;
     LV2_State_Make_Path make_path_;
     LV2_State_Free_Path free_path_;
+    const LV2_Feature* state_features_[7] = {};
+    float saved_value_ = 0.0f;
+
+    const LV2_State_Interface* stateInterface() const {
+        if (!instance_) return nullptr;
+        return (const LV2_State_Interface*)lilv_instance_get_extension_data(instance_, LV2_STATE__interface);
+    }
 
+    const LV2_Feature* const* stateFeatures() {
+        state_features_[0] = &features_.um_f;
+        state_features_[1] = &features_.unm_f;
+        state_features_[2] = &features_.map_path_feature;
+        state_features_[3] = &features_.make_path_feature;
+        state_features_[4] = &features_.free_path_feature;
+        state_features_[5] = log_.feature();
+        state_features_[6] = nullptr;
+        return state_features_;
+    }
+
+    // lilv_state_new_from_instance() asks for every port value to save
+    static const void* get_port_value(const char* port_symbol, void* user_data,
+                                      uint32_t* size, uint32_t* type) {
+        auto* self = static_cast<LV2Plugin*>(user_data);
+        for (auto& p : self->ports_) {
+            if (!p.is_control || !p.is_input) continue;
+            const LilvNode* sym = lilv_port_get_symbol(self->plugin_, p.lilv_port);
+            if (sym && std::string(lilv_node_as_string(sym)) == port_symbol) {
+                // lilv copies the value before asking for the next port
+                self->saved_value_ = self->pending_controls_
+                        ? self->pending_controls_[p.index].load(std::memory_order_relaxed)
+                        : p.control;
+                *size = sizeof(float);
+                *type = self->map_uri(LV2_ATOM__Float);
+                return &self->saved_value_;
+            }
+        }
+        *size = 0;
+        *type = 0;
+        return nullptr;
+    }
+
+    // lilv_state_restore() hands over every port value of the preset. The
+    // plugin may be running, so values are staged like setControlValue()
+    // and reach the port at the next process(); the port stays connected
+    // to p.control from init.
     static void set_port_value(const char* port_symbol, void* user_data,
                                const void* value, uint32_t size, uint32_t type) {
         auto* self = static_cast<LV2Plugin*>(user_data);
         for (auto& p : self->ports_) {
             const LilvNode* sym = lilv_port_get_symbol(self->plugin_, p.lilv_port);
             if (sym && std::string(lilv_node_as_string(sym)) == port_symbol) {
-                if (p.is_control && size == sizeof(float)) {
-                    p.control = *(const float*)value;
-                    lilv_instance_connect_port(self->instance_, p.index, &p.control);
-                }
+                if (p.is_control && size == sizeof(float))
+                    self->setControlValue(p.index, *(const float*)value);
                 break;
             }
         }
@@ -740,6 +1170,9 @@ private:
     bool init_ports() {
         uint32_t n = lilv_plugin_get_num_ports(plugin_);
         ports_.reserve(n);
+        pending_controls_.reset(new std::atomic<float>[n]);
+        control_dirty_.reset(new std::atomic<bool>[n]);
+        for (uint32_t i = 0; i < n; ++i) control_dirty_[i].store(false, std::memory_order_relaxed);
 
         LilvNode* midi_event = lilv_new_uri(world_, LV2_MIDI__MidiEvent);
 
@@ -761,19 +1194,7 @@ private:
             // Allocate and initialize atom ports
             if (p.is_atom) {
                 p.atom_buf_size = required_atom_size_;
-                p.atom = (LV2_Atom_Sequence*)aligned_alloc(64, p.atom_buf_size);
-                memset(p.atom, 0, p.atom_buf_size);
-                p.atom->atom.type = urids_.atom_Sequence;
-
-                if (p.is_input) {
-                    p.atom->atom.size = sizeof(LV2_Atom_Sequence_Body);
-                    p.atom->body.unit = 0;
-                    p.atom->body.pad = 0;
-                } else {
-                    p.atom->atom.size = 0;
-                }
-
-                p.atom_state = new AtomState();
+                alloc_atom(p);
             }
 
             // Extract default values for control inputs
@@ -788,6 +1209,7 @@ private:
                 }
                 p.control = p.defvalue;
             }
+            pending_controls_[i].store(p.control, std::memory_order_relaxed);
 
             ports_.push_back(p);
 
@@ -800,6 +1222,13 @@ private:
         }
 
         lilv_node_free(midi_event);
+
+        // lv2:reportsLatency output, valid after each run()
+        if (lilv_plugin_has_latency(plugin_)) {
+            const uint32_t index = lilv_plugin_get_latency_port_index(plugin_);
+            if (index < n && ports_[index].is_control && !ports_[index].is_input)
+                latency_port_ = (int)index;
+        }
         return true;
     }
 
@@ -815,6 +1244,42 @@ private:
         AtomState* atom_state = nullptr;
     };
 
+    void alloc_atom(Port& p) {
+        p.atom = (LV2_Atom_Sequence*)aligned_alloc(64, p.atom_buf_size);
+        memset(p.atom, 0, p.atom_buf_size);
+        p.atom->atom.type = urids_.atom_Sequence;
+
+        if (p.is_input) {
+            p.atom->atom.size = sizeof(LV2_Atom_Sequence_Body);
+            p.atom->body.unit = 0;
+            p.atom->body.pad = 0;
+        } else {
+            p.atom->atom.size = 0;
+        }
+
+        p.atom_state = new AtomState();
+    }
+
+    // The port table of another instance of the same plugin, with buffers
+    // and controls of our own; instead of init_ports(), no Lilv queries
+    void copy_ports(const LV2Plugin& src) {
+        ports_.reserve(src.ports_.size());
+        pending_controls_.reset(new std::atomic<float>[src.ports_.size()]);
+        control_dirty_.reset(new std::atomic<bool>[src.ports_.size()]);
+        for (const auto& sp : src.ports_) {
+            Port p = sp;
+            p.control = p.defvalue;
+            p.atom = nullptr;
+            p.atom_state = nullptr;
+            if (p.is_atom) alloc_atom(p);
+            pending_controls_[p.index].store(p.control, std::memory_order_relaxed);
+            control_dirty_[p.index].store(false, std::memory_order_relaxed);
+            ports_.push_back(p);
+        }
+        for (auto* control : src.controls_) controls_.push_back(control->clone());
+        latency_port_ = src.latency_port_;
+    }
+
     // ========== Plugin Instantiation ==========
     bool init_instance() {
         LV2_Options_Option options[] = {
@@ -831,14 +1296,20 @@ private:
 
         LV2_Feature opt_f { LV2_OPTIONS__options, options };
 
+        log_.init(lilv_node_as_uri(lilv_plugin_get_uri(plugin_)), &um_);
+
         LV2_Feature* feats[] = { &features_.um_f, &features_.unm_f, &opt_f,
                     &features_.bbl_feature, &features_.map_path_feature,
                     &features_.make_path_feature, &features_.free_path_feature,
-                    &host_worker_.feature, nullptr };
+                    &host_worker_.feature, log_.feature(), nullptr };
 
-        if (!checkFeatures(feats)) return false;
+        if (!features_checked_) {
+            std::lock_guard<std::mutex> lock(worldLock());
+            if (!checkFeatures(feats)) return false;
+            features_checked_ = true;
+        }
 
-        instance_ = lilv_plugin_instantiate(plugin_, sample_rate_, feats);
+        instance_ = instantiate(feats);
         if (!instance_) return false;
 
         // Setup worker if plugin provides interface
@@ -852,7 +1323,8 @@ private:
             host_worker_.responses = lv2_ringbuffer_create(8192);
             host_worker_.response_buffer.resize(8192);
             host_worker_.running.store(true);
-            host_worker_.worker_thread = std::thread(worker_thread_func, &host_worker_);
+            host_worker_.worker_thread = ThreadManager::get().spawn(
+                    ThreadManager::Role::Realtime, "lv2-worker", worker_thread_func, &host_worker_);
         }
 
         // Connect control and atom ports
@@ -860,7 +1332,7 @@ private:
             if (p.is_audio) continue;
             if (p.is_control) {
                 lilv_instance_connect_port(instance_, p.index, &p.control);
-                LOGD ("[%s] Connected control port %u to value %f", lilv_node_as_string(lilv_plugin_get_name(plugin_)), p.index, p.control);
+                RT_LOGD("[%s] Connected control port %u to value %f", shortName(), p.index, p.control);
             }
             if (p.is_atom)
                 lilv_instance_connect_port(instance_, p.index, p.atom);
@@ -870,6 +1342,149 @@ private:
         return true;
     }
 
+    // lilv_plugin_instantiate() registers the library with the world and so
+    // would need the world lock throughout. Only the paths are looked up
+    // under the lock; dlopen and the plugin's own instantiate(), the slow
+    // part, run outside it.
+    LilvInstance* instantiate(const LV2_Feature* const* feats) {
+        if (lib_path_.empty()) {
+            std::lock_guard<std::mutex> lock(worldLock());
+            uri_ = lilv_node_as_uri(lilv_plugin_get_uri(plugin_));
+            char* lib = lilv_file_uri_parse(lilv_node_as_uri(lilv_plugin_get_library_uri(plugin_)), nullptr);
+            char* bundle = lilv_file_uri_parse(lilv_node_as_uri(lilv_plugin_get_bundle_uri(plugin_)), nullptr);
+            if (lib) lib_path_ = lib;
+            if (bundle) bundle_path_ = bundle;
+            lilv_free(lib);
+            lilv_free(bundle);
+        }
+        const std::string& uri = uri_;
+
+        void* library = lib_path_.empty() ? nullptr : dlopen(lib_path_.c_str(), RTLD_NOW);
+        auto entry = library ? (LV2_Descriptor_Function)dlsym(library, "lv2_descriptor") : nullptr;
+        if (!entry) {
+            // No plain lv2_descriptor (or no library): let lilv do it
+            if (library) dlclose(library);
+            std::lock_guard<std::mutex> lock(worldLock());
+            return lilv_plugin_instantiate(plugin_, sample_rate_, feats);
+        }
+
+        const LV2_Descriptor* descriptor = nullptr;
+        for (uint32_t i = 0; (descriptor = entry(i)); ++i)
+            if (uri == descriptor->URI) break;
+        LV2_Handle handle = descriptor ? descriptor->instantiate(descriptor, sample_rate_,
+                                                                 bundle_path_.c_str(), feats)
+                                       : nullptr;
+        if (!handle) {
+            dlclose(library);
+            return nullptr;
+        }
+
+        auto* instance = (LilvInstance*)calloc(1, sizeof(LilvInstance));
+        instance->lv2_descriptor = descriptor;
+        instance->lv2_handle = handle;
+        library_ = library;
+        return instance;
+    }
+
+    // ========== Sandbox ==========
+    bool init_sandbox() {
+        if (!sandbox_->create()) return false;
+
+        SandboxShm* shm = sandbox_->shm();
+        for (auto& p : ports_) {
+            if (p.index >= SandboxShm::kMaxPorts) return false;
+            if (p.is_control) shm->controls[p.index] = p.control;
+        }
+        return sandbox_->launch();
+    }
+
+    // Same contract as the in-process path: controls, UI atoms and audio go
+    // into the shared block, outputs come back into ports_ and the rings
+    bool process_sandboxed(float* inputBuffer, float* outputBuffer, int numFrames,
+                           uint32_t midiCount, HostProfile* prof, uint64_t t) {
+        if ((uint32_t)numFrames > SandboxShm::kMaxFrames || !sandbox_->begin())
+            return false;
+
+        SandboxShm* shm = sandbox_->shm();
+        uint32_t atom_bytes = 0;
+        for (auto& p : ports_) {
+            if (p.is_control && p.is_input) shm->controls[p.index] = p.control;
+            if (!p.is_atom || !p.is_input) continue;
+            if (!p.atom_state->ui_to_dsp_pending.exchange(false, std::memory_order_acquire)) continue;
+
+            const uint32_t size = p.atom_state->ui_to_dsp.size();
+            const uint32_t total = (sizeof(SandboxShm::AtomRecord) + size + 7) & ~7u;
+            if (atom_bytes + total > SandboxShm::kAtomBytes) continue;
+            auto* rec = (SandboxShm::AtomRecord*)(shm->atom_in + atom_bytes);
+            rec->port = p.index;
+            rec->pad = 0;
+            rec->size = size;
+            rec->type = p.atom_state->ui_to_dsp_type;
+            memcpy(rec + 1, p.atom_state->ui_to_dsp.data(), size);
+            atom_bytes += total;
+        }
+        shm->atom_in_bytes = atom_bytes;
+        shm->midi_count = std::min(midiCount, SandboxShm::kMaxMidi);
+        if (shm->midi_count) memcpy(shm->midi, midi_in_, sizeof(MidiEvent) * shm->midi_count);
+        shm->frames = numFrames;
+        memcpy(shm->audio_in, inputBuffer, sizeof(float) * numFrames);
+        if (prof) t = prof->lap(HostProfile::Connect, t);
+
+        // Wait at most half a block, a late sandbox costs this slot one block
+        sandbox_->submit();
+        const int64_t budget = (int64_t)(5e8 * numFrames / sample_rate_);
+        const bool answered = sandbox_->wait(budget);
+        if (prof) t = prof->lap(HostProfile::Run, t);
+        if (answered != sandbox_answered_) {
+            sandbox_answered_ = answered;
+            if (!answered) RT_LOGW("[LV2Plugin] Sandbox missed a block, bypassing until it answers");
+            else RT_LOGI("[LV2Plugin] Sandbox answering again");
+        }
+        if (!answered) return false;
+
+        memcpy(outputBuffer, shm->audio_out, sizeof(float) * numFrames);
+        for (auto& p : ports_) {
+            if (p.is_control && !p.is_input) p.control = shm->controls[p.index];
+        }
+
+        uint32_t offset = 0;
+        while (offset + sizeof(SandboxShm::AtomRecord) <= shm->atom_out_bytes) {
+            const auto* rec = (const SandboxShm::AtomRecord*)(shm->atom_out + offset);
+            offset += (sizeof(*rec) + rec->size + 7) & ~7u;
+            for (auto& p : ports_) {
+                if (p.index != rec->port || !p.is_atom || p.is_input) continue;
+                lv2_ringbuffer_t* rb = p.atom_state->dsp_to_ui;
+                const uint32_t total = sizeof(LV2_Atom) + rec->size;
+                if (lv2_ringbuffer_write_padded(rb, (const char*)&rec->size, total))
+                    lv2_ringbuffer_note_fill(rb);
+                else
+                    lv2_ringbuffer_note_dropped(rb);
+            }
+        }
+
+        if (prof) {
+            prof->lap(HostProfile::AtomOut, t);
+            prof->endCycle();
+        }
+        return true;
+    }
+
+    // Short MIDI messages as midi:MidiEvent atoms, after any UI atom
+    void append_midi(Port& p, uint32_t count) {
+        struct {
+            LV2_Atom_Event ev;
+            uint8_t data[4];
+        } buf;
+        for (uint32_t i = 0; i < count; ++i) {
+            const MidiEvent& e = midi_in_[i];
+            buf.ev.time.frames = e.frame;
+            buf.ev.body.type = urids_.midi_Event;
+            buf.ev.body.size = e.size;
+            memcpy(buf.data, e.data, sizeof(e.data));
+            if (!lv2_atom_sequence_append_event(p.atom, p.atom_buf_size, &buf.ev)) break;
+        }
+    }
+
     // ========== Worker Thread ==========
     struct LV2HostWorker {
         lv2_ringbuffer_t* requests = nullptr;
@@ -993,7 +1608,8 @@ private:
     LilvPlugin* plugin_;
     LilvInstance* instance_;
 
-    LilvNode *audio_class_, *control_class_, *atom_class_, *input_class_, *rsz_minimumSize_;
+    LilvNode *audio_class_ = nullptr, *control_class_ = nullptr, *atom_class_ = nullptr,
+             *input_class_ = nullptr, *rsz_minimumSize_ = nullptr;
 
     double sample_rate_;
     uint32_t max_block_length_;
@@ -1004,9 +1620,34 @@ public:
 private:
     std::vector<PluginControl*> controls_;
 
+    // Control values written by setControlValue(), indexed like ports_,
+    // each flagged until process() applies it; controls_dirty_ is set if
+    // any is
+    std::unique_ptr<std::atomic<float>[]> pending_controls_;
+    std::unique_ptr<std::atomic<bool>[]> control_dirty_;
+    std::atomic<bool> controls_dirty_{false};
+    bool sandbox_answered_ = true;  // audio thread only
+
     LV2HostWorker host_worker_;
+    PluginLog log_;
+    void* library_ = nullptr;       // set when instantiate() opened the library itself
+    std::string uri_, lib_path_, bundle_path_;     // resolved once, see instantiate()
+    bool features_checked_ = false;
+
+    // State captured by prepareClone(), restored by finishClone()
+    struct CloneState {
+        std::vector<std::string> strings;
+        std::vector<std::vector<uint8_t>> values;
+        std::vector<StateProperty> props;   // pointing into strings and values
+    };
+    std::unique_ptr<CloneState> clone_state_;
 
     std::atomic<bool> shutdown_;
+    HostProfile* profile_ = nullptr;
+    std::unique_ptr<SandboxHost> sandbox_;
+    int latency_port_ = -1;
+    const MidiEvent* midi_in_ = nullptr;
+    uint32_t midi_in_count_ = 0;
 };
 
 // ============================================================================
@@ -0,0 +1,215 @@
+/*
+ * Limiter.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Brick-wall lookahead limiter at the very end of the chain.
+ *
+ * The signal is delayed by the lookahead, which is reported as latency().
+ * The detector works on the undelayed input in groups of kGroup frames. For
+ * each group it takes the four-lane block max of |x| and of an interpolated
+ * midpoint between neighbouring samples (a cubic half-sample estimate, so
+ * most inter-sample overs are caught without oversampling). That gives the
+ * gain the group needs to stay under the ceiling.
+ *
+ * The gain applied to the delayed group is the lowest of:
+ *   - the release curve back towards unity;
+ *   - for every group still inside the lookahead, a straight line that
+ *     reaches that group's gain by the time the group is output.
+ * The gain therefore never exceeds what any sample needs, and gain changes
+ * are spread over the lookahead instead of landing on the peak. Within a
+ * group the gain is ramped linearly. A group at unity is a plain copy.
+ */
+
+#ifndef OPIQO_LIMITER_H
+#define OPIQO_LIMITER_H
+
+#include "Simd.h"
+#include "SlotMix.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+class Limiter {
+public:
+    static constexpr int kMaxChannels = 2;
+    static constexpr int kGroup = 8;                // frames per gain step
+    static constexpr float kMaxLookaheadMs = 10.0f;
+
+    // Settings, written from any thread
+    std::atomic<bool> enabled{true};
+    std::atomic<float> ceiling_db{-1.0f};
+    std::atomic<float> lookahead_ms{1.5f};
+    std::atomic<float> release_ms{50.0f};
+
+    // Not real-time: size the delay for the stream about to start
+    void prepare(double rate, int channels) {
+        rate_ = rate;
+        channels_ = std::clamp(channels, 1, kMaxChannels);
+        const int max_groups = groupsFor(kMaxLookaheadMs);
+        delay_.assign((size_t)max_groups * kGroup * channels_, 0.0f);
+        need_.assign(max_groups, 1.0f);
+        groups_ = 0;
+        on_ = false;
+    }
+
+    // Frames of delay the limiter adds right now
+    int latency() const {
+        if (!enabled.load(std::memory_order_relaxed) || delay_.empty()) return 0;
+        return groupsFor(lookahead_ms.load(std::memory_order_relaxed)) * kGroup;
+    }
+
+    // Gain reduction of the last group, 1 = none
+    float reduction() const { return reduction_.load(std::memory_order_relaxed); }
+
+    // ---------------------------------------------------------------------
+    // Audio thread
+    // ---------------------------------------------------------------------
+
+    // In place over numSamples interleaved samples
+    void process(float* buf, int numSamples) {
+        if (delay_.empty() || numSamples <= 0) return;
+
+        const bool on = enabled.load(std::memory_order_relaxed);
+        const int groups = groupsFor(lookahead_ms.load(std::memory_order_relaxed));
+        if (on != on_ || groups != groups_) reset(on, groups);
+        if (!on) return;
+
+        const float ceiling = std::pow(10.0f, ceiling_db.load(std::memory_order_relaxed) / 20.0f);
+        const float release = 1.0f - std::exp(-(float)kGroup * 1000.0f / (float)rate_ /
+                std::max(1.0f, release_ms.load(std::memory_order_relaxed)));
+
+        const int line = line_;
+        float held[kGroup * kMaxChannels];
+
+        for (int i = 0; i < numSamples;) {
+            if (phase_ == 0) startGroup(ceiling, release);
+
+            const int frames = std::min(kGroup - phase_, (numSamples - i) / channels_);
+            if (frames <= 0) break;
+            const int n = frames * channels_;
+            float* chunk = buf + i;
+
+            detect(chunk, n);
+
+            // Swap the chunk through the delay line
+            const int first = std::min(n, line - pos_);
+            memcpy(held, delay_.data() + pos_, sizeof(float) * first);
+            memcpy(delay_.data() + pos_, chunk, sizeof(float) * first);
+            if (first < n) {
+                memcpy(held + first, delay_.data(), sizeof(float) * (n - first));
+                memcpy(delay_.data(), chunk + first, sizeof(float) * (n - first));
+            }
+            pos_ = (pos_ + n) % line;
+
+            if (from_ == 1.0f && to_ == 1.0f) {
+                memcpy(chunk, held, sizeof(float) * n);
+            } else {
+                const float step = (to_ - from_) / (float)kGroup;
+                slotmix::apply(held, held, chunk, n, channels_,
+                               MixGains::gain(from_ + step * (float)phase_),
+                               MixGains::gain(from_ + step * (float)(phase_ + frames)));
+            }
+
+            phase_ = (phase_ + frames) % kGroup;
+            i += n;
+        }
+    }
+
+private:
+    static constexpr int kHistory = 3;              // frames the midpoint estimate looks back
+
+    int groupsFor(float ms) const {
+        const float clamped = std::clamp(ms, 0.0f, kMaxLookaheadMs);
+        const int frames = (int)std::ceil(rate_ * clamped / 1000.0);
+        return std::max(2, (frames + kGroup - 1) / kGroup);
+    }
+
+    void reset(bool on, int groups) {
+        on_ = on;
+        groups_ = groups;
+        std::fill(delay_.begin(), delay_.end(), 0.0f);
+        std::fill(need_.begin(), need_.end(), 1.0f);
+        line_ = groups * kGroup * channels_;
+        pos_ = 0;
+        head_ = 0;
+        phase_ = 0;
+        peak_ = 0.0f;
+        from_ = to_ = 1.0f;
+        for (auto& h : history_) h = 0.0f;
+        reduction_.store(1.0f, std::memory_order_relaxed);
+    }
+
+    // Close the input group that just completed and pick the gain ramp for
+    // the output group that starts now
+    void startGroup(float ceiling, float release) {
+        // need_ is a ring of the last groups_ input groups, oldest first
+        // from head_; the oldest is the group about to be output
+        need_[(head_ + groups_ - 1) % groups_] = peak_ > ceiling ? ceiling / peak_ : 1.0f;
+        peak_ = 0.0f;
+
+        float gain = to_ + (1.0f - to_) * release;
+        const float span = (float)(groups_ - 1);
+        for (int d = 0; d < groups_; ++d) {
+            const float need = need_[(head_ + d) % groups_];
+            const float slope = d > 1 ? (float)(d - 1) / span : 0.0f;
+            gain = std::min(gain, need + (1.0f - need) * slope);
+        }
+
+        from_ = to_;
+        to_ = gain;
+        head_ = (head_ + 1) % groups_;
+        need_[(head_ + groups_ - 1) % groups_] = 1.0f;
+        reduction_.store(gain, std::memory_order_relaxed);
+    }
+
+    // Fold |x| and the midpoint estimates of n interleaved samples into peak_
+    void detect(const float* chunk, int n) {
+        using namespace simd;
+        const int ch = channels_;
+        const int h = kHistory * ch;
+        float s[(kHistory + kGroup) * kMaxChannels];
+        memcpy(s, history_, sizeof(float) * h);
+        memcpy(s + h, chunk, sizeof(float) * n);
+
+        // Midpoint between x[-2] and x[-1] from x[-3] .. x[0]
+        const v4sf nine = splat(9.0f / 16.0f), one = splat(1.0f / 16.0f);
+        v4sf m = splat(0.0f);
+        int i = h;
+        for (; i + 4 <= h + n; i += 4) {
+            const v4sf x0 = load(s + i);
+            const v4sf mid = nine * (load(s + i - ch) + load(s + i - 2 * ch)) -
+                             one * (load(s + i - 3 * ch) + x0);
+            m = max(m, max(abs(x0), abs(mid)));
+        }
+        float p = std::max(peak_, hmax(m));
+        for (; i < h + n; ++i) {
+            const float mid = (9.0f * (s[i - ch] + s[i - 2 * ch]) - (s[i - 3 * ch] + s[i])) / 16.0f;
+            p = std::max(p, std::max(std::fabs(s[i]), std::fabs(mid)));
+        }
+        peak_ = p;
+
+        memcpy(history_, s + n, sizeof(float) * h);
+    }
+
+    double rate_ = 48000;
+    int channels_ = 1;
+
+    // Audio thread state
+    std::vector<float> delay_;
+    std::vector<float> need_;
+    bool on_ = false;
+    int groups_ = 0;
+    int line_ = 0;
+    int pos_ = 0;
+    int head_ = 0;
+    int phase_ = 0;
+    float peak_ = 0.0f;
+    float from_ = 1.0f, to_ = 1.0f;
+    float history_[kHistory * kMaxChannels] = {};
+    std::atomic<float> reduction_{1.0f};
+};
+
+#endif //OPIQO_LIMITER_H
@@ -16,11 +16,14 @@
 
 #include <cassert>
 #include "logging_macros.h"
+#include "RtLog.h"
 
 #include "LiveEffectEngine.h"
 
 LiveEffectEngine::LiveEffectEngine() {
     assert(mOutputChannelCount == mInputChannelCount);
+    // Anything the audio path logs goes through the real-time logger
+    rtlog::Logger::get().start();
 }
 
 void LiveEffectEngine::setRecordingDeviceId(int32_t deviceId) {
@@ -45,18 +48,57 @@ bool LiveEffectEngine::setEffectOn(bool isOn) {
     bool success = true;
     if (isOn != mIsEffectOn) {
         if (isOn) {
-            success = openStreams() == oboe::Result::OK;
+            success = mJalvUri.empty() ? openStreams() == oboe::Result::OK : openJalv();
             if (success) {
                 mIsEffectOn = isOn;
             }
         } else {
-            closeStreams();
+            if (mJalv) {
+                closeJalv();
+            } else {
+                closeStreams();
+            }
             mIsEffectOn = isOn;
        }
     }
     return success;
 }
 
+bool LiveEffectEngine::setJalvPlugin(const std::string &uri) {
+    if (mIsEffectOn) return false;
+    mJalvUri = uri;
+    return true;
+}
+
+const CallbackStats *LiveEffectEngine::callbackStats() {
+    if (mJalv && mJalv->backend) return &mJalv->backend->stats;
+    if (mDuplexStream) return &mDuplexStream->stats;
+    return nullptr;
+}
+
+bool LiveEffectEngine::openJalv() {
+    // jalv_open_() expects a zeroed Jalv and opens the Oboe streams itself
+    mJalv = static_cast<Jalv *>(calloc(1, sizeof(Jalv)));
+    const int status = jalv_open_(mJalv, mJalvUri.c_str(),
+                                  lv2Path.empty() ? nullptr : lv2Path.c_str());
+    if (status != 0 || jalv_activate_(mJalv) != 0) {
+        LOGE("Failed to run %s through jalv: %d", mJalvUri.c_str(), status);
+        jalv_close_(mJalv);
+        free(mJalv);
+        mJalv = nullptr;
+        return false;
+    }
+    sampleRate = (int32_t) mJalv->settings.sample_rate;
+    return true;
+}
+
+void LiveEffectEngine::closeJalv() {
+    jalv_deactivate_(mJalv);
+    jalv_close_(mJalv);
+    free(mJalv);
+    mJalv = nullptr;
+}
+
 void LiveEffectEngine::closeStreams() {
     /*
     * Note: The order of events is important here.
@@ -101,10 +143,14 @@ oboe::Result  LiveEffectEngine::openStreams() {
     warnIfNotLowLatency(mRecordingStream);
 
     mDuplexStream = std::make_unique<FullDuplexPass>();
-    mDuplexStream -> plugin1 = plugin1 ;
-    mDuplexStream -> plugin2 = plugin2 ;
-    mDuplexStream -> plugin3 = plugin3 ;
-    mDuplexStream -> plugin4 = plugin4 ;
+    inputStage.prepare(mSampleRate, mInputChannelCount);
+    mDuplexStream -> chain = &chain ;
+    chain.modulation().prepare(mSampleRate);
+    mDuplexStream -> input = &inputStage ;
+    limiter.prepare(mSampleRate, mOutputChannelCount);
+    mDuplexStream -> limiter = &limiter ;
+    mDuplexStream -> midi = &midiInput ;
+    mDuplexStream -> sampleRate = mSampleRate ;
     mDuplexStream->instance = instance ;
     mDuplexStream->setSharedInputStream(mRecordingStream);
     mDuplexStream->setSharedOutputStream(mPlayStream);
@@ -249,3 +295,30 @@ void LiveEffectEngine::onErrorAfterClose(oboe::AudioStream *oboeStream,
         openStreams();
     }
 }
+
+int32_t LiveEffectEngine::getProcessingLatency() {
+    return inputStage.latency() + (int32_t)chain.latency() + limiter.latency();
+}
+
+int32_t LiveEffectEngine::getRoundTripLatency() {
+    int32_t frames = getProcessingLatency();
+    for (auto *stream : {mRecordingStream.get(), mPlayStream.get()}) {
+        if (!stream) continue;
+        auto millis = stream->calculateLatencyMillis();
+        if (millis) {
+            frames += (int32_t)(millis.value() * stream->getSampleRate() / 1000.0);
+        } else {
+            // No timestamps yet, the buffer is the best estimate
+            frames += stream->getBufferSizeInFrames();
+        }
+    }
+    return frames;
+}
+
+int32_t LiveEffectEngine::getBlockSize() {
+    if (mPlayStream) {
+        const int32_t frames = mPlayStream->getFramesPerDataCallback();
+        return frames > 0 ? frames : mPlayStream->getFramesPerBurst();
+    }
+    return oboe::DefaultStreamValues::FramesPerBurst;
+}
@@ -22,6 +22,10 @@
 #include <string>
 #include <thread>
 #include "FullDuplexPass.h"
+#include "jalv.h"
+#include "InstancePool.h"
+#include "SlotCloner.h"
+#include "PluginCostProfiler.h"
 #include "json.hpp"
 
 using json = nlohmann::json;
@@ -39,6 +43,18 @@ public:
      */
     bool setEffectOn(bool isOn);
 
+    /**
+     * Run uri through jalv on its own Oboe streams instead of the chain the
+     * next time the effect is turned on, or the chain again when uri is
+     * empty. Both report into CallbackStats, so a plugin can be timed
+     * through either process path on the same device.
+     * @return false while the effect is on
+     */
+    bool setJalvPlugin(const std::string &uri);
+
+    // Cost of the running engine's callbacks, null when it is off
+    const CallbackStats *callbackStats();
+
     /*
      * oboe::AudioStreamDataCallback interface implementation
      */
@@ -51,22 +67,42 @@ public:
     void onErrorBeforeClose(oboe::AudioStream *oboeStream, oboe::Result error) override;
     void onErrorAfterClose(oboe::AudioStream *oboeStream, oboe::Result error) override;
 
+    // Frames per callback of the open stream, or the device default
+    int32_t getBlockSize();
+
+    // Interleaved channels of both streams
+    int32_t getChannelCount() const { return mOutputChannelCount; }
+
+    // Frames of delay added by the engine: input stage, plugins, limiter
+    int32_t getProcessingLatency();
+
+    // Frames from input to output including both streams
+    int32_t getRoundTripLatency();
+
     bool setAudioApi(oboe::AudioApi);
     bool isAAudioRecommended(void);
 
     std::string cacheDir ;
     std::unique_ptr<FullDuplexPass> mDuplexStream;
-    LV2Plugin * plugin1 = nullptr;
-    LV2Plugin * plugin2 = nullptr;
-    LV2Plugin * plugin3 = nullptr;
-    LV2Plugin * plugin4 = nullptr;
+    PluginChain chain;
+    SlotCloner cloner{chain};
+    InputStage inputStage;
+    Limiter limiter;
+    MidiInput midiInput;
     LilvInstance *instance = nullptr;
     LilvWorld * world = nullptr;
     const LilvPlugins * plugins = nullptr;
     json pluginInfo;
+    std::string lv2Path;
+    std::string nativeLibraryDir;
+    PluginCostProfiler costProfiler;
     std::shared_ptr<oboe::AudioStream> mRecordingStream;
     std::shared_ptr<oboe::AudioStream> mPlayStream;
     int32_t sampleRate = oboe::DefaultStreamValues::SampleRate ;
+    // Warm instances for addPlugin; world is read when one is built
+    InstancePool pool{[this](const std::string& uri, double rate) {
+        return new LV2Plugin(world, uri.c_str(), rate, 4096);
+    }};
 
 
 private:
@@ -78,8 +114,13 @@ private:
     int32_t           mSampleRate = oboe::kUnspecified;
     const int32_t     mInputChannelCount = oboe::ChannelCount::Stereo;
     const int32_t     mOutputChannelCount = oboe::ChannelCount::Stereo;
+    std::string       mJalvUri;
+    Jalv             *mJalv = nullptr;
     oboe::Result openStreams();
 
+    bool openJalv();
+    void closeJalv();
+
     void closeStreams();
 
     void closeStream(std::shared_ptr<oboe::AudioStream> &stream);
@@ -0,0 +1,56 @@
+/*
+ * MeterBank.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Output control port snapshots shared with the UI.
+ *
+ * Each slot owns two banks of (port index, value) pairs and a sequence
+ * number. After every cycle the audio thread fills the bank the UI is not
+ * reading (seq + 1) and then publishes it by incrementing seq. The UI maps
+ * the same memory as a direct ByteBuffer (see MeterReader.java), reads bank
+ * seq & 1 and retries if seq moved meanwhile. The writer never waits.
+ *
+ * The layout is read from Java by byte offset, so it is fixed here and
+ * checked at compile time.
+ */
+
+#ifndef OPIQO_METERBANK_H
+#define OPIQO_METERBANK_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+struct MeterSlot {
+    static constexpr uint32_t kMaxMeters = 32;
+
+    struct Bank {
+        uint32_t count;
+        uint32_t index[kMaxMeters];
+        float    value[kMaxMeters];
+    };
+
+    std::atomic<uint32_t> seq{0};
+    uint32_t reserved = 0;
+    Bank bank[2] = {};
+
+    // Audio thread: the bank to fill for this cycle
+    Bank& back() {
+        return bank[(seq.load(std::memory_order_relaxed) + 1) & 1];
+    }
+
+    // Audio thread: publish the bank returned by back()
+    void commit() {
+        seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};
+
+// Offsets mirrored in MeterReader.java
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "seq must be a plain word");
+static_assert(sizeof(std::atomic<uint32_t>) == 4, "seq must be a plain word");
+static_assert(offsetof(MeterSlot, bank) == 8, "MeterReader.BANK_OFFSET");
+static_assert(sizeof(MeterSlot::Bank) == 260, "MeterReader.BANK_SIZE");
+static_assert(sizeof(MeterSlot) == 528, "MeterReader.SLOT_SIZE");
+
+#endif //OPIQO_METERBANK_H
@@ -0,0 +1,248 @@
+/*
+ * MidiInput.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * MIDI from devices (or a replayed file) to the audio thread.
+ *
+ * Sources push raw MIDI bytes with a CLOCK_MONOTONIC timestamp, the clock
+ * Android's MIDI API and System.nanoTime() use. The bytes are split into
+ * short messages (sysex is dropped) and queued in a fixed ring. Each source
+ * (a device port, or the file replay) has its own parser, so running status
+ * and a message split across pushes belong to the source that sent them.
+ * Sources are not real-time and are serialised by a mutex; the audio thread
+ * only ever reads the ring with acquire/release on the indices and never
+ * waits.
+ *
+ * Each callback, collect() takes the events that fall inside the block's
+ * time span and turns their timestamps into frame offsets. The caller uses
+ * the span of the previous block, so every event lands at the offset at
+ * which it arrived, one block late: a fixed latency instead of jitter.
+ */
+
+#ifndef OPIQO_MIDIINPUT_H
+#define OPIQO_MIDIINPUT_H
+
+#include "ThreadManager.h"
+#include "logging_macros.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct MidiEvent {
+    int64_t time_ns;    // CLOCK_MONOTONIC
+    uint32_t frame;     // offset in the block, set by collect()
+    uint8_t size;
+    uint8_t data[3];
+};
+
+class MidiInput {
+public:
+    static constexpr uint32_t kCapacity = 1024;     // power of two
+    static constexpr uint32_t kMaxPerBlock = 256;
+    static constexpr uint32_t kMaxSources = 16;     // parsers
+    static constexpr uint32_t kReplaySource = 0;
+
+    ~MidiInput() {
+        stopReplay();
+    }
+
+    static int64_t now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    // Any thread but the audio thread: queue the messages in `bytes` from
+    // source, returns how many were queued. A message completes at the
+    // time of the push that brings its last byte.
+    int push(uint32_t source, const uint8_t* bytes, size_t count, int64_t time_ns) {
+        std::lock_guard<std::mutex> lock(producer_);
+        // Device ids wrap around the parsers, never onto the replay's
+        const uint32_t slot = source == kReplaySource ? kReplaySource
+                                                      : 1 + (source - 1) % (kMaxSources - 1);
+        Parser& parser = parsers_[slot];
+        MidiEvent& e = parser.partial;
+        uint8_t& need = parser.need;
+        int queued = 0;
+
+        for (size_t i = 0; i < count; ++i) {
+            const uint8_t b = bytes[i];
+            if (b >= 0xf8) {
+                // Real-time messages may sit in the middle of anything
+                MidiEvent rt = {time_ns, 0, 1, {b, 0, 0}};
+                queued += enqueue(rt);
+                continue;
+            }
+            if (b & 0x80) {
+                parser.in_sysex = b == 0xf0;
+                need = messageSize(b);
+                parser.running = b < 0xf0 ? b : 0;
+                e.data[0] = b;
+                e.size = need ? 1 : 0;
+            } else {
+                if (parser.in_sysex) continue;
+                if (e.size == 0) {
+                    if (!parser.running) continue;
+                    e.data[0] = parser.running;
+                    e.size = 1;
+                    need = messageSize(parser.running);
+                }
+                if (e.size < 3) e.data[e.size++] = b;
+            }
+            if (need && e.size == need) {
+                e.time_ns = time_ns;
+                queued += enqueue(e);
+                e.size = 0;
+            }
+        }
+        return queued;
+    }
+
+    // Messages lost because the audio thread fell behind
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    // ---------------------------------------------------------------------
+    // Audio thread
+    // ---------------------------------------------------------------------
+
+    // Events up to the end of the block [start_ns, start_ns + numFrames/rate),
+    // in order, with frame offsets; anything older lands on frame 0
+    uint32_t collect(int64_t start_ns, uint32_t numFrames, double rate,
+                     MidiEvent* out, uint32_t max) {
+        if (numFrames == 0) return 0;
+        const int64_t end_ns = start_ns + (int64_t)(1e9 * numFrames / rate);
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        const uint32_t head = head_.load(std::memory_order_acquire);
+
+        uint32_t n = 0, last = 0;
+        while (tail != head && n < max) {
+            const MidiEvent& e = ring_[tail & (kCapacity - 1)];
+            if (e.time_ns >= end_ns) break;
+
+            uint32_t frame = 0;
+            if (e.time_ns > start_ns)
+                frame = std::min(numFrames - 1, (uint32_t)((e.time_ns - start_ns) * rate / 1e9));
+            last = std::max(last, frame);   // sequences must not go back in time
+
+            out[n] = e;
+            out[n].frame = last;
+            ++n;
+            ++tail;
+        }
+        tail_.store(tail, std::memory_order_release);
+        return n;
+    }
+
+    // ---------------------------------------------------------------------
+    // File replay, a stand-in for a device where there is none
+    // ---------------------------------------------------------------------
+
+    // Replay "<ms> <hex byte> ..." lines ('#' starts a comment), the time
+    // counted from the start of the replay
+    bool startReplay(const std::string& path, bool loop = false) {
+        std::ifstream ifs(path);
+        if (!ifs) {
+            LOGE("[MidiInput] Cannot open %s", path.c_str());
+            return false;
+        }
+
+        std::vector<Scheduled> script;
+        std::string line;
+        while (std::getline(ifs, line)) {
+            const auto hash = line.find('#');
+            if (hash != std::string::npos) line.resize(hash);
+            std::istringstream fields(line);
+            Scheduled s;
+            if (!(fields >> s.ms)) continue;
+            unsigned byte;
+            while (s.bytes.size() < 3 && fields >> std::hex >> byte) s.bytes.push_back((uint8_t)byte);
+            if (!s.bytes.empty()) script.push_back(std::move(s));
+        }
+
+        stopReplay();
+        replaying_.store(true);
+        replay_ = ThreadManager::get().spawn(ThreadManager::Role::Realtime, "midi-replay",
+                                             &MidiInput::replay, this, std::move(script), loop);
+        return true;
+    }
+
+    void stopReplay() {
+        replaying_.store(false);
+        if (replay_.joinable()) replay_.join();
+    }
+
+private:
+    struct Scheduled {
+        double ms = 0;
+        std::vector<uint8_t> bytes;
+    };
+
+    // Byte stream state of one source, under producer_
+    struct Parser {
+        MidiEvent partial = {0, 0, 0, {0, 0, 0}};
+        uint8_t need = 0;
+        uint8_t running = 0;
+        bool in_sysex = false;
+    };
+
+    static uint8_t messageSize(uint8_t status) {
+        if (status < 0xc0 || (status >= 0xe0 && status < 0xf0)) return 3;
+        if (status < 0xe0) return 2;
+        switch (status) {
+            case 0xf1: case 0xf3: return 2;
+            case 0xf2: return 3;
+            case 0xf6: return 1;
+            default: return 0;      // sysex and undefined, not passed on
+        }
+    }
+
+    // Producer side, under producer_
+    int enqueue(const MidiEvent& e) {
+        const uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) >= kCapacity) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return 0;
+        }
+        ring_[head & (kCapacity - 1)] = e;
+        head_.store(head + 1, std::memory_order_release);
+        return 1;
+    }
+
+    void replay(std::vector<Scheduled> script, bool loop) {
+        do {
+            const int64_t start = now();
+            for (const auto& s : script) {
+                const int64_t at = start + (int64_t)(s.ms * 1e6);
+                while (replaying_.load() && now() < at) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(
+                            std::min<int64_t>(1000, (at - now()) / 1000 + 1)));
+                }
+                if (!replaying_.load()) return;
+                push(kReplaySource, s.bytes.data(), s.bytes.size(), at);
+            }
+        } while (loop && replaying_.load());
+    }
+
+    std::mutex producer_;
+    Parser parsers_[kMaxSources];
+
+    MidiEvent ring_[kCapacity];
+    std::atomic<uint32_t> head_{0};
+    std::atomic<uint32_t> tail_{0};
+    std::atomic<uint64_t> dropped_{0};
+
+    std::atomic<bool> replaying_{false};
+    std::thread replay_;
+};
+
+#endif //OPIQO_MIDIINPUT_H
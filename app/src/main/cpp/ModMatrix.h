@@ -0,0 +1,247 @@
+/*
+ * ModMatrix.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Modulation routing: MIDI CCs, LFOs and envelope followers driving plugin
+ * control ports.
+ *
+ * Every source is one float in 0..1 in a flat array: the 16 x 128 CCs, then
+ * the LFOs, then the envelope followers. A route maps a source through a
+ * curve onto the range of one (slot, port):
+ *
+ *     t   = clamp(source, 0, 1)
+ *     y   = t + curve * t * (1 - t)      curve in -1..1, 0 = linear
+ *     out = min + (max - min) * y
+ *
+ * The routes are a structure of arrays (Table) built off the audio thread
+ * and published with one atomic swap, like the plugin slots. PluginChain
+ * runs the chain in sub-blocks of kSubBlock frames while any route exists.
+ * Before each sub-block, evaluate() advances the sources, shapes all routes
+ * four at a time and writes the results straight into Port::control. With
+ * no route, controlChanges() still takes every block's CCs, so the sources
+ * are current and MIDI learn can complete the first route.
+ *
+ * MIDI learn: learn() arms the matrix with a route whose source is unknown,
+ * the audio thread records the next CC it sees, and pollLearn() completes
+ * the route from any other thread.
+ */
+
+#ifndef OPIQO_MODMATRIX_H
+#define OPIQO_MODMATRIX_H
+
+#include "LV2Plugin.hpp"
+#include "MidiInput.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+struct ModRoute {
+    int32_t source = -1;
+    int32_t slot = 1;       // 1-based, as everywhere else
+    uint32_t port = 0;
+    float min = 0.0f;
+    float max = 1.0f;
+    float curve = 0.0f;
+};
+
+class ModMatrix {
+public:
+    static constexpr int kSubBlock = 32;           // frames between evaluations
+    static constexpr int kMaxRoutes = 64;           // multiple of four
+    static constexpr int kLfos = 4;
+    static constexpr int kEnvelopes = 2;
+
+    // Source numbering
+    static constexpr int kCcSources = 16 * 128;
+    static constexpr int kLfoBase = kCcSources;
+    static constexpr int kEnvBase = kLfoBase + kLfos;
+    static constexpr int kSources = kEnvBase + kEnvelopes;
+
+    static constexpr int ccSource(int channel, int cc) { return channel * 128 + cc; }
+
+    enum Shape { Sine = 0, Triangle, Saw, Square };
+
+    // Routes ready for the audio thread, padded to a multiple of four
+    struct Table {
+        uint32_t count = 0;
+        int32_t source[kMaxRoutes];
+        int32_t slot[kMaxRoutes];       // 0-based here
+        uint32_t port[kMaxRoutes];
+        alignas(16) float min[kMaxRoutes];
+        alignas(16) float range[kMaxRoutes];
+        alignas(16) float curve[kMaxRoutes];
+        alignas(16) float value[kMaxRoutes];
+    };
+
+    // Modulator settings, written from any thread
+    struct Lfo {
+        std::atomic<float> hz{1.0f};
+        std::atomic<int> shape{Sine};
+    };
+    struct Envelope {
+        std::atomic<float> attack_ms{5.0f};
+        std::atomic<float> release_ms{200.0f};
+        std::atomic<float> gain{4.0f};     // input level that reads as 1 is 1/gain
+    };
+
+    Lfo lfo[kLfos];
+    Envelope envelope[kEnvelopes];
+
+    ModMatrix() {
+        for (auto& s : sources_) s = 0.0f;
+    }
+
+    ~ModMatrix() {
+        delete table_.exchange(nullptr);
+    }
+
+    // Not real-time: the stream rate the LFOs and envelopes run at
+    void prepare(double rate) { rate_ = rate; }
+
+    // Build a table from routes; invalid routes are left out
+    static Table* build(const std::vector<ModRoute>& routes, int slots) {
+        auto* t = new Table();
+        for (const auto& r : routes) {
+            if (t->count == kMaxRoutes) break;
+            if (r.source < 0 || r.source >= kSources || r.slot < 1 || r.slot > slots) continue;
+            const uint32_t i = t->count++;
+            t->source[i] = r.source;
+            t->slot[i] = r.slot - 1;
+            t->port[i] = r.port;
+            t->min[i] = r.min;
+            t->range[i] = r.max - r.min;
+            t->curve[i] = std::clamp(r.curve, -1.0f, 1.0f);
+        }
+        return t;
+    }
+
+    // Writer side, the caller waits out the audio thread before freeing
+    // the returned table
+    Table* swap(Table* next) { return table_.exchange(next); }
+
+    Table* table() const { return table_.load(std::memory_order_acquire); }
+
+    // Arm MIDI learn for a route, its source is filled by the next CC
+    void learn(const ModRoute& route) {
+        pending_ = route;
+        learned_.store(-1, std::memory_order_relaxed);
+        learning_.store(true, std::memory_order_release);
+    }
+
+    // The learnt route once a CC arrived, false while still waiting
+    bool pollLearn(ModRoute& route) {
+        const int source = learned_.exchange(-1, std::memory_order_acquire);
+        if (source < 0) return false;
+        route = pending_;
+        route.source = source;
+        return true;
+    }
+
+    void cancelLearn() {
+        learning_.store(false, std::memory_order_relaxed);
+        learned_.store(-1, std::memory_order_relaxed);
+    }
+
+    float source(int index) const {
+        return index >= 0 && index < kSources ? sources_[index] : 0.0f;
+    }
+
+    // ---------------------------------------------------------------------
+    // Audio thread
+    // ---------------------------------------------------------------------
+
+    // Take the CCs in `midi` into the sources and MIDI learn without
+    // evaluating any route; for blocks with no routes to evaluate
+    void controlChanges(const MidiEvent* midi, uint32_t midiCount) {
+        for (uint32_t i = 0; i < midiCount; ++i) controlChange(midi[i]);
+    }
+
+    // Advance the sources over a sub-block of `input` (numSamples
+    // interleaved, the chain input) and its MIDI, then write every route
+    // into its plugin port
+    void evaluate(Table& t, LV2Plugin* const* plugins, const float* input,
+                  int numSamples, int channels, const MidiEvent* midi, uint32_t midiCount) {
+        controlChanges(midi, midiCount);
+
+        const double frames = (double)numSamples / std::max(1, channels);
+        for (int i = 0; i < kLfos; ++i) {
+            sources_[kLfoBase + i] = lfoValue(i);
+            lfo_phase_[i] += frames * lfo[i].hz.load(std::memory_order_relaxed) / rate_;
+            lfo_phase_[i] -= std::floor(lfo_phase_[i]);
+        }
+
+        const float peak = simd::peak(input, numSamples);
+        const float seconds = (float)(frames / rate_);
+        for (int i = 0; i < kEnvelopes; ++i) {
+            const Envelope& e = envelope[i];
+            const float level = std::min(1.0f, peak * e.gain.load(std::memory_order_relaxed));
+            const float ms = level > env_[i] ? e.attack_ms.load(std::memory_order_relaxed)
+                                             : e.release_ms.load(std::memory_order_relaxed);
+            env_[i] += (level - env_[i]) * (1.0f - std::exp(-seconds * 1000.0f / std::max(0.1f, ms)));
+            sources_[kEnvBase + i] = env_[i];
+        }
+
+        shape(t);
+
+        for (uint32_t r = 0; r < t.count; ++r) {
+            LV2Plugin* p = plugins[t.slot[r]];
+            if (p) p->setControlDirect(t.port[r], t.value[r]);
+        }
+    }
+
+private:
+    // Gather the sources, then shape four routes per step
+    void shape(Table& t) {
+        using namespace simd;
+        const uint32_t padded = (t.count + 3) & ~3u;
+        for (uint32_t r = 0; r < padded; ++r)
+            t.value[r] = r < t.count ? sources_[t.source[r]] : 0.0f;
+
+        const v4sf zero = splat(0.0f), one = splat(1.0f);
+        for (uint32_t r = 0; r < padded; r += 4) {
+            const v4sf v = min(max(load(t.value + r), zero), one);
+            const v4sf y = v + load(t.curve + r) * v * (one - v);
+            store(t.value + r, load(t.min + r) + load(t.range + r) * y);
+        }
+    }
+
+    void controlChange(const MidiEvent& e) {
+        if (e.size != 3 || (e.data[0] & 0xf0) != 0xb0) return;
+        const int source = ccSource(e.data[0] & 0x0f, e.data[1] & 0x7f);
+        sources_[source] = (float)(e.data[2] & 0x7f) / 127.0f;
+
+        if (learning_.load(std::memory_order_acquire)) {
+            learning_.store(false, std::memory_order_relaxed);
+            learned_.store(source, std::memory_order_release);
+        }
+    }
+
+    float lfoValue(int i) const {
+        const double ph = lfo_phase_[i];
+        switch (lfo[i].shape.load(std::memory_order_relaxed)) {
+            case Triangle: return (float)(ph < 0.5 ? 2.0 * ph : 2.0 - 2.0 * ph);
+            case Saw: return (float)ph;
+            case Square: return ph < 0.5 ? 1.0f : 0.0f;
+            default: return (float)(0.5 - 0.5 * std::cos(2.0 * M_PI * ph));
+        }
+    }
+
+    std::atomic<Table*> table_{nullptr};
+    double rate_ = 48000;
+
+    // Audio thread state
+    float sources_[kSources];
+    double lfo_phase_[kLfos] = {};
+    float env_[kEnvelopes] = {};
+
+    // MIDI learn
+    ModRoute pending_;
+    std::atomic<bool> learning_{false};
+    std::atomic<int> learned_{-1};
+};
+
+#endif //OPIQO_MODMATRIX_H
@@ -0,0 +1,650 @@
+/*
+ * PluginChain.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * The ordered set of plugin slots shared by the UI and the audio callback.
+ *
+ * The audio thread only ever sees an immutable snapshot of the slots. Any
+ * mutation (add, remove, reorder) copies the snapshot, publishes the copy
+ * with one atomic store and then waits for a grace period — the end of any
+ * callback that may still be using the old snapshot — before the old
+ * snapshot and any plugin it no longer references are freed. The callback
+ * never blocks and never sees a half-updated chain.
+ *
+ * Slots run in series. Each slot boundary applies the slot's dry/wet,
+ * trims and pan in one pass (see SlotMix.h). A snapshot may carry mix
+ * settings for the plugins it brings in; they are applied once, by the
+ * first cycle that runs the snapshot or by the writer right after its
+ * grace period, whichever comes first, so new plugins never play a block
+ * of the old rig's mix and old ones never play the new mix.
+ *
+ * While the chain input is silent (see InputStage.h), a slot whose effect
+ * has died away is idled: it is not run and outputs silence, so downstream
+ * slots can idle in turn. Anything that is not silent wakes it.
+ *
+ * A plugin's lv2:reportsLatency port is read after every run. The slot
+ * delays its dry path by the same amount, so dry/wet stays phase aligned,
+ * and the chain's latency is the sum of its slots.
+ *
+ * While modulation routes exist (see ModMatrix.h), the block is run in
+ * sub-blocks of ModMatrix::kSubBlock frames and the matrix writes the
+ * modulated control ports before each one. Playing automation lanes (see
+ * Automation.h) split the block at their breakpoints the same way.
+ *
+ * After each slot runs, its output control ports are copied into that
+ * slot's MeterSlot, which the UI reads without locking (see MeterBank.h).
+ */
+
+#ifndef OPIQO_PLUGINCHAIN_H
+#define OPIQO_PLUGINCHAIN_H
+
+#include "Automation.h"
+#include "LV2Plugin.hpp"
+#include "MeterBank.h"
+#include "ModMatrix.h"
+#include "Simd.h"
+#include "SlotMix.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class PluginChain {
+public:
+    static constexpr int kSlots = 4;
+
+    struct MixSettings {
+        float mix = 1.0f, in_trim = 1.0f, out_trim = 1.0f, pan = 0.0f;
+    };
+
+    struct Slots {
+        LV2Plugin* plugin[kSlots] = {};
+        // Mix of the slots flagged in has_mix, published with the plugins;
+        // the others keep theirs
+        bool has_mix[kSlots] = {};
+        MixSettings mix[kSlots];
+        uint64_t mix_serial = 0;    // set by publish()
+    };
+
+    PluginChain() : current_(new Slots()) {}
+
+    ~PluginChain() {
+        Slots* slots = current_.exchange(nullptr);
+        for (auto* p : slots->plugin) destroy(p);
+        delete slots;
+    }
+
+    // ---------------------------------------------------------------------
+    // Audio thread
+    // ---------------------------------------------------------------------
+
+    // Run every slot in series, must be called from a single audio thread.
+    // Slots ping-pong between the two buffers, so inputBuffer is used as
+    // scratch and each slot still has its dry input next to its wet output
+    // for the mix at its boundary (see SlotMix.h). channels is the
+    // interleave of the buffers and only matters for pan. silentInput says
+    // the block is exact silence, e.g. gated by the InputStage. midi goes to
+    // every slot subscribed to MIDI input, stamped in plugin frames.
+    void process(float* inputBuffer, float* outputBuffer, int numSamples, int channels = 1,
+                 bool silentInput = false, const MidiEvent* midi = nullptr,
+                 uint32_t midiCount = 0) {
+        in_cycle_.store(true);
+        const Slots* slots = current_.load();
+        claimMix(*slots);
+
+        int active[kSlots];
+        int count = 0;
+        for (int i = 0; i < kSlots; ++i) {
+            if (slots->plugin[i]) {
+                active[count++] = i;
+            } else {
+                meters_[i].back().count = 0;
+                meters_[i].commit();
+                quiet_[i] = 0;
+                latency_[i].store(0, std::memory_order_relaxed);
+            }
+        }
+
+        // No route to evaluate: only the CCs, for the sources and MIDI learn
+        ModMatrix::Table* mod = mod_.table();
+        if (!mod || mod->count == 0) {
+            mod_.controlChanges(midi, midiCount);
+            mod = nullptr;
+        }
+        Automation::Lanes* lanes = automation_.active();
+        const int ch = std::max(1, channels);
+        const uint32_t frames = numSamples / ch;
+
+        if (!mod && !lanes) {
+            run(slots, active, count, inputBuffer, outputBuffer, numSamples, channels,
+                silentInput, midi, midiCount);
+        } else {
+            // Modulated or automated: set the controls before every
+            // sub-block, each sub-block getting its own MIDI rebased to its
+            // start. Automation first, so a modulated port follows the matrix.
+            MidiEvent local[MidiInput::kMaxPerBlock];
+            uint32_t e = 0;
+            for (uint32_t at = 0; at < frames;) {
+                uint32_t next = frames;
+                if (lanes) next = automation_.apply(*lanes, at, frames, slots->plugin);
+                if (mod) next = std::min(next, at + (uint32_t)ModMatrix::kSubBlock);
+
+                const int off = (int)at * ch;
+                const int n = (int)(next - at) * ch;
+                uint32_t m = 0;
+                for (; e < midiCount && midi[e].frame < (uint32_t)(off + n) &&
+                       m < MidiInput::kMaxPerBlock; ++e, ++m) {
+                    local[m] = midi[e];
+                    local[m].frame -= std::min<uint32_t>(local[m].frame, off);
+                }
+                if (mod) mod_.evaluate(*mod, slots->plugin, inputBuffer + off, n, channels, local, m);
+                run(slots, active, count, inputBuffer + off, outputBuffer + off, n, channels,
+                    silentInput, local, m);
+                at = next;
+            }
+        }
+        automation_.advance(frames);
+
+        cycle_.fetch_add(1);
+        in_cycle_.store(false);
+    }
+
+    // ---------------------------------------------------------------------
+    // Any other thread
+    // ---------------------------------------------------------------------
+
+    // Slot indices are 1-based to match the Java side
+    static bool isValidSlot(int slot) { return slot >= 1 && slot <= kSlots; }
+
+    // Put plugin into slot, destroying whatever was there; with mix, the
+    // slot's mix settings change together with the plugin
+    bool replace(int slot, LV2Plugin* plugin, const MixSettings* mix = nullptr) {
+        if (!isValidSlot(slot)) return false;
+        std::lock_guard<std::mutex> lock(writer_lock_);
+        Slots next = edit();
+        LV2Plugin* old = next.plugin[slot - 1];
+        next.plugin[slot - 1] = plugin;
+        if (mix) {
+            next.has_mix[slot - 1] = true;
+            next.mix[slot - 1] = *mix;
+        }
+        publish(next);
+        destroy(old);
+        return true;
+    }
+
+    bool remove(int slot) {
+        return replace(slot, nullptr);
+    }
+
+    // Put a whole rig in place in one step, destroying every plugin it
+    // replaces; the first cycle after it runs the new chain complete, with
+    // the mix of the slots next flags in has_mix
+    void replaceAll(const Slots& next) {
+        std::lock_guard<std::mutex> lock(writer_lock_);
+        const Slots old = *current_.load();
+        publish(next);
+        for (int i = 0; i < kSlots; ++i) {
+            if (std::find(std::begin(next.plugin), std::end(next.plugin), old.plugin[i]) ==
+                std::end(next.plugin))
+                destroy(old.plugin[i]);
+        }
+    }
+
+    // Swap two slots in one step, so no cycle runs a plugin twice
+    bool swap(int a, int b) {
+        if (!isValidSlot(a) || !isValidSlot(b)) return false;
+        std::lock_guard<std::mutex> lock(writer_lock_);
+        Slots next = edit();
+        std::swap(next.plugin[a - 1], next.plugin[b - 1]);
+        publish(next);
+        return true;
+    }
+
+    // Slot mix settings, applied from the next cycle with a one-block ramp.
+    // They belong to the slot, not the plugin, and survive replace().
+    bool setMix(int slot, float wet) {
+        if (!isValidSlot(slot)) return false;
+        mix_[slot - 1].mix.store(std::clamp(wet, 0.0f, 1.0f), std::memory_order_relaxed);
+        return true;
+    }
+
+    bool setInputTrim(int slot, float gain) {
+        if (!isValidSlot(slot)) return false;
+        mix_[slot - 1].in_trim.store(std::clamp(gain, 0.0f, kMaxTrim), std::memory_order_relaxed);
+        return true;
+    }
+
+    bool setOutputTrim(int slot, float gain) {
+        if (!isValidSlot(slot)) return false;
+        mix_[slot - 1].out_trim.store(std::clamp(gain, 0.0f, kMaxTrim), std::memory_order_relaxed);
+        return true;
+    }
+
+    bool setPan(int slot, float pan) {
+        if (!isValidSlot(slot)) return false;
+        mix_[slot - 1].pan.store(std::clamp(pan, -1.0f, 1.0f), std::memory_order_relaxed);
+        return true;
+    }
+
+    // The slot's current mix settings, for presets
+    const SlotMix& slotMix(int slot) const { return mix_[slot - 1]; }
+
+    // Whether the slot's plugin gets the MIDI input, on by default
+    bool setMidiSubscribed(int slot, bool subscribed) {
+        if (!isValidSlot(slot)) return false;
+        midi_subscribed_[slot - 1].store(subscribed, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Replace the modulation routes. Like the mix they belong to the slot,
+    // so they carry over to whatever plugin is put in it.
+    void setModRoutes(const std::vector<ModRoute>& routes) {
+        std::lock_guard<std::mutex> lock(writer_lock_);
+        routes_ = routes;
+        publishRoutes();
+    }
+
+    bool addModRoute(const ModRoute& route) {
+        if (!isValidSlot(route.slot)) return false;
+        std::lock_guard<std::mutex> lock(writer_lock_);
+        if (routes_.size() >= (size_t)ModMatrix::kMaxRoutes) return false;
+        routes_.push_back(route);
+        publishRoutes();
+        return true;
+    }
+
+    // Drop every route to (slot, port)
+    void removeModRoutes(int slot, uint32_t portIndex) {
+        std::lock_guard<std::mutex> lock(writer_lock_);
+        routes_.erase(std::remove_if(routes_.begin(), routes_.end(), [&](const ModRoute& r) {
+            return r.slot == slot && r.port == portIndex;
+        }), routes_.end());
+        publishRoutes();
+    }
+
+    std::vector<ModRoute> modRoutes() {
+        std::lock_guard<std::mutex> lock(writer_lock_);
+        return routes_;
+    }
+
+    // MIDI learn: the next CC on the input becomes the source of `route`
+    void learnModRoute(const ModRoute& route) { mod_.learn(route); }
+
+    // The learnt CC source once the route has been added, -1 while waiting
+    int pollModLearn() {
+        ModRoute route;
+        if (!mod_.pollLearn(route)) return -1;
+        addModRoute(route);
+        return route.source;
+    }
+
+    // LFO and envelope settings, and prepare()
+    ModMatrix& modulation() { return mod_; }
+
+    // Automation lanes: replace the breakpoints of (slot, port), frames
+    // ascending, creating the lane if needed
+    bool setAutomationLane(int slot, uint32_t portIndex, bool ramp,
+                           const std::vector<uint64_t>& frames, const std::vector<float>& values) {
+        if (!isValidSlot(slot) || frames.size() != values.size() ||
+            frames.size() > Automation::kMaxPoints || !std::is_sorted(frames.begin(), frames.end()))
+            return false;
+        std::lock_guard<std::mutex> lock(writer_lock_);
+        Automation::Lanes* next = editLanes();
+        Automation::Lane* lane = laneFor(*next, slot, portIndex);
+        if (!lane) {
+            delete next;
+            return false;
+        }
+        lane->ramp = ramp;
+        std::copy(frames.begin(), frames.end(), lane->frame);
+        std::copy(values.begin(), values.end(), lane->value);
+        lane->count.store((uint32_t)frames.size());
+        publishLanes(next);
+        return true;
+    }
+
+    // Arm (slot, port) for recording, creating an empty lane if needed
+    bool armAutomation(int slot, uint32_t portIndex, bool armed) {
+        if (!isValidSlot(slot)) return false;
+        std::lock_guard<std::mutex> lock(writer_lock_);
+        Automation::Lanes* next = editLanes();
+        Automation::Lane* lane = armed ? laneFor(*next, slot, portIndex)
+                                       : next->find(slot, portIndex);
+        if (!lane) {
+            delete next;
+            return !armed;
+        }
+        lane->armed = armed;
+        publishLanes(next);
+        return true;
+    }
+
+    void clearAutomationLane(int slot, uint32_t portIndex) {
+        std::lock_guard<std::mutex> lock(writer_lock_);
+        Automation::Lanes* next = editLanes();
+        Automation::Lane* lane = next->find(slot, portIndex);
+        if (lane) {
+            *lane = next->lane[--next->count];
+            next->lane[next->count].count.store(0);
+        }
+        publishLanes(next);
+    }
+
+    // The breakpoints of (slot, port), e.g. after recording
+    bool automationLane(int slot, uint32_t portIndex, std::vector<uint64_t>& frames,
+                        std::vector<float>& values) {
+        std::lock_guard<std::mutex> lock(writer_lock_);
+        mergeRecorded();
+        std::unique_ptr<Automation::Lanes> cur(automation_.copy());
+        const Automation::Lane* lane = cur->find(slot, portIndex);
+        if (!lane) return false;
+        const uint32_t n = lane->count.load();
+        frames.assign(lane->frame, lane->frame + n);
+        values.assign(lane->value, lane->value + n);
+        return true;
+    }
+
+    // Transport and the playhead
+    Automation& automation() { return automation_; }
+
+    // Put what has been recorded so far into the lanes, e.g. once the
+    // transport stops recording
+    void commitRecording() {
+        std::lock_guard<std::mutex> lock(writer_lock_);
+        mergeRecorded();
+    }
+
+    // Stage a control value, the plugin applies it at its next cycle
+    bool setValue(int slot, uint32_t portIndex, float value) {
+        if (!isValidSlot(slot)) return false;
+        automation_.record(slot, portIndex, value, MidiInput::now());
+        std::lock_guard<std::mutex> lock(writer_lock_);
+        // Keep room in the recorded points ring during a long take
+        if (automation_.recordedPending() >= Automation::kRecorded / 2) mergeRecorded();
+        LV2Plugin* p = current_.load()->plugin[slot - 1];
+        return p && p->setControlValue(portIndex, value);
+    }
+
+    // Run fn(plugin) with the slot pinned against concurrent removal
+    template <typename Fn>
+    bool withSlot(int slot, Fn&& fn) {
+        if (!isValidSlot(slot)) return false;
+        std::lock_guard<std::mutex> lock(writer_lock_);
+        LV2Plugin* p = current_.load()->plugin[slot - 1];
+        if (!p) return false;
+        fn(p);
+        return true;
+    }
+
+    // Frames of latency the slot's plugin reported in its last run
+    uint32_t slotLatency(int slot) const {
+        if (!isValidSlot(slot)) return 0;
+        return latency_[slot - 1].load(std::memory_order_relaxed);
+    }
+
+    // Frames from chain input to chain output: every slot is in series and
+    // compensates its own dry path, so the slot latencies add up
+    uint32_t latency() const {
+        uint32_t total = 0;
+        for (const auto& l : latency_) total += l.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    // Output control snapshots, one per slot, valid for the chain's lifetime
+    MeterSlot* meters() { return meters_; }
+    static constexpr size_t metersSize() { return sizeof(MeterSlot) * kSlots; }
+
+private:
+    static constexpr float kMaxTrim = 16.0f;    // +24 dB
+    // A slot idles after this many silent-input blocks with its output
+    // below kQuietPeak (-100 dB)
+    static constexpr uint32_t kIdleBlocks = 16;
+    static constexpr float kQuietPeak = 1e-5f;
+    // Longest plugin latency the dry path is compensated for, in samples of
+    // the interleaved stream
+    static constexpr uint32_t kMaxCompensation = 8192;
+
+    // The active slots over one stretch of the block
+    void run(const Slots* slots, const int* active, int count, float* inputBuffer,
+             float* outputBuffer, int numSamples, int channels, bool silentInput,
+             const MidiEvent* midi, uint32_t midiCount) {
+        float* src = inputBuffer;
+        float* dst = outputBuffer;
+
+        // Chain input: nobody before the first slot to fold its trim into
+        if (count > 0) {
+            SlotMix& first = mix_[active[0]];
+            const float to = first.in_trim.load(std::memory_order_relaxed);
+            if (to != 1.0f || first.cur_in_trim != 1.0f) {
+                slotmix::apply(src, src, src, numSamples, channels,
+                               MixGains::gain(first.cur_in_trim), MixGains::gain(to));
+            }
+            first.cur_in_trim = to;
+        }
+
+        bool silent = silentInput;
+        for (int k = 0; k < count; ++k) {
+            const int i = active[k];
+            LV2Plugin* p = slots->plugin[i];
+
+            if (silent && quiet_[i] >= kIdleBlocks) {
+                // Idle: silence in, tail long gone, so silence out
+                memset(dst, 0, sizeof(float) * numSamples);
+            } else {
+                if (midiCount && midi_subscribed_[i].load(std::memory_order_relaxed))
+                    p->setMidiInput(midi, midiCount);
+
+                MeterSlot::Bank& meters = meters_[i].back();
+                meters.count = 0;
+                if (p->process(src, dst, numSamples)) {
+                    meters.count = p->readOutputControls(meters.index, meters.value,
+                                                         MeterSlot::kMaxMeters);
+                } else {
+                    memcpy(dst, src, sizeof(float) * numSamples);
+                }
+                meters_[i].commit();
+
+                // Line the dry path up with the wet one for the mix. The
+                // plugin runs over the interleaved block as one stream, so
+                // what it reports is in samples of that stream, not frames.
+                uint32_t latency = 0;
+                if (p->reportsLatency()) {
+                    latency = std::min(p->latency(), kMaxCompensation);
+                    compensate(compensation_[i], src, numSamples, latency);
+                }
+                latency_[i].store(latency / std::max(1, channels), std::memory_order_relaxed);
+
+                if (silent && p->canIdle() && simd::peak(dst, numSamples) <= kQuietPeak) {
+                    ++quiet_[i];
+                } else {
+                    quiet_[i] = 0;
+                }
+                silent = false;
+            }
+
+            mixBoundary(src, dst, numSamples, channels, mix_[i],
+                        k + 1 < count ? &mix_[active[k + 1]] : nullptr);
+            std::swap(src, dst);
+        }
+
+        if (src != outputBuffer) memcpy(outputBuffer, src, sizeof(float) * numSamples);
+    }
+
+    // One fused pass: this slot's mix, output trim and pan, and the next
+    // slot's input trim. Skipped when it would not change the signal.
+    static void mixBoundary(const float* dry, float* wet, int numSamples, int channels,
+                            SlotMix& m, SlotMix* next) {
+        float next_from = 1.0f, next_to = 1.0f;
+        if (next) {
+            next_from = next->cur_in_trim;
+            next_to = next->in_trim.load(std::memory_order_relaxed);
+            next->cur_in_trim = next_to;
+        }
+
+        const float mix = m.mix.load(std::memory_order_relaxed);
+        const float out_trim = m.out_trim.load(std::memory_order_relaxed);
+        const float pan = m.pan.load(std::memory_order_relaxed);
+
+        const MixGains from = MixGains::from(m.cur_mix, m.cur_out_trim, m.cur_pan, next_from);
+        const MixGains to = MixGains::from(mix, out_trim, pan, next_to);
+        m.cur_mix = mix;
+        m.cur_out_trim = out_trim;
+        m.cur_pan = pan;
+
+        if (from == to && to.isIdentity()) return;
+        slotmix::apply(dry, wet, wet, numSamples, channels, from, to);
+    }
+
+    // Delay of a slot's dry path, preallocated for kMaxCompensation samples
+    // (plus room for one chunk, so a block never wraps onto itself)
+    struct Compensation {
+        std::vector<float> line;
+        uint32_t pos = 0;
+    };
+
+    // Delay buf in place by `delay` samples; with no delay the line still
+    // takes the block, so a later latency change has history to read
+    static void compensate(Compensation& c, float* buf, int numSamples, uint32_t delay) {
+        const uint32_t size = (uint32_t)c.line.size();
+        float* line = c.line.data();
+        for (int off = 0; off < numSamples;) {
+            const uint32_t n = std::min<uint32_t>(numSamples - off, size - delay);
+            const uint32_t first = std::min(n, size - c.pos);
+            memcpy(line + c.pos, buf + off, sizeof(float) * first);
+            memcpy(line, buf + off + first, sizeof(float) * (n - first));
+
+            if (delay) {
+                const uint32_t read = (c.pos + size - delay) % size;
+                const uint32_t head = std::min(n, size - read);
+                memcpy(buf + off, line + read, sizeof(float) * head);
+                memcpy(buf + off + head, line, sizeof(float) * (n - head));
+            }
+            c.pos = (c.pos + n) % size;
+            off += n;
+        }
+    }
+
+    // Under writer_lock_: a copy of the current snapshot to change, without
+    // the mix it was published with
+    Slots edit() const {
+        Slots next = *current_.load();
+        std::fill(std::begin(next.has_mix), std::end(next.has_mix), false);
+        return next;
+    }
+
+    void publish(const Slots& next) {
+        // Lines are allocated once, before the first plugin that needs one
+        // can reach the audio thread, and kept for the chain's lifetime
+        for (int i = 0; i < kSlots; ++i) {
+            if (next.plugin[i] && next.plugin[i]->reportsLatency() && compensation_[i].line.empty())
+                compensation_[i].line.assign((size_t)kMaxCompensation * 2, 0.0f);
+        }
+
+        Slots* fresh = new Slots(next);
+        fresh->mix_serial = 0;
+        if (std::find(std::begin(next.has_mix), std::end(next.has_mix), true) != std::end(next.has_mix))
+            fresh->mix_serial = ++mix_serial_;
+
+        Slots* old = current_.exchange(fresh);
+        synchronize();
+        // No cycle ran the new snapshot yet (or the callback is stopped):
+        // its mix is set here, before anyone can change it again
+        claimMix(*fresh);
+        delete old;
+    }
+
+    // Audio thread at the start of a cycle, or the writer after publishing:
+    // the first to see a snapshot with a new mix sets it, exactly once
+    void claimMix(const Slots& slots) {
+        uint64_t applied = mix_applied_.load(std::memory_order_acquire);
+        if (slots.mix_serial <= applied ||
+            !mix_applied_.compare_exchange_strong(applied, slots.mix_serial))
+            return;
+        for (int i = 0; i < kSlots; ++i) {
+            if (!slots.has_mix[i]) continue;
+            setMix(i + 1, slots.mix[i].mix);
+            setInputTrim(i + 1, slots.mix[i].in_trim);
+            setOutputTrim(i + 1, slots.mix[i].out_trim);
+            setPan(i + 1, slots.mix[i].pan);
+        }
+    }
+
+    // Under writer_lock_: the lane for (slot, port), added if there is room
+    static Automation::Lane* laneFor(Automation::Lanes& lanes, int slot, uint32_t portIndex) {
+        Automation::Lane* lane = lanes.find(slot, portIndex);
+        if (lane || lanes.count == Automation::kMaxLanes) return lane;
+        lane = &lanes.lane[lanes.count++];
+        lane->slot = slot;
+        lane->port = portIndex;
+        lane->ramp = false;
+        lane->armed = false;
+        lane->count.store(0);
+        return lane;
+    }
+
+    // Under writer_lock_: a copy of the lanes to edit, recorded points
+    // included
+    Automation::Lanes* editLanes() {
+        Automation::Lanes* next = automation_.copy();
+        automation_.merge(*next);
+        return next;
+    }
+
+    // Under writer_lock_: republish the lanes if points were recorded
+    void mergeRecorded() {
+        if (automation_.recordedPending() == 0) return;
+        publishLanes(editLanes());
+    }
+
+    void publishLanes(Automation::Lanes* next) {
+        Automation::Lanes* old = automation_.swap(next);
+        synchronize();
+        delete old;
+    }
+
+    // Under writer_lock_
+    void publishRoutes() {
+        ModMatrix::Table* old = mod_.swap(ModMatrix::build(routes_, kSlots));
+        synchronize();
+        delete old;
+    }
+
+    // Wait until no callback can still hold the previous snapshot
+    void synchronize() {
+        if (!in_cycle_.load()) return;
+        const uint64_t seen = cycle_.load();
+        while (in_cycle_.load() && cycle_.load() == seen) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+
+    static void destroy(LV2Plugin* plugin) {
+        if (!plugin) return;
+        plugin->closePlugin();
+        delete plugin;
+    }
+
+    std::atomic<Slots*> current_;
+    std::atomic<bool> in_cycle_{false};
+    std::atomic<uint64_t> cycle_{0};
+    std::mutex writer_lock_;
+    MeterSlot meters_[kSlots];
+    SlotMix mix_[kSlots];
+    uint64_t mix_serial_ = 0;                   // under writer_lock_
+    std::atomic<uint64_t> mix_applied_{0};      // last mix_serial set
+    uint32_t quiet_[kSlots] = {};   // audio thread only
+    Compensation compensation_[kSlots];
+    std::atomic<uint32_t> latency_[kSlots] = {};
+    std::atomic<bool> midi_subscribed_[kSlots] = {true, true, true, true};
+    ModMatrix mod_;
+    Automation automation_;
+    std::vector<ModRoute> routes_;  // under writer_lock_
+};
+
+#endif //OPIQO_PLUGINCHAIN_H
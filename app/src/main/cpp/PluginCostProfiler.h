@@ -0,0 +1,267 @@
+/*
+ * PluginCostProfiler.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Background self-benchmark of every plugin in the catalog.
+ *
+ * A background thread loads its own Lilv world from the LV2 path (so it
+ * never races the UI on the engine's world), instantiates each plugin in
+ * turn at the stream's rate and block size, feeds it an interleaved block
+ * of noise for every channel, as PluginChain does, and records the mean and
+ * worst ns/sample. Results are kept per plugin URI and persisted as JSON in
+ * the cache directory, so a plugin is measured once per rate/block/channels
+ * combination. The engine sums these to predict the load of a chain before
+ * it runs.
+ *
+ * Plugins run in the app's process here. The URI being measured is written
+ * to a marker file next to the database first, so a plugin that takes the
+ * process down is found there on the next start, recorded as crashed and
+ * never measured again.
+ */
+
+#ifndef OPIQO_PLUGINCOSTPROFILER_H
+#define OPIQO_PLUGINCOSTPROFILER_H
+
+#include "logging_macros.h"
+#include "LV2Plugin.hpp"
+#include "ThreadManager.h"
+#include "json.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+class PluginCostProfiler {
+public:
+    struct Cost {
+        double ns_per_sample = 0.0;        // mean over all measured blocks
+        double worst_ns_per_sample = 0.0;  // slowest single block
+        int32_t rate = 0;
+        int32_t block = 0;                 // frames
+        int32_t channels = 0;
+        bool crashed = false;              // took the process down, never retried
+    };
+
+    ~PluginCostProfiler() {
+        stop();
+    }
+
+    // Measure every uri not yet known at this rate/block/channels, in the background
+    void start(const std::string& lv2Path, std::vector<std::string> uris,
+               int32_t rate, int32_t block, int32_t channels, const std::string& dbPath) {
+        stop();
+        lv2_path_ = lv2Path;
+        uris_ = std::move(uris);
+        rate_ = rate;
+        block_ = block;
+        channels_ = channels;
+        db_path_ = dbPath;
+        load();
+        recoverCrash();
+
+        stop_.store(false);
+        running_.store(true);
+        thread_ = ThreadManager::get().spawn(ThreadManager::Role::Background, "cost-profiler",
+                                             &PluginCostProfiler::run, this);
+    }
+
+    void stop() {
+        stop_.store(true);
+        if (thread_.joinable()) thread_.join();
+        running_.store(false);
+    }
+
+    bool isRunning() const { return running_.load(); }
+
+    bool lookup(const std::string& uri, Cost& cost) const {
+        std::lock_guard<std::mutex> lock(lock_);
+        auto it = costs_.find(uri);
+        if (it == costs_.end()) return false;
+        cost = it->second;
+        return true;
+    }
+
+    // Fraction of one core the plugins would use at rate over channels
+    // interleaved channels, -1 if any is unknown
+    double predictLoad(const std::vector<std::string>& uris, int32_t rate, int32_t channels) const {
+        double ns_per_sample = 0.0;
+        for (const auto& uri : uris) {
+            Cost cost;
+            if (!lookup(uri, cost) || cost.crashed) return -1.0;
+            ns_per_sample += cost.ns_per_sample;
+        }
+        return ns_per_sample * rate * channels / 1e9;
+    }
+
+    nlohmann::json toJson() const {
+        std::lock_guard<std::mutex> lock(lock_);
+        nlohmann::json db = nlohmann::json::object();
+        for (const auto& [uri, cost] : costs_) {
+            db[uri] = {
+                    {"ns_per_sample", cost.ns_per_sample},
+                    {"worst_ns_per_sample", cost.worst_ns_per_sample},
+                    {"rate", cost.rate},
+                    {"block", cost.block},
+                    {"channels", cost.channels},
+                    {"crashed", cost.crashed}
+            };
+        }
+        return db;
+    }
+
+private:
+    static constexpr int kWarmupBlocks = 16;
+    static constexpr int kMeasureBlocks = 256;
+
+    void run() {
+        LilvWorld* world = lilv_world_new();
+        LilvNode* path = lilv_new_string(world, lv2_path_.c_str());
+        lilv_world_set_option(world, LILV_OPTION_LV2_PATH, path);
+        lilv_node_free(path);
+        lilv_world_load_all(world);
+
+        for (const auto& uri : uris_) {
+            if (stop_.load()) break;
+
+            Cost cost;
+            if (lookup(uri, cost) && (cost.crashed || (cost.rate == rate_ && cost.block == block_ &&
+                                                       cost.channels == channels_)))
+                continue;
+
+            markMeasuring(uri);
+            const bool measured = measure(world, uri, cost);
+            markMeasuring("");
+            if (measured) {
+                LOGD("[PluginCostProfiler] %s: %.1f ns/sample (worst %.1f)",
+                     uri.c_str(), cost.ns_per_sample, cost.worst_ns_per_sample);
+                std::lock_guard<std::mutex> lock(lock_);
+                costs_[uri] = cost;
+            } else {
+                LOGE("[PluginCostProfiler] Could not measure %s", uri.c_str());
+            }
+        }
+
+        lilv_world_free(world);
+        save();
+        running_.store(false);
+    }
+
+    bool measure(LilvWorld* world, const std::string& uri, Cost& cost) {
+        const int samples = block_ * channels_;
+        LV2Plugin plugin(world, uri.c_str(), rate_, samples);
+        if (!plugin.initialize()) return false;
+        plugin.start();
+
+        std::vector<float> in(samples), out(samples);
+        std::minstd_rand rng(1);
+        std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+        for (auto& s : in) s = noise(rng);
+
+        uint64_t total = 0, worst = 0;
+        for (int b = 0; b < kWarmupBlocks + kMeasureBlocks; ++b) {
+            if (stop_.load()) return false;
+            const auto t0 = std::chrono::steady_clock::now();
+            plugin.process(in.data(), out.data(), samples);
+            const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - t0).count();
+            if (b < kWarmupBlocks) continue;
+            total += ns;
+            if (ns > worst) worst = ns;
+        }
+
+        plugin.closePlugin();
+        cost.ns_per_sample = (double)total / ((double)kMeasureBlocks * samples);
+        cost.worst_ns_per_sample = (double)worst / samples;
+        cost.rate = rate_;
+        cost.block = block_;
+        cost.channels = channels_;
+        return true;
+    }
+
+    std::string markerPath() const {
+        return db_path_.empty() ? "" : db_path_ + ".measuring";
+    }
+
+    // The uri about to be measured, or "" once it returned
+    void markMeasuring(const std::string& uri) const {
+        const std::string marker = markerPath();
+        if (marker.empty()) return;
+        if (uri.empty()) {
+            std::remove(marker.c_str());
+            return;
+        }
+        std::ofstream ofs(marker, std::ios::trunc);
+        ofs << uri;
+    }
+
+    // A marker left behind names the plugin the last run died in
+    void recoverCrash() {
+        const std::string marker = markerPath();
+        if (marker.empty()) return;
+        std::ifstream ifs(marker);
+        std::string uri;
+        if (!ifs || !std::getline(ifs, uri) || uri.empty()) return;
+        ifs.close();
+
+        LOGE("[PluginCostProfiler] %s crashed while being measured, not measuring it again",
+             uri.c_str());
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            Cost& cost = costs_[uri];
+            cost = Cost();
+            cost.crashed = true;
+        }
+        save();
+        std::remove(marker.c_str());
+    }
+
+    void load() {
+        std::ifstream ifs(db_path_);
+        if (!ifs) return;
+
+        nlohmann::json db = nlohmann::json::parse(ifs, nullptr, false);
+        if (!db.is_object()) return;
+
+        std::lock_guard<std::mutex> lock(lock_);
+        for (auto it = db.begin(); it != db.end(); ++it) {
+            Cost cost;
+            cost.ns_per_sample = it.value().value("ns_per_sample", 0.0);
+            cost.worst_ns_per_sample = it.value().value("worst_ns_per_sample", 0.0);
+            cost.rate = it.value().value("rate", 0);
+            cost.block = it.value().value("block", 0);
+            cost.channels = it.value().value("channels", 0);
+            cost.crashed = it.value().value("crashed", false);
+            costs_[it.key()] = cost;
+        }
+    }
+
+    void save() const {
+        if (db_path_.empty()) return;
+        std::ofstream ofs(db_path_);
+        if (ofs) ofs << toJson().dump(2);
+    }
+
+    std::string lv2_path_;
+    std::vector<std::string> uris_;
+    int32_t rate_ = 0;
+    int32_t block_ = 0;
+    int32_t channels_ = 0;
+    std::string db_path_;
+
+    mutable std::mutex lock_;
+    std::map<std::string, Cost> costs_;
+
+    std::atomic<bool> stop_{false};
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+};
+
+#endif //OPIQO_PLUGINCOSTPROFILER_H
@@ -0,0 +1,223 @@
+/*
+ * PluginLog.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * The LV2 log feature (log:log) for one plugin instance.
+ *
+ * Plugins may log from the audio thread (log:Trace, and plenty of plugins
+ * ignore that restriction), the worker and instantiate() all at once, so the
+ * message ring is a bounded multi-producer queue: a producer claims a cell by
+ * CAS on the head and publishes it with the cell's sequence number, nobody
+ * waits. The message is formatted into the cell with vsnprintf, no
+ * allocation and no syscall; the rtlog drain thread (RtLog.h) writes it out
+ * later, prefixed with the plugin's URI.
+ *
+ * Each plugin may queue kPerSecond messages a second; the rest are counted
+ * as suppressed and reported as one line. Stats() gives the per-plugin
+ * counters, so a chatty plugin can be found from the UI.
+ */
+
+#ifndef OPIQO_PLUGINLOG_H
+#define OPIQO_PLUGINLOG_H
+
+#include "RtLog.h"
+
+#include <lv2/core/lv2.h>
+#include <lv2/log/log.h>
+#include <lv2/urid/urid.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+
+class PluginLog : public rtlog::Source {
+public:
+    static constexpr uint32_t kCells = 32;          // power of two
+    static constexpr size_t kMessageSize = 240;
+    static constexpr uint32_t kPerSecond = 20;
+
+    struct Stats {
+        uint64_t messages = 0;      // queued
+        uint64_t suppressed = 0;    // over the rate limit
+        uint64_t dropped = 0;       // ring full
+        uint64_t errors = 0;
+        uint64_t warnings = 0;
+    };
+
+    PluginLog() {
+        for (uint32_t i = 0; i < kCells; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+        log_.handle = this;
+        log_.printf = printf_cb;
+        log_.vprintf = vprintf_cb;
+        feature_.URI = LV2_LOG__log;
+        feature_.data = &log_;
+    }
+
+    ~PluginLog() override {
+        if (attached_) rtlog::Logger::get().detach(this);
+    }
+
+    PluginLog(const PluginLog&) = delete;
+    PluginLog& operator=(const PluginLog&) = delete;
+
+    // Not real-time, before the plugin can log
+    void init(const std::string& name, LV2_URID_Map* map) {
+        name_ = name;
+        error_ = map->map(map->handle, LV2_LOG__Error);
+        warning_ = map->map(map->handle, LV2_LOG__Warning);
+        note_ = map->map(map->handle, LV2_LOG__Note);
+        trace_ = map->map(map->handle, LV2_LOG__Trace);
+        if (!attached_) {
+            rtlog::Logger::get().attach(this);
+            attached_ = true;
+        }
+    }
+
+    LV2_Feature* feature() { return &feature_; }
+
+    Stats stats() const {
+        Stats s;
+        s.messages = messages_.load(std::memory_order_relaxed);
+        s.suppressed = suppressed_.load(std::memory_order_relaxed);
+        s.dropped = dropped_.load(std::memory_order_relaxed);
+        s.errors = errors_.load(std::memory_order_relaxed);
+        s.warnings = warnings_.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    // rtlog drain thread
+    void drain() override {
+        uint32_t tail = tail_;
+        for (;;) {
+            Cell& c = cells_[tail & (kCells - 1)];
+            if (c.seq.load(std::memory_order_acquire) != tail + 1) break;
+            char line[kMessageSize + 160];
+            snprintf(line, sizeof(line), "[%s] %s", name_.c_str(), c.text);
+            rtlog::Logger::get().write(c.level, line);
+            c.seq.store(tail + kCells, std::memory_order_release);
+            ++tail;
+        }
+        tail_ = tail;
+
+        const uint64_t suppressed = suppressed_.load(std::memory_order_relaxed);
+        if (suppressed != reported_) {
+            char line[200];
+            snprintf(line, sizeof(line), "[%s] %llu log messages suppressed", name_.c_str(),
+                     (unsigned long long)(suppressed - reported_));
+            rtlog::Logger::get().write(rtlog::Warn, line);
+            reported_ = suppressed;
+        }
+    }
+
+private:
+    struct Cell {
+        std::atomic<uint32_t> seq{0};
+        rtlog::Level level = rtlog::Info;
+        char text[kMessageSize];
+    };
+
+    static int printf_cb(LV2_Log_Handle handle, LV2_URID type, const char* fmt, ...) {
+        va_list ap;
+        va_start(ap, fmt);
+        const int n = vprintf_cb(handle, type, fmt, ap);
+        va_end(ap);
+        return n;
+    }
+
+    static int vprintf_cb(LV2_Log_Handle handle, LV2_URID type, const char* fmt, va_list ap) {
+        return static_cast<PluginLog*>(handle)->push(type, fmt, ap);
+    }
+
+    rtlog::Level levelOf(LV2_URID type) {
+        if (type == error_) {
+            errors_.fetch_add(1, std::memory_order_relaxed);
+            return rtlog::Error;
+        }
+        if (type == warning_) {
+            warnings_.fetch_add(1, std::memory_order_relaxed);
+            return rtlog::Warn;
+        }
+        return type == trace_ ? rtlog::Debug : rtlog::Info;
+    }
+
+    // Any thread, the audio thread included
+    int push(LV2_URID type, const char* fmt, va_list ap) {
+        const rtlog::Level level = levelOf(type);
+
+        // Nobody drains before the logger runs, so write in place
+        if (!rtlog::Logger::get().running()) {
+            char text[kMessageSize], line[kMessageSize + 160];
+            const int n = vsnprintf(text, sizeof(text), fmt, ap);
+            trim(text, n);
+            snprintf(line, sizeof(line), "[%s] %s", name_.c_str(), text);
+            rtlog::Logger::get().write(level, line);
+            return n;
+        }
+
+        if (!admit()) {
+            suppressed_.fetch_add(1, std::memory_order_relaxed);
+            return 0;
+        }
+
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        Cell* c;
+        for (;;) {
+            c = &cells_[head & (kCells - 1)];
+            const int32_t diff = (int32_t)(c->seq.load(std::memory_order_acquire) - head);
+            if (diff < 0) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return 0;
+            }
+            if (diff == 0 && head_.compare_exchange_weak(head, head + 1, std::memory_order_relaxed))
+                break;
+            if (diff > 0) head = head_.load(std::memory_order_relaxed);
+        }
+
+        c->level = level;
+        const int n = vsnprintf(c->text, kMessageSize, fmt, ap);
+        trim(c->text, n);
+        c->seq.store(head + 1, std::memory_order_release);
+        messages_.fetch_add(1, std::memory_order_relaxed);
+        return n;
+    }
+
+    // Drop the plugin's own newlines, the sink adds one
+    static void trim(char* text, int n) {
+        size_t len = std::min<size_t>(n < 0 ? 0 : (size_t)n, kMessageSize - 1);
+        while (len && text[len - 1] == '\n') text[--len] = 0;
+    }
+
+    // Fixed one-second windows, kPerSecond messages each
+    bool admit() {
+        const int64_t now = rtlog::Logger::now();
+        int64_t start = window_.load(std::memory_order_relaxed);
+        if (now - start >= 1000000000 && window_.compare_exchange_strong(start, now))
+            in_window_.store(0, std::memory_order_relaxed);
+        return in_window_.fetch_add(1, std::memory_order_relaxed) < kPerSecond;
+    }
+
+    std::string name_ = "plugin";
+    LV2_URID error_ = 0, warning_ = 0, note_ = 0, trace_ = 0;
+    LV2_Log_Log log_;
+    LV2_Feature feature_;
+    bool attached_ = false;
+
+    Cell cells_[kCells];
+    std::atomic<uint32_t> head_{0};
+    uint32_t tail_ = 0;             // drain thread only
+    uint64_t reported_ = 0;         // drain thread only
+
+    std::atomic<int64_t> window_{0};
+    std::atomic<uint32_t> in_window_{0};
+
+    std::atomic<uint64_t> messages_{0};
+    std::atomic<uint64_t> suppressed_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> errors_{0};
+    std::atomic<uint64_t> warnings_{0};
+};
+
+#endif //OPIQO_PLUGINLOG_H
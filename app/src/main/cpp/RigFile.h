@@ -0,0 +1,407 @@
+/*
+ * RigFile.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * The binary rig file: the whole chain in one file that is mapped, not
+ * parsed.
+ *
+ *   Header      magic "OPQR", version, sizes, where the index is
+ *   SlotEntry[] the index, one per occupied slot: slot number, flags, the
+ *               plugin URI and its FNV-1a hash, the slot mix, and where the
+ *               slot's controls and state properties are
+ *   Control[]   (port index, value) for every control input
+ *   Property[]  the plugin's state:interface properties that are plain
+ *               portable data (LV2_STATE_IS_POD | LV2_STATE_IS_PORTABLE):
+ *               key, type, flags and an 8-byte aligned opaque blob
+ *   strings     NUL-terminated URIs, referenced by offset
+ *
+ * Everything is little endian and fixed size; open() checks every offset
+ * once, so the accessors never do. A control-only preset (applyControls())
+ * is applied straight from the mapping to the plugins already loaded,
+ * matched by URI hash, without allocating. load() builds the whole rig
+ * through SessionLoader instead, restoring the properties from the mapping.
+ *
+ * Turtle stays the interchange format: exportTurtle() writes each slot as a
+ * lilv state file next to a session.json that AudioEngine.loadSession()
+ * reads, and save() after such a load turns it back into a rig file.
+ */
+
+#ifndef OPIQO_RIGFILE_H
+#define OPIQO_RIGFILE_H
+
+#include "LV2Plugin.hpp"
+#include "PluginChain.h"
+#include "SessionLoader.h"
+#include "json.hpp"
+#include "logging_macros.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "RigFile.h assumes a little endian target"
+#endif
+
+class RigFile {
+public:
+    static constexpr uint16_t kVersion = 1;
+    static constexpr uint32_t kMaxControls = 512;  // per slot
+
+    enum SlotFlags : uint8_t { Sandboxed = 1 };
+
+    struct Header {
+        char magic[4];              // "OPQR"
+        uint16_t version;
+        uint16_t header_size;
+        uint32_t file_size;
+        uint32_t slot_count;
+        uint32_t index;             // SlotEntry[slot_count]
+        uint32_t strings;
+        uint32_t strings_size;
+        uint32_t reserved;
+    };
+
+    struct SlotEntry {
+        uint8_t slot;               // 1-based
+        uint8_t flags;              // SlotFlags
+        uint16_t reserved;
+        uint32_t uri;               // string
+        uint64_t uri_hash;
+        float mix, in_trim, out_trim, pan;
+        uint32_t controls;          // Control[control_count]
+        uint32_t control_count;
+        uint32_t properties;        // Property[property_count]
+        uint32_t property_count;
+    };
+
+    struct Control {
+        uint32_t port;
+        float value;
+    };
+
+    struct Property {
+        uint32_t key;               // string
+        uint32_t type;              // string
+        uint32_t flags;             // LV2_State_Flags
+        uint32_t size;
+        uint32_t data;              // 8-byte aligned
+        uint32_t reserved;
+    };
+
+    static_assert(sizeof(Header) == 32, "rig file layout");
+    static_assert(sizeof(SlotEntry) == 48, "rig file layout");
+    static_assert(sizeof(Control) == 8, "rig file layout");
+    static_assert(sizeof(Property) == 24, "rig file layout");
+
+    // FNV-1a, 64 bit
+    static uint64_t hash(const char* s) {
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (; *s; ++s) h = (h ^ (uint8_t)*s) * 0x100000001b3ull;
+        return h;
+    }
+
+    RigFile() = default;
+    ~RigFile() { close(); }
+    RigFile(const RigFile&) = delete;
+    RigFile& operator=(const RigFile&) = delete;
+
+    // Map `path` and check it, false (and nothing mapped) if it is not a
+    // rig file this version can read
+    bool open(const std::string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            LOGE("[RigFile] Cannot open %s: %s", path.c_str(), strerror(errno));
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(Header)) {
+            size_ = (size_t)st.st_size;
+            void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) base_ = (const uint8_t*)map;
+        }
+        ::close(fd);
+
+        if (!base_ || !validate()) {
+            LOGE("[RigFile] %s is not a readable rig file", path.c_str());
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (base_) munmap((void*)base_, size_);
+        base_ = nullptr;
+        size_ = 0;
+    }
+
+    bool isOpen() const { return base_ != nullptr; }
+
+    const Header& header() const { return *(const Header*)base_; }
+    uint32_t slotCount() const { return header().slot_count; }
+    const SlotEntry& slot(uint32_t i) const { return entries()[i]; }
+    const char* string(uint32_t offset) const {
+        return (const char*)base_ + header().strings + offset;
+    }
+    const Control* controls(const SlotEntry& e) const { return (const Control*)(base_ + e.controls); }
+    const Property* properties(const SlotEntry& e) const {
+        return (const Property*)(base_ + e.properties);
+    }
+    const void* data(const Property& p) const { return base_ + p.data; }
+
+    // Control-only preset: set the controls of every slot whose current
+    // plugin is the one in the file. No allocation, no plugin is loaded or
+    // removed; returns the slots that matched.
+    uint32_t applyControls(PluginChain& chain) const {
+        uint32_t matched = 0;
+        for (uint32_t i = 0; i < slotCount(); ++i) {
+            const SlotEntry& e = slot(i);
+            chain.withSlot(e.slot, [&](LV2Plugin* p) {
+                if (hash(p->uri()) != e.uri_hash) return;
+                const Control* c = controls(e);
+                for (uint32_t k = 0; k < e.control_count; ++k) p->setControlValue(c[k].port, c[k].value);
+                ++matched;
+            });
+        }
+        return matched;
+    }
+
+    // The whole rig: every slot in the file, restored from the mapping,
+    // which must stay open until load() returns
+    std::vector<SessionLoader::Timing> load(PluginChain& chain, SessionLoader& loader) const {
+        std::vector<SessionLoader::Slot> slots;
+        for (uint32_t i = 0; i < slotCount(); ++i) {
+            const SlotEntry& e = slot(i);
+            SessionLoader::Slot s;
+            s.slot = e.slot;
+            s.uri = string(e.uri);
+            s.sandboxed = e.flags & Sandboxed;
+            s.has_mix = true;
+            s.mix = e.mix;
+            s.in_trim = e.in_trim;
+            s.out_trim = e.out_trim;
+            s.pan = e.pan;
+            const Control* c = controls(e);
+            for (uint32_t k = 0; k < e.control_count; ++k) s.controls.emplace_back(c[k].port, c[k].value);
+            if (e.property_count) {
+                s.restore = [this, &e](LV2Plugin& p) {
+                    std::vector<LV2Plugin::StateProperty> props;
+                    const Property* f = properties(e);
+                    for (uint32_t k = 0; k < e.property_count; ++k)
+                        props.push_back({string(f[k].key), string(f[k].type), f[k].flags,
+                                         data(f[k]), f[k].size});
+                    return p.restoreProperties(props.data(), (uint32_t)props.size());
+                };
+            }
+            slots.push_back(std::move(s));
+        }
+
+        return loader.load(chain, slots);
+    }
+
+    // Write the chain as it is now. Properties are saved while the plugins
+    // run, which state:interface allows.
+    static bool save(PluginChain& chain, const std::string& path) {
+        Writer w;
+        for (int slot = 1; slot <= PluginChain::kSlots; ++slot) {
+            chain.withSlot(slot, [&](LV2Plugin* p) { w.add(chain, slot, p); });
+        }
+        return w.write(path);
+    }
+
+    // Turtle bridge: dir/slot-N.ttl per slot plus dir/session.json for
+    // AudioEngine.loadSession()
+    static bool exportTurtle(PluginChain& chain, const std::string& dir) {
+        nlohmann::json session = {{"slots", nlohmann::json::array()}};
+        for (int slot = 1; slot <= PluginChain::kSlots; ++slot) {
+            chain.withSlot(slot, [&](LV2Plugin* p) {
+                const std::string ttl = dir + "/slot-" + std::to_string(slot) + ".ttl";
+                nlohmann::json entry = {{"slot", slot}, {"uri", p->uri()}, {"sandboxed", p->isSandboxed()}};
+                if (p->saveState(ttl)) {
+                    entry["state"] = ttl;
+                } else {
+                    // Sandboxed, or lilv could not save it: controls only
+                    uint32_t index[kMaxControls];
+                    float value[kMaxControls];
+                    const uint32_t n = p->readInputControls(index, value, kMaxControls);
+                    for (uint32_t k = 0; k < n; ++k)
+                        entry["controls"][std::to_string(index[k])] = value[k];
+                }
+                session["slots"].push_back(entry);
+            });
+        }
+        std::ofstream out(dir + "/session.json");
+        out << session.dump(2);
+        return out.good();
+    }
+
+private:
+    const SlotEntry* entries() const { return (const SlotEntry*)(base_ + header().index); }
+
+    bool within(uint64_t offset, uint64_t bytes) const { return offset + bytes <= size_; }
+
+    bool validate() const {
+        const Header& h = header();
+        if (memcmp(h.magic, "OPQR", 4) != 0 || h.version != kVersion) return false;
+        if (h.header_size != sizeof(Header) || h.file_size != size_) return false;
+        if (!within(h.index, (uint64_t)h.slot_count * sizeof(SlotEntry)) || h.index % 8) return false;
+        if (h.strings_size == 0 || !within(h.strings, h.strings_size)) return false;
+        if (base_[h.strings + h.strings_size - 1] != 0) return false;
+
+        auto str = [&](uint32_t offset) { return offset < h.strings_size; };
+        for (uint32_t i = 0; i < h.slot_count; ++i) {
+            const SlotEntry& e = entries()[i];
+            if (!PluginChain::isValidSlot(e.slot) || !str(e.uri)) return false;
+            if (e.controls % 4 || !within(e.controls, (uint64_t)e.control_count * sizeof(Control)))
+                return false;
+            if (e.properties % 4 ||
+                !within(e.properties, (uint64_t)e.property_count * sizeof(Property)))
+                return false;
+            const Property* p = properties(e);
+            for (uint32_t k = 0; k < e.property_count; ++k) {
+                if (!str(p[k].key) || !str(p[k].type) || p[k].data % 8 ||
+                    !within(p[k].data, p[k].size))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Lays the file out in memory, then writes it in one go
+    class Writer {
+    public:
+        Writer() : strings_(1, 0) {}    // offset 0 is "", so strings are never empty
+
+        void add(PluginChain& chain, int slot, LV2Plugin* p) {
+            Slot s;
+            s.entry = {};
+            s.entry.slot = (uint8_t)slot;
+            s.entry.flags = p->isSandboxed() ? Sandboxed : 0;
+            s.entry.uri = intern(p->uri());
+            s.entry.uri_hash = hash(p->uri());
+            const SlotMix& mix = chain.slotMix(slot);
+            s.entry.mix = mix.mix.load(std::memory_order_relaxed);
+            s.entry.in_trim = mix.in_trim.load(std::memory_order_relaxed);
+            s.entry.out_trim = mix.out_trim.load(std::memory_order_relaxed);
+            s.entry.pan = mix.pan.load(std::memory_order_relaxed);
+
+            uint32_t index[kMaxControls];
+            float value[kMaxControls];
+            const uint32_t n = p->readInputControls(index, value, kMaxControls);
+            for (uint32_t k = 0; k < n; ++k) s.controls.push_back({index[k], value[k]});
+
+            // Only what means the same in another process, or on another
+            // device; the rest (handles, native layouts) is left out
+            uint32_t skipped = 0;
+            p->saveProperties([&](const LV2Plugin::StateProperty& prop) {
+                constexpr uint32_t kPlain = LV2_STATE_IS_POD | LV2_STATE_IS_PORTABLE;
+                if ((prop.flags & kPlain) != kPlain) {
+                    ++skipped;
+                    return;
+                }
+                Blob b;
+                b.property = {intern(prop.key), intern(prop.type), prop.flags, prop.size, 0, 0};
+                b.bytes.assign((const uint8_t*)prop.value, (const uint8_t*)prop.value + prop.size);
+                s.blobs.push_back(std::move(b));
+            });
+            if (skipped)
+                LOGW("[RigFile] %s: %u state properties are not portable data, not saved",
+                     p->uri(), skipped);
+            slots_.push_back(std::move(s));
+        }
+
+        bool write(const std::string& path) {
+            std::vector<uint8_t> out(sizeof(Header));
+            const uint32_t index = append(out, nullptr, slots_.size() * sizeof(SlotEntry));
+            for (size_t i = 0; i < slots_.size(); ++i) {
+                Slot& s = slots_[i];
+                s.entry.controls = append(out, s.controls.data(), s.controls.size() * sizeof(Control));
+                s.entry.control_count = (uint32_t)s.controls.size();
+                for (auto& b : s.blobs) b.property.data = append(out, b.bytes.data(), b.bytes.size());
+                std::vector<Property> props;
+                for (const auto& b : s.blobs) props.push_back(b.property);
+                s.entry.properties = append(out, props.data(), props.size() * sizeof(Property));
+                s.entry.property_count = (uint32_t)props.size();
+                memcpy(out.data() + index + i * sizeof(SlotEntry), &s.entry, sizeof(SlotEntry));
+            }
+            const uint32_t strings = append(out, strings_.data(), strings_.size());
+
+            Header h = {};
+            memcpy(h.magic, "OPQR", 4);
+            h.version = kVersion;
+            h.header_size = sizeof(Header);
+            h.file_size = (uint32_t)out.size();
+            h.slot_count = (uint32_t)slots_.size();
+            h.index = index;
+            h.strings = strings;
+            h.strings_size = (uint32_t)strings_.size();
+            memcpy(out.data(), &h, sizeof(h));
+
+            // Replace the old file only once the new one is complete
+            const std::string tmp = path + ".tmp";
+            FILE* f = fopen(tmp.c_str(), "wb");
+            if (!f) {
+                LOGE("[RigFile] Cannot write %s: %s", tmp.c_str(), strerror(errno));
+                return false;
+            }
+            const bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+            if (fclose(f) != 0 || !ok || rename(tmp.c_str(), path.c_str()) != 0) {
+                LOGE("[RigFile] Cannot write %s", path.c_str());
+                unlink(tmp.c_str());
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        struct Blob {
+            Property property;
+            std::vector<uint8_t> bytes;
+        };
+
+        struct Slot {
+            SlotEntry entry;
+            std::vector<Control> controls;
+            std::vector<Blob> blobs;
+        };
+
+        // 8-byte aligned section, zero filled when data is null
+        static uint32_t append(std::vector<uint8_t>& out, const void* data, size_t size) {
+            out.resize((out.size() + 7) & ~(size_t)7, 0);
+            const uint32_t at = (uint32_t)out.size();
+            out.resize(out.size() + size, 0);
+            if (data && size) memcpy(out.data() + at, data, size);
+            return at;
+        }
+
+        uint32_t intern(const char* s) {
+            auto it = offsets_.find(s);
+            if (it != offsets_.end()) return it->second;
+            const uint32_t at = (uint32_t)strings_.size();
+            strings_.insert(strings_.end(), s, s + strlen(s) + 1);
+            offsets_.emplace(s, at);
+            return at;
+        }
+
+        std::vector<Slot> slots_;
+        std::vector<char> strings_;
+        std::unordered_map<std::string, uint32_t> offsets_;
+    };
+
+    const uint8_t* base_ = nullptr;
+    size_t size_ = 0;
+};
+
+#endif //OPIQO_RIGFILE_H
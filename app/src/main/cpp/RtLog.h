@@ -0,0 +1,385 @@
+/*
+ * RtLog.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Logging that is safe on the audio thread.
+ *
+ * RT_LOGx() does not format anything. It stores a fixed-size binary record,
+ * the format string pointer (a literal, so it outlives the record), the
+ * arguments widened to 64 bits and a copy of any string arguments, in the
+ * calling thread's ring. Rings are single producer, single consumer and come
+ * from a static pool: a thread claims one with a CAS on its first record and
+ * gives it back when it exits, so logging never allocates or locks.
+ *
+ * A background thread drains every ring, formats the records and forwards
+ * them to logcat (stderr on host builds) and, optionally, a file. Records
+ * that find their ring full, or no ring free, are counted in dropped().
+ * Until start() is called, records are formatted and written in place, so
+ * tools that never start the logger still see their output.
+ *
+ * Other queues of already formatted text (PluginLog.h) attach a Source and
+ * are drained by the same thread.
+ */
+
+#ifndef OPIQO_RTLOG_H
+#define OPIQO_RTLOG_H
+
+#include "ThreadManager.h"
+#include "logging_macros.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+namespace rtlog {
+
+enum Level : uint8_t { Debug = 0, Info, Warn, Error };
+
+constexpr int kMaxArgs = 6;
+constexpr int kTextSize = 64;       // string arguments, truncated to fit
+constexpr uint32_t kRingSize = 128; // records per thread, power of two
+constexpr int kMaxThreads = 8;
+constexpr int kMaxSources = 32;
+
+struct Record {
+    int64_t time_ns;
+    const char* fmt;
+    uint8_t level;
+    uint8_t nargs;
+    char type[kMaxArgs];            // 'i' 'u' 'd' 's' 'p'
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const void* p;
+        uint32_t text;              // offset into text
+    } arg[kMaxArgs];
+    char text[kTextSize];
+};
+
+// A queue drained by the logger's thread, which calls drain() with the
+// output serialised, so drain() may call Logger::write()
+struct Source {
+    virtual ~Source() = default;
+    virtual void drain() = 0;
+};
+
+struct Ring {
+    std::atomic<bool> claimed{false};
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+    Record records[kRingSize];
+};
+
+class Logger {
+public:
+    static Logger& get() {
+        static Logger logger;
+        return logger;
+    }
+
+    // Start the drain thread, also writing to `path` when given
+    void start(const std::string& path = std::string()) {
+        std::lock_guard<std::mutex> lock(control_);
+        if (running_.load()) return;
+        if (!path.empty()) file_ = fopen(path.c_str(), "a");
+        running_.store(true, std::memory_order_release);
+        thread_ = ThreadManager::get().spawn(ThreadManager::Role::Background, "rtlog",
+                                             &Logger::run, this);
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> lock(control_);
+        if (!running_.exchange(false)) return;
+        if (thread_.joinable()) thread_.join();
+        drain();
+        if (file_) fclose(file_);
+        file_ = nullptr;
+    }
+
+    // CLOCK_MONOTONIC, the clock records are stamped with
+    static int64_t now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    bool running() const { return running_.load(std::memory_order_acquire); }
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    // Not real-time: drain `source` from now on; detach() returns once the
+    // drain thread is done with it
+    void attach(Source* source) {
+        std::lock_guard<std::mutex> lock(write_);
+        for (auto*& s : sources_) {
+            if (!s) {
+                s = source;
+                return;
+            }
+        }
+        LOGW("[RtLog] No room for another log source");
+    }
+
+    void detach(Source* source) {
+        std::lock_guard<std::mutex> lock(write_);
+        for (auto*& s : sources_)
+            if (s == source) s = nullptr;
+    }
+
+    // Formatted text, from Source::drain() or any non-real-time thread
+    void write(Level level, const char* text) {
+        if (holder_.load(std::memory_order_relaxed) == std::this_thread::get_id()) {
+            output(level, now(), text);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(write_);
+        output(level, now(), text);
+    }
+
+    // Any thread, real-time safe once started
+    template <typename... Args>
+    void log(Level level, const char* fmt, const Args&... args) {
+        static_assert(sizeof...(Args) <= kMaxArgs, "too many arguments for a log record");
+        Record r;
+        r.time_ns = now();
+        r.fmt = fmt;
+        r.level = level;
+        r.nargs = 0;
+        [[maybe_unused]] uint32_t used = 0;
+        (pack(r, used, args), ...);
+
+        if (!running_.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(write_);
+            emit(r);
+            return;
+        }
+
+        Ring* ring = local();
+        if (!ring) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        const uint32_t head = ring->head.load(std::memory_order_relaxed);
+        if (head - ring->tail.load(std::memory_order_acquire) >= kRingSize) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        ring->records[head & (kRingSize - 1)] = r;
+        ring->head.store(head + 1, std::memory_order_release);
+    }
+
+    // Format a record the way the drain thread does, for tests and tools
+    static size_t format(const Record& r, char* out, size_t size) {
+        size_t n = 0;
+        int a = 0;
+        auto put = [&](int wrote) {
+            if (wrote > 0) n = std::min(size - 1, n + (size_t)wrote);
+        };
+
+        for (const char* f = r.fmt; *f && n + 1 < size;) {
+            if (*f != '%') {
+                out[n++] = *f++;
+                continue;
+            }
+            if (f[1] == '%') {
+                out[n++] = '%';
+                f += 2;
+                continue;
+            }
+
+            // Rebuild the conversion with our own length modifier; a '*'
+            // width or precision takes the next integer argument and is
+            // written into the spec as a number
+            char spec[32];
+            size_t s = 0;
+            bool stars_ok = true;
+            spec[s++] = *f++;
+            while (*f && strchr("-+ #0123456789.*", *f) && s < 20) {
+                if (*f != '*') {
+                    spec[s++] = *f++;
+                    continue;
+                }
+                ++f;
+                if (a < r.nargs && (r.type[a] == 'i' || r.type[a] == 'u')) {
+                    const long long w = std::clamp<long long>(r.arg[a++].i, -999, 999);
+                    s += snprintf(spec + s, sizeof(spec) - s, "%lld", w);
+                } else {
+                    stars_ok = false;
+                }
+            }
+            while (*f && strchr("hlLqjzt", *f)) ++f;
+            const char conv = *f ? *f++ : 'd';
+
+            if (!stars_ok || a >= r.nargs) {
+                put(snprintf(out + n, size - n, "?"));
+                continue;
+            }
+            const char type = r.type[a];
+            const auto& v = r.arg[a++];
+            if (strchr("diouxXc", conv) && (type == 'i' || type == 'u')) {
+                if (conv != 'c') {
+                    spec[s++] = 'l';
+                    spec[s++] = 'l';
+                }
+                spec[s++] = conv;
+                spec[s] = 0;
+                if (conv == 'c')
+                    put(snprintf(out + n, size - n, spec, (int)v.i));
+                else if (type == 'i')
+                    put(snprintf(out + n, size - n, spec, (long long)v.i));
+                else
+                    put(snprintf(out + n, size - n, spec, (unsigned long long)v.u));
+            } else if (strchr("fFeEgGaA", conv) && type == 'd') {
+                spec[s++] = conv;
+                spec[s] = 0;
+                put(snprintf(out + n, size - n, spec, v.d));
+            } else if (conv == 's' && type == 's') {
+                spec[s++] = 's';
+                spec[s] = 0;
+                put(snprintf(out + n, size - n, spec, r.text + v.text));
+            } else if (conv == 'p') {
+                put(snprintf(out + n, size - n, "%p", v.p));
+            } else {
+                put(snprintf(out + n, size - n, "?"));
+            }
+        }
+        out[n] = 0;
+        return n;
+    }
+
+private:
+    Logger() = default;
+
+    ~Logger() {
+        stop();
+    }
+
+    template <typename T>
+    static void pack(Record& r, uint32_t& used, const T& value) {
+        const int a = r.nargs++;
+        using V = std::decay_t<T>;
+        if constexpr (std::is_same_v<V, bool>) {
+            r.type[a] = 'i';
+            r.arg[a].i = value;
+        } else if constexpr (std::is_integral_v<V> || std::is_enum_v<V>) {
+            if constexpr (std::is_signed_v<V>) {
+                r.type[a] = 'i';
+                r.arg[a].i = (int64_t)value;
+            } else {
+                r.type[a] = 'u';
+                r.arg[a].u = (uint64_t)value;
+            }
+        } else if constexpr (std::is_floating_point_v<V>) {
+            r.type[a] = 'd';
+            r.arg[a].d = value;
+        } else if constexpr (std::is_same_v<V, const char*> || std::is_same_v<V, char*>) {
+            r.type[a] = 's';
+            r.arg[a].text = used;
+            const char* str = value;
+            if constexpr (!std::is_array_v<T>) {
+                if (!str) str = "(null)";
+            }
+            const size_t room = used < kTextSize ? kTextSize - used - 1 : 0;
+            const size_t len = std::min(strlen(str), room);
+            memcpy(r.text + used, str, len);
+            r.text[used + len] = 0;
+            used = std::min<uint32_t>(kTextSize - 1, used + (uint32_t)len + 1);
+        } else {
+            static_assert(std::is_pointer_v<V>, "unsupported log argument");
+            r.type[a] = 'p';
+            r.arg[a].p = (const void*)value;
+        }
+    }
+
+    // The calling thread's ring, claimed on first use
+    Ring* local() {
+        struct Claim {
+            Ring* ring = nullptr;
+            ~Claim() {
+                if (ring) ring->claimed.store(false, std::memory_order_release);
+            }
+        };
+        thread_local Claim claim;
+        if (claim.ring) return claim.ring;
+        for (auto& ring : rings_) {
+            bool expected = false;
+            if (ring.claimed.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+                claim.ring = &ring;
+                return claim.ring;
+            }
+        }
+        return nullptr;
+    }
+
+    void run() {
+        while (running_.load(std::memory_order_acquire)) {
+            drain();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+
+    void drain() {
+        std::lock_guard<std::mutex> lock(write_);
+        for (auto& ring : rings_) {
+            uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+            const uint32_t head = ring.head.load(std::memory_order_acquire);
+            for (; tail != head; ++tail) emit(ring.records[tail & (kRingSize - 1)]);
+            ring.tail.store(tail, std::memory_order_release);
+        }
+        holder_.store(std::this_thread::get_id(), std::memory_order_relaxed);
+        for (auto* source : sources_)
+            if (source) source->drain();
+        holder_.store(std::thread::id(), std::memory_order_relaxed);
+        if (file_) fflush(file_);
+    }
+
+    // Under write_
+    void emit(const Record& r) {
+        char line[512];
+        format(r, line, sizeof(line));
+        output((Level)r.level, r.time_ns, line);
+    }
+
+    void output(Level level, int64_t time_ns, const char* line) {
+        switch (level) {
+            case Debug: LOGD("%s", line); break;
+            case Info: LOGI("%s", line); break;
+            case Warn: LOGW("%s", line); break;
+            default: LOGE("%s", line); break;
+        }
+        if (file_) {
+            static const char kLevels[] = "DIWE";
+            fprintf(file_, "%lld.%06lld %c %s\n", (long long)(time_ns / 1000000000),
+                    (long long)(time_ns % 1000000000 / 1000), kLevels[level & 3], line);
+        }
+    }
+
+    Ring rings_[kMaxThreads];
+    Source* sources_[kMaxSources] = {};
+    std::atomic<std::thread::id> holder_{};     // the thread draining the sources
+    std::atomic<bool> running_{false};
+    std::atomic<uint64_t> dropped_{0};
+    std::thread thread_;
+    std::mutex control_;
+    std::mutex write_;
+    FILE* file_ = nullptr;
+};
+
+} // namespace rtlog
+
+#define RT_LOGD(fmt, ...) rtlog::Logger::get().log(rtlog::Debug, "" fmt, ##__VA_ARGS__)
+#define RT_LOGI(fmt, ...) rtlog::Logger::get().log(rtlog::Info, "" fmt, ##__VA_ARGS__)
+#define RT_LOGW(fmt, ...) rtlog::Logger::get().log(rtlog::Warn, "" fmt, ##__VA_ARGS__)
+#define RT_LOGE(fmt, ...) rtlog::Logger::get().log(rtlog::Error, "" fmt, ##__VA_ARGS__)
+
+#endif //OPIQO_RTLOG_H
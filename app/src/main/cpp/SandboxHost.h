@@ -0,0 +1,247 @@
+/*
+ * SandboxHost.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * App side of an out-of-process plugin slot.
+ *
+ * Creates the shared block (SandboxShm.h), spawns the sandbox executable
+ * (sandbox_main.cpp, packaged as libopiqo_sandbox.so so Android extracts it
+ * into nativeLibraryDir) with the memfd on fd 3, and keeps it alive: a
+ * watchdog thread restarts the sandbox with backoff when it exits or stops
+ * answering. Control values live in the shared block, so a restarted
+ * sandbox comes back with the settings the slot had.
+ *
+ * The audio thread never waits for more than the budget it passes to
+ * wait(). A block the sandbox misses is reported to the caller, and no new
+ * block is submitted until the late reply arrives.
+ */
+
+#ifndef OPIQO_SANDBOXHOST_H
+#define OPIQO_SANDBOXHOST_H
+
+#include "logging_macros.h"
+#include "SandboxShm.h"
+#include "ThreadManager.h"
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+
+extern char** environ;
+
+class SandboxHost {
+public:
+    struct Config {
+        std::string executable;     // path to libopiqo_sandbox.so
+        std::string lv2_path;
+        std::string uri;
+        double sample_rate = 48000;
+        uint32_t max_frames = SandboxShm::kMaxFrames;
+    };
+
+    explicit SandboxHost(Config config) : config_(std::move(config)) {}
+
+    ~SandboxHost() {
+        stop();
+    }
+
+    // Create and map the shared block, the caller may then seed controls
+    bool create() {
+        fd_ = memfd_create("opiqo-sandbox", MFD_CLOEXEC);
+        if (fd_ < 0 || ftruncate(fd_, sizeof(SandboxShm)) != 0) {
+            LOGE("[SandboxHost] memfd failed: %s", strerror(errno));
+            return false;
+        }
+
+        void* mem = mmap(nullptr, sizeof(SandboxShm), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (mem == MAP_FAILED) {
+            LOGE("[SandboxHost] mmap failed: %s", strerror(errno));
+            return false;
+        }
+        shm_ = new (mem) SandboxShm();
+        shm_->magic = SandboxShm::kMagic;
+        shm_->version = SandboxShm::kVersion;
+        for (auto& c : shm_->controls) c = 0.0f;
+        return true;
+    }
+
+    // Spawn the sandbox and wait for it to instantiate the plugin
+    bool launch() {
+        if (!shm_) return false;
+        running_.store(true);
+        if (!spawn()) return false;
+        watchdog_ = ThreadManager::get().spawn(ThreadManager::Role::Background, "sandbox-watch",
+                                               &SandboxHost::watchdog, this);
+
+        // Instantiation runs in the sandbox, give it a moment
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!shm_->ready.load(std::memory_order_acquire)) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                LOGE("[SandboxHost] %s did not start", config_.uri.c_str());
+                return false;
+            }
+            sandbox_futex_wait(&shm_->ready, 0, 50000000);
+        }
+        return true;
+    }
+
+    void stop() {
+        running_.store(false);
+        if (watchdog_.joinable()) watchdog_.join();
+        terminate();
+        if (shm_) {
+            munmap(shm_, sizeof(SandboxShm));
+            shm_ = nullptr;
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    SandboxShm* shm() { return shm_; }
+
+    // ---------------------------------------------------------------------
+    // Audio thread
+    // ---------------------------------------------------------------------
+
+    // True when the sandbox is up and has answered every block, i.e. the
+    // caller owns the turn and may fill the shared block
+    bool begin() {
+        if (!shm_ || !shm_->ready.load(std::memory_order_acquire)) return false;
+        if (shm_->reply.load(std::memory_order_acquire) ==
+            shm_->request.load(std::memory_order_relaxed)) return true;
+
+        // Still working on a block we gave up on
+        late_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    void submit() {
+        sent_ = shm_->request.load(std::memory_order_relaxed) + 1;
+        shm_->request.store(sent_, std::memory_order_release);
+        sandbox_futex_wake(&shm_->request);
+    }
+
+    // Wait for the reply to the last submit() for at most budget_ns
+    bool wait(int64_t budget_ns) {
+        for (int i = 0; i < kSpin; ++i) {
+            if (shm_->reply.load(std::memory_order_acquire) == sent_) return answered();
+        }
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(budget_ns);
+        for (;;) {
+            const uint32_t seen = shm_->reply.load(std::memory_order_acquire);
+            if (seen == sent_) return answered();
+
+            const int64_t left = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    deadline - std::chrono::steady_clock::now()).count();
+            if (left <= 0) break;
+            sandbox_futex_wait(&shm_->reply, seen, left);
+        }
+
+        missed_.fetch_add(1, std::memory_order_relaxed);
+        late_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    uint64_t missed() const { return missed_.load(std::memory_order_relaxed); }
+    uint32_t restarts() const { return restarts_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr int kSpin = 2000;
+    // Consecutive missed blocks after which a live sandbox counts as hung
+    static constexpr uint32_t kHungBlocks = 200;
+
+    bool answered() {
+        late_.store(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool spawn() {
+        const std::string rate = std::to_string(config_.sample_rate);
+        const std::string frames = std::to_string(config_.max_frames);
+        char* argv[] = {
+                const_cast<char*>(config_.executable.c_str()), const_cast<char*>("3"),
+                const_cast<char*>(config_.lv2_path.c_str()), const_cast<char*>(config_.uri.c_str()),
+                const_cast<char*>(rate.c_str()), const_cast<char*>(frames.c_str()), nullptr
+        };
+
+        // dup2 onto 3 clears close-on-exec for the sandbox's copy only
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, fd_, 3);
+
+        const int err = posix_spawn(&pid_, argv[0], &actions, nullptr, argv, environ);
+        posix_spawn_file_actions_destroy(&actions);
+        if (err != 0) {
+            LOGE("[SandboxHost] spawn %s failed: %s", argv[0], strerror(err));
+            pid_ = -1;
+            return false;
+        }
+        LOGD("[SandboxHost] %s running in pid %d", config_.uri.c_str(), pid_);
+        return true;
+    }
+
+    void terminate() {
+        if (pid_ <= 0) return;
+        kill(pid_, SIGKILL);
+        waitpid(pid_, nullptr, 0);
+        pid_ = -1;
+        if (shm_) shm_->ready.store(0, std::memory_order_release);
+    }
+
+    // Restart the sandbox when it exits or hangs, backing off if it keeps dying
+    void watchdog() {
+        auto backoff = std::chrono::milliseconds(100);
+        while (running_.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+            int status = 0;
+            const bool exited = pid_ > 0 && waitpid(pid_, &status, WNOHANG) == pid_;
+            const bool hung = late_.load(std::memory_order_relaxed) > kHungBlocks;
+            if (!exited && !hung && pid_ > 0) {
+                backoff = std::chrono::milliseconds(100);
+                continue;
+            }
+
+            if (exited) {
+                LOGE("[SandboxHost] %s died (status 0x%x), restarting", config_.uri.c_str(), status);
+                pid_ = -1;
+                shm_->ready.store(0, std::memory_order_release);
+            } else if (hung) {
+                LOGE("[SandboxHost] %s stopped answering, restarting", config_.uri.c_str());
+                terminate();
+            }
+
+            std::this_thread::sleep_for(backoff);
+            backoff = std::min(backoff * 2, std::chrono::milliseconds(5000));
+            late_.store(0, std::memory_order_relaxed);
+            if (running_.load() && spawn()) restarts_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    Config config_;
+    int fd_ = -1;
+    SandboxShm* shm_ = nullptr;
+    pid_t pid_ = -1;
+    uint32_t sent_ = 0;
+
+    std::atomic<bool> running_{false};
+    std::atomic<uint64_t> missed_{0};
+    std::atomic<uint32_t> late_{0};
+    std::atomic<uint32_t> restarts_{0};
+    std::thread watchdog_;
+};
+
+#endif //OPIQO_SANDBOXHOST_H
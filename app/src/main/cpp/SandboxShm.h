@@ -0,0 +1,92 @@
+/*
+ * SandboxShm.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Memory shared between the app and an out-of-process plugin host.
+ *
+ * One block per sandboxed slot, created with memfd_create and mapped by
+ * both processes. The two sides take turns: the app fills the inputs and
+ * bumps `request`, the sandbox runs the plugin, fills the outputs and sets
+ * `reply` to the request it answered. Those two words are the only shared
+ * state touched concurrently; everything else belongs to whichever side
+ * holds the turn, handed over with release/acquire on the counters. Both
+ * counters double as futex words, so the only syscall per block is the wake
+ * (plus a wait when the other side is not already spinning on it).
+ */
+
+#ifndef OPIQO_SANDBOXSHM_H
+#define OPIQO_SANDBOXSHM_H
+
+#include "MidiInput.h"
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <ctime>
+
+struct SandboxShm {
+    static constexpr uint32_t kMagic = 0x4f505342;   // "OPSB"
+    static constexpr uint32_t kVersion = 2;
+    static constexpr uint32_t kMaxFrames = 4096;
+    static constexpr uint32_t kMaxPorts = 128;
+    static constexpr uint32_t kAtomBytes = 16384;
+    static constexpr uint32_t kMaxMidi = MidiInput::kMaxPerBlock;
+
+    // Atom records in atom_in/atom_out: header then `atom.size` body bytes,
+    // each record padded to 8 bytes
+    struct AtomRecord {
+        uint32_t port;
+        uint32_t pad;
+        uint32_t size;    // LV2_Atom
+        uint32_t type;
+    };
+
+    uint32_t magic;
+    uint32_t version;
+
+    alignas(64) std::atomic<uint32_t> request;     // app: block n is ready
+    alignas(64) std::atomic<uint32_t> reply;       // sandbox: block n is done
+    alignas(64) std::atomic<uint32_t> ready;       // sandbox: plugin instantiated
+    std::atomic<uint32_t> blocks;                  // sandbox: blocks processed
+
+    // Turn-owned data
+    alignas(64) uint32_t frames;
+    float controls[kMaxPorts];        // in: app writes, out: sandbox writes
+    uint32_t atom_in_bytes;
+    uint32_t atom_out_bytes;
+    alignas(8) uint8_t atom_in[kAtomBytes];
+    alignas(8) uint8_t atom_out[kAtomBytes];
+    uint32_t midi_count;
+    MidiEvent midi[kMaxMidi];         // in: frame-stamped, for MIDI atom inputs
+    alignas(64) float audio_in[kMaxFrames];
+    alignas(64) float audio_out[kMaxFrames];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "futex words must be plain words");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex words must be plain words");
+
+// ============================================================================
+// futex helpers, shared (not private) because the word is in a memfd
+// ============================================================================
+
+static inline void sandbox_futex_wake(std::atomic<uint32_t>* word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+// Sleep while *word == expected, at most timeout_ns. False on timeout.
+static inline bool sandbox_futex_wait(std::atomic<uint32_t>* word, uint32_t expected,
+                                      int64_t timeout_ns) {
+    struct timespec ts;
+    ts.tv_sec = timeout_ns / 1000000000;
+    ts.tv_nsec = timeout_ns % 1000000000;
+    const long rc = syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT,
+                            expected, timeout_ns >= 0 ? &ts : nullptr, nullptr, 0);
+    return rc == 0 || errno != ETIMEDOUT;
+}
+
+#endif //OPIQO_SANDBOXSHM_H
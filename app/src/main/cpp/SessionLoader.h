@@ -0,0 +1,187 @@
+/*
+ * SessionLoader.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Loads a whole session, every slot at once.
+ *
+ * Each slot is built on its own loader thread (Foreground, see
+ * ThreadManager.h): construct, initialize, restore its state (a state file
+ * or the slot's own restore hook), set its controls and run kWarmupBlocks
+ * silent blocks, so the first real callback does not pay for page faults,
+ * lazy tables and denormal tails. Lilv is only touched under
+ * LV2Plugin::worldLock(); the plugin's own instantiate() and state restore,
+ * the slow part, run in parallel.
+ *
+ * Nothing reaches the audio thread until every slot is ready. The finished
+ * rig is then published with one PluginChain::replaceAll(), so playback
+ * switches from the old chain to the complete new one between two callbacks.
+ * Slot mix settings given with the slots are published in the same snapshot,
+ * so they change with the plugins and not a block earlier or later.
+ * A slot that fails to load is left empty and reported, the rest still load.
+ *
+ * Every slot reports how long each step took and when, counted from the
+ * start of the load, it was ready to play.
+ */
+
+#ifndef OPIQO_SESSIONLOADER_H
+#define OPIQO_SESSIONLOADER_H
+
+#include "LV2Plugin.hpp"
+#include "PluginChain.h"
+#include "ThreadManager.h"
+#include "json.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class SessionLoader {
+public:
+    static constexpr int kWarmupBlocks = 4;
+
+    struct Slot {
+        int slot = 1;               // 1-based
+        std::string uri;
+        std::string state;          // state file, empty for none
+        bool sandboxed = false;
+        std::vector<std::pair<uint32_t, float>> controls;  // port index, value
+        std::function<bool(LV2Plugin&)> restore;            // more state, e.g. RigFile.h
+        bool has_mix = false;       // else the slot keeps its current mix
+        float mix = 1.0f, in_trim = 1.0f, out_trim = 1.0f, pan = 0.0f;
+    };
+
+    struct Timing {
+        int slot = 0;
+        std::string uri;
+        bool ok = false;
+        double instantiate_ms = 0;  // construct + initialize + start
+        double restore_ms = 0;      // state file and controls
+        double warmup_ms = 0;
+        double ready_ms = 0;        // since the load started
+    };
+
+    // Builds the (not yet initialized) plugin for a slot, e.g. to attach a
+    // sandbox; called on the loader threads
+    using Factory = std::function<LV2Plugin*(const Slot&)>;
+
+    SessionLoader(Factory factory, int frames) : factory_(std::move(factory)), frames_(frames) {}
+
+    // Load `slots` and publish them into `chain`, replacing the whole rig.
+    // Returns one timing per requested slot, in order.
+    std::vector<Timing> load(PluginChain& chain, const std::vector<Slot>& slots) {
+        start_ = Clock::now();
+        std::vector<Timing> timings(slots.size());
+        std::vector<LV2Plugin*> plugins(slots.size(), nullptr);
+
+        const size_t workers = std::min(slots.size(),
+                                        std::max<size_t>(1, ThreadManager::get().bigCores().size()));
+        std::atomic<size_t> next{0};
+        auto work = [&] {
+            for (size_t i; (i = next.fetch_add(1)) < slots.size();)
+                plugins[i] = build(slots[i], timings[i]);
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t w = 0; w < workers; ++w)
+            threads.push_back(ThreadManager::get().spawn(ThreadManager::Role::Foreground,
+                                                         "session-load", work));
+        for (auto& t : threads) t.join();
+
+        PluginChain::Slots rig;
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (!plugins[i]) continue;
+            LV2Plugin*& at = rig.plugin[slots[i].slot - 1];
+            if (at) {
+                LOGE("[SessionLoader] Slot %d listed twice, keeping the first", slots[i].slot);
+                plugins[i]->closePlugin();
+                delete plugins[i];
+                timings[i].ok = false;
+                continue;
+            }
+            at = plugins[i];
+            if (slots[i].has_mix) {
+                rig.has_mix[slots[i].slot - 1] = true;
+                rig.mix[slots[i].slot - 1] = {slots[i].mix, slots[i].in_trim, slots[i].out_trim,
+                                              slots[i].pan};
+            }
+        }
+        chain.replaceAll(rig);
+        published_ms_ = since(start_);
+        LOGD("[SessionLoader] %zu slots on %zu threads, playing after %.1f ms", slots.size(),
+             workers, published_ms_);
+        return timings;
+    }
+
+    // When the complete rig reached the audio thread, since the load started
+    double publishedMs() const { return published_ms_; }
+
+    static nlohmann::json toJson(const std::vector<Timing>& timings, double published_ms) {
+        nlohmann::json report = {{"published_ms", published_ms}, {"slots", nlohmann::json::array()}};
+        for (const auto& t : timings) {
+            report["slots"].push_back({
+                    {"slot", t.slot}, {"uri", t.uri}, {"ok", t.ok},
+                    {"instantiate_ms", t.instantiate_ms}, {"restore_ms", t.restore_ms},
+                    {"warmup_ms", t.warmup_ms}, {"ready_ms", t.ready_ms}
+            });
+        }
+        return report;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static double since(Clock::time_point t) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - t).count();
+    }
+
+    // Loader thread: a ready, warmed-up plugin, or null
+    LV2Plugin* build(const Slot& s, Timing& timing) {
+        timing.slot = s.slot;
+        timing.uri = s.uri;
+        if (!PluginChain::isValidSlot(s.slot)) {
+            LOGE("[SessionLoader] Unknown slot %d", s.slot);
+            return nullptr;
+        }
+
+        Clock::time_point t = Clock::now();
+        LV2Plugin* plugin = factory_(s);
+        if (!plugin || !plugin->initialize()) {
+            LOGE("[SessionLoader] Failed to initialize %s for slot %d", s.uri.c_str(), s.slot);
+            delete plugin;
+            return nullptr;
+        }
+        plugin->start();
+        timing.instantiate_ms = since(t);
+
+        t = Clock::now();
+        if (!s.state.empty() && !plugin->loadState(s.state))
+            LOGE("[SessionLoader] Cannot restore %s into slot %d", s.state.c_str(), s.slot);
+        if (s.restore && !s.restore(*plugin))
+            LOGE("[SessionLoader] Cannot restore the state of slot %d", s.slot);
+        for (const auto& [port, value] : s.controls) plugin->setControlValue(port, value);
+        timing.restore_ms = since(t);
+
+        // Not on the audio thread yet, so process() is ours to call
+        t = Clock::now();
+        std::vector<float> in(frames_, 0.0f), out(frames_, 0.0f);
+        for (int b = 0; b < kWarmupBlocks; ++b) plugin->process(in.data(), out.data(), frames_);
+        timing.warmup_ms = since(t);
+
+        timing.ready_ms = since(start_);
+        timing.ok = true;
+        return plugin;
+    }
+
+    Factory factory_;
+    int frames_;
+    Clock::time_point start_;
+    double published_ms_ = 0;
+};
+
+#endif //OPIQO_SESSIONLOADER_H
@@ -0,0 +1,70 @@
+/*
+ * Simd.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Four-lane float helpers on GCC/Clang vector extensions, which lower to
+ * NEON on ARM and SSE on x86. Only what the built-in DSP stages need.
+ */
+
+#ifndef OPIQO_SIMD_H
+#define OPIQO_SIMD_H
+
+#include <cstdint>
+#include <cstring>
+
+namespace simd {
+
+typedef float v4sf __attribute__((vector_size(16)));
+typedef int32_t v4si __attribute__((vector_size(16)));
+
+static inline v4sf load(const float* p) {
+    v4sf v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void store(float* p, v4sf v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline v4sf splat(float f) {
+    return v4sf{f, f, f, f};
+}
+
+static inline v4sf abs(v4sf v) {
+    return (v4sf)((v4si)v & 0x7fffffff);
+}
+
+static inline v4sf max(v4sf a, v4sf b) {
+    const v4si gt = a > b;
+    return (v4sf)(((v4si)a & gt) | ((v4si)b & ~gt));
+}
+
+static inline v4sf min(v4sf a, v4sf b) {
+    const v4si lt = a < b;
+    return (v4sf)(((v4si)a & lt) | ((v4si)b & ~lt));
+}
+
+static inline float hmax(v4sf v) {
+    const float a = v[0] > v[1] ? v[0] : v[1];
+    const float b = v[2] > v[3] ? v[2] : v[3];
+    return a > b ? a : b;
+}
+
+// Largest |p[i]| over n samples
+static inline float peak(const float* p, int n) {
+    v4sf m = splat(0.0f);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) m = max(m, abs(load(p + i)));
+    float r = hmax(m);
+    for (; i < n; ++i) {
+        const float a = p[i] < 0 ? -p[i] : p[i];
+        if (a > r) r = a;
+    }
+    return r;
+}
+
+} // namespace simd
+
+#endif //OPIQO_SIMD_H
@@ -0,0 +1,145 @@
+/*
+ * SlotCloner.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Duplicates a slot into another one, for dual mono, A/B comparison or
+ * parallel branches, without a round trip through a state file.
+ *
+ * clone() captures the source plugin on the calling thread with
+ * LV2Plugin::prepareClone(): port tables, URID map and current state are
+ * copied in memory, nothing is asked of Lilv and the source keeps playing.
+ * The copy is instantiated, restored and warmed up on the cloner's own
+ * thread and only then put into the target slot, along with the source
+ * slot's mix in the same snapshot (see PluginChain::replace()). Clones are
+ * built one after the other, in the order asked for.
+ */
+
+#ifndef OPIQO_SLOTCLONER_H
+#define OPIQO_SLOTCLONER_H
+
+#include "LV2Plugin.hpp"
+#include "PluginChain.h"
+#include "ThreadManager.h"
+#include "logging_macros.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class SlotCloner {
+public:
+    static constexpr int kWarmupBlocks = 4;
+    static constexpr int kWarmupFrames = 256;
+
+    explicit SlotCloner(PluginChain& chain) : chain_(chain) {}
+
+    ~SlotCloner() {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            running_ = false;
+        }
+        wake_.notify_all();
+        if (thread_.joinable()) thread_.join();
+        for (auto& job : queue_) delete job.plugin;
+    }
+
+    SlotCloner(const SlotCloner&) = delete;
+    SlotCloner& operator=(const SlotCloner&) = delete;
+
+    // Copy slot `from` into slot `to`, replacing whatever is there once the
+    // copy is ready. False if `from` is empty or runs in a sandbox.
+    bool clone(int from, int to) {
+        if (!PluginChain::isValidSlot(to)) return false;
+        Job job;
+        job.to = to;
+        job.start = Clock::now();
+        chain_.withSlot(from, [&](LV2Plugin* p) { job.plugin = p->prepareClone(); });
+        if (!job.plugin) {
+            LOGE("[SlotCloner] Slot %d cannot be cloned", from);
+            return false;
+        }
+        const SlotMix& mix = chain_.slotMix(from);
+        job.mix.mix = mix.mix.load(std::memory_order_relaxed);
+        job.mix.in_trim = mix.in_trim.load(std::memory_order_relaxed);
+        job.mix.out_trim = mix.out_trim.load(std::memory_order_relaxed);
+        job.mix.pan = mix.pan.load(std::memory_order_relaxed);
+
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            queue_.push_back(job);
+            pending_.fetch_add(1, std::memory_order_relaxed);
+            if (!thread_.joinable())
+                thread_ = ThreadManager::get().spawn(ThreadManager::Role::Foreground, "slot-clone",
+                                                     &SlotCloner::run, this);
+        }
+        wake_.notify_one();
+        return true;
+    }
+
+    // Clones asked for and not yet in their slot
+    int pending() const { return pending_.load(std::memory_order_relaxed); }
+
+    // From clone() to the copy playing in its slot, for the last clone
+    double lastCloneMs() const { return last_ms_.load(std::memory_order_relaxed); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Job {
+        int to = 0;
+        LV2Plugin* plugin = nullptr;
+        PluginChain::MixSettings mix;
+        Clock::time_point start;
+    };
+
+    void run() {
+        std::unique_lock<std::mutex> lock(lock_);
+        while (running_) {
+            wake_.wait(lock, [this] { return !running_ || !queue_.empty(); });
+            if (!running_) break;
+            Job job = queue_.front();
+            queue_.pop_front();
+            lock.unlock();
+
+            build(job);
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+
+            lock.lock();
+        }
+    }
+
+    void build(Job& job) {
+        LV2Plugin* plugin = job.plugin;
+        if (!plugin->finishClone()) {
+            LOGE("[SlotCloner] Failed to instantiate the copy for slot %d", job.to);
+            delete plugin;
+            return;
+        }
+        plugin->start();
+        std::vector<float> in(kWarmupFrames, 0.0f), out(kWarmupFrames, 0.0f);
+        for (int b = 0; b < kWarmupBlocks; ++b) plugin->process(in.data(), out.data(), kWarmupFrames);
+
+        LOGD("[SlotCloner] %s ready for slot %d", plugin->uri(), job.to);
+        chain_.replace(job.to, plugin, &job.mix);
+
+        const double ms = std::chrono::duration<double, std::milli>(Clock::now() - job.start).count();
+        last_ms_.store(ms, std::memory_order_relaxed);
+        LOGD("[SlotCloner] Slot %d playing %.1f ms after the clone was asked for", job.to, ms);
+    }
+
+    PluginChain& chain_;
+    std::mutex lock_;
+    std::condition_variable wake_;
+    std::thread thread_;
+    bool running_ = true;
+    std::deque<Job> queue_;
+    std::atomic<int> pending_{0};
+    std::atomic<double> last_ms_{0.0};
+};
+
+#endif //OPIQO_SLOTCLONER_H
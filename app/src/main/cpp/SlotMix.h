@@ -0,0 +1,114 @@
+/*
+ * SlotMix.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Dry/wet, input trim, output trim and pan around each chain slot.
+ *
+ * All four reduce to two gains per channel at each slot boundary:
+ *
+ *     out = a * dry + b * wet
+ *     a   = (1 - mix) * out_trim * pan_gain * next_in_trim
+ *     b   =      mix  * out_trim * pan_gain * next_in_trim
+ *
+ * so one pass over the block applies this slot's mix, trim and pan and the
+ * next slot's input trim together. Gains ramp linearly across a block when a
+ * target changed, and a boundary whose gains are a = 0, b = 1 and not
+ * ramping is skipped entirely.
+ *
+ * The kernel is four-lane (Simd.h) over interleaved mono or stereo.
+ */
+
+#ifndef OPIQO_SLOTMIX_H
+#define OPIQO_SLOTMIX_H
+
+#include "Simd.h"
+
+#include <algorithm>
+#include <atomic>
+
+struct SlotMix {
+    // Targets, written from any thread
+    std::atomic<float> mix{1.0f};        // 0 = dry only, 1 = wet only
+    std::atomic<float> in_trim{1.0f};    // linear gain
+    std::atomic<float> out_trim{1.0f};   // linear gain
+    std::atomic<float> pan{0.0f};        // -1 left .. +1 right, balance law
+
+    // Values reached at the end of the last block, audio thread only
+    float cur_mix = 1.0f;
+    float cur_in_trim = 1.0f;
+    float cur_out_trim = 1.0f;
+    float cur_pan = 0.0f;
+};
+
+// Per-channel dry (a) and wet (b) gains, left/right (equal for mono)
+struct MixGains {
+    float a[2];
+    float b[2];
+
+    bool operator==(const MixGains& o) const {
+        return a[0] == o.a[0] && a[1] == o.a[1] && b[0] == o.b[0] && b[1] == o.b[1];
+    }
+
+    bool isIdentity() const {
+        return a[0] == 0.0f && a[1] == 0.0f && b[0] == 1.0f && b[1] == 1.0f;
+    }
+
+    static MixGains from(float mix, float out_trim, float pan, float next_in_trim) {
+        const float l = std::min(1.0f, 1.0f - pan) * out_trim * next_in_trim;
+        const float r = std::min(1.0f, 1.0f + pan) * out_trim * next_in_trim;
+        return {{(1.0f - mix) * l, (1.0f - mix) * r}, {mix * l, mix * r}};
+    }
+
+    static MixGains gain(float g) {
+        return {{g, g}, {0.0f, 0.0f}};
+    }
+};
+
+namespace slotmix {
+
+using simd::v4sf;
+using simd::load;
+using simd::store;
+
+// dst[i] = a(i) * dry[i] + b(i) * wet[i] over numSamples interleaved
+// samples, gains ramping from `from` to `to`. dst may alias dry or wet.
+static inline void apply(const float* dry, const float* wet, float* dst, int numSamples,
+                         int channels, const MixGains& from, const MixGains& to) {
+    if (channels < 1 || channels > 2) channels = 1;
+    const int frames = numSamples / channels;
+    if (frames <= 0) return;
+
+    const float inv = 1.0f / (float)frames;
+    float da[2], db[2];
+    for (int c = 0; c < 2; ++c) {
+        da[c] = (to.a[c] - from.a[c]) * inv;
+        db[c] = (to.b[c] - from.b[c]) * inv;
+    }
+
+    // Lane k holds sample k of a 4-sample group: frame k / channels,
+    // channel k % channels
+    v4sf a, b, step_a, step_b;
+    for (int k = 0; k < 4; ++k) {
+        const int c = channels == 2 ? (k & 1) : 0;
+        const float f = (float)(k / channels);
+        a[k] = from.a[c] + da[c] * f;
+        b[k] = from.b[c] + db[c] * f;
+        step_a[k] = da[c] * (float)(4 / channels);
+        step_b[k] = db[c] * (float)(4 / channels);
+    }
+
+    int i = 0;
+    for (; i + 4 <= numSamples; i += 4) {
+        store(dst + i, a * load(dry + i) + b * load(wet + i));
+        a += step_a;
+        b += step_b;
+    }
+    for (int k = 0; i < numSamples; ++i, ++k) {
+        dst[i] = a[k] * dry[i] + b[k] * wet[i];
+    }
+}
+
+} // namespace slotmix
+
+#endif //OPIQO_SLOTMIX_H
@@ -0,0 +1,251 @@
+/*
+ * ThreadManager.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Where the helper threads run.
+ *
+ * The CPU topology is read from sysfs: every cpuN that is online, its
+ * cpu_capacity (cpufreq's cpuinfo_max_freq when the kernel has no capacity)
+ * and its cluster (topology/cluster_id, else physical_package_id; reported,
+ * not used for placement). Cores of the lowest capacity are the little ones,
+ * everything above them is big. Where there are three capacities or more,
+ * the big cores of the highest one are the prime cores, which the audio
+ * callback is scheduled onto. With one capacity everywhere nothing is
+ * pinned.
+ *
+ * spawn() starts a thread that places itself before running its body:
+ *   - Realtime (LV2 workers, pipeline stages, MIDI replay): big cores except
+ *     the prime ones, so they do not preempt the callback there, and
+ *     SCHED_FIFO at kFifoPriority, below the audio callback; where that is
+ *     not permitted, nice kRealtimeNice instead;
+ *   - Foreground (session loading, anything the user is waiting on): big
+ *     cores, default policy and priority;
+ *   - Background (logging, watchdogs, scanning, encoding): little cores and
+ *     nice kBackgroundNice.
+ * Every placement is recorded and report() lists what was achieved, which is
+ * not always what was asked for.
+ *
+ * The sysfs root is a constructor argument so a fake tree can stand in for
+ * /sys/devices/system/cpu on a Linux host.
+ */
+
+#ifndef OPIQO_THREADMANAGER_H
+#define OPIQO_THREADMANAGER_H
+
+#include "logging_macros.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+class ThreadManager {
+public:
+    enum class Role { Realtime, Foreground, Background };
+
+    static constexpr int kFifoPriority = 1;
+    static constexpr int kRealtimeNice = -16;
+    static constexpr int kBackgroundNice = 10;
+
+    struct Cpu {
+        int id = 0;
+        int capacity = 0;
+        int cluster = -1;
+    };
+
+    struct Placement {
+        std::string name;
+        Role role = Role::Background;
+        std::vector<int> cpus;      // empty: not pinned
+        bool pinned = false;
+        bool fifo = false;
+        int nice = 0;
+        bool niced = false;
+    };
+
+    // The real topology, scanned once
+    static ThreadManager& get() {
+        static ThreadManager manager;
+        return manager;
+    }
+
+    explicit ThreadManager(std::string root = "/sys/devices/system/cpu") : root_(std::move(root)) {
+        scan();
+    }
+
+    const std::vector<Cpu>& cpus() const { return cpus_; }
+    const std::vector<int>& bigCores() const { return big_; }
+    const std::vector<int>& littleCores() const { return little_; }
+    const std::vector<int>& primeCores() const { return prime_; }
+
+    // The cores a thread of `role` is pinned to, empty when it is not pinned
+    // (topology unknown, or one kind of core only)
+    std::vector<int> affinity(Role role) const {
+        if (role == Role::Realtime && !prime_.empty()) {
+            // Big cores below the prime tier, never empty: scan() only
+            // sets prime_ with a middle tier
+            std::vector<int> cores;
+            for (int c : big_)
+                if (std::find(prime_.begin(), prime_.end(), c) == prime_.end()) cores.push_back(c);
+            return cores;
+        }
+        const std::vector<int>& cores = role == Role::Background ? little_ : big_;
+        if (cores.empty() || cores.size() == cpus_.size()) return {};
+        return cores;
+    }
+
+    // Start fn(args...) on a new thread placed for `role`
+    template <typename Fn, typename... Args>
+    std::thread spawn(Role role, const char* name, Fn&& fn, Args&&... args) {
+        return std::thread([this, role, name = std::string(name),
+                            fn = std::forward<Fn>(fn)](auto&&... a) mutable {
+            place(role, name.c_str());
+            std::invoke(fn, std::forward<decltype(a)>(a)...);
+        }, std::forward<Args>(args)...);
+    }
+
+    // Place the calling thread
+    Placement place(Role role, const char* name) {
+        Placement p;
+        p.name = name;
+        p.role = role;
+
+#ifdef __linux__
+        pthread_setname_np(pthread_self(), p.name.substr(0, 15).c_str());
+
+        const std::vector<int> cores = affinity(role);
+        if (!cores.empty()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int c : cores) CPU_SET(c, &set);
+            p.pinned = sched_setaffinity(0, sizeof(set), &set) == 0;
+            if (p.pinned) p.cpus = cores;
+        }
+
+        if (role == Role::Realtime) {
+            sched_param param = {};
+            param.sched_priority = kFifoPriority;
+            p.fifo = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+        }
+        if (!p.fifo && role != Role::Foreground) {
+            p.nice = role == Role::Realtime ? kRealtimeNice : kBackgroundNice;
+            p.niced = setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), p.nice) == 0;
+        }
+#endif
+
+        std::lock_guard<std::mutex> lock(lock_);
+        placements_.push_back(p);
+        if (placements_.size() > kMaxPlacements) placements_.erase(placements_.begin());
+        return p;
+    }
+
+    std::vector<Placement> placements() {
+        std::lock_guard<std::mutex> lock(lock_);
+        return placements_;
+    }
+
+    // One line for the topology, then one per placed thread
+    std::string report() {
+        std::ostringstream out;
+        out << "cpus";
+        for (const auto& c : cpus_)
+            out << " " << c.id << ":" << c.capacity << "/" << c.cluster;
+        out << " big " << list(big_) << " prime " << list(prime_) << " little " << list(little_) << "\n";
+
+        for (const auto& p : placements()) {
+            static const char* kRoles[] = {" realtime", " foreground", " background"};
+            out << p.name << kRoles[(int)p.role]
+                << " cpus " << (p.pinned ? list(p.cpus) : std::string("any"));
+            if (p.fifo)
+                out << " SCHED_FIFO " << kFifoPriority;
+            else if (p.role == Role::Foreground)
+                out << " default";
+            else
+                out << " nice " << (p.niced ? std::to_string(p.nice) : std::string("unchanged"));
+            out << "\n";
+        }
+        return out.str();
+    }
+
+private:
+    static constexpr size_t kMaxPlacements = 64;
+
+    void scan() {
+        DIR* dir = opendir(root_.c_str());
+        if (!dir) {
+            LOGW("[ThreadManager] Cannot read %s, threads stay unplaced", root_.c_str());
+            return;
+        }
+        while (dirent* e = readdir(dir)) {
+            int id;
+            char rest;
+            if (sscanf(e->d_name, "cpu%d%c", &id, &rest) != 1) continue;
+            const std::string cpu = root_ + "/" + e->d_name;
+            if (readInt(cpu + "/online", 1) == 0) continue;
+
+            Cpu c;
+            c.id = id;
+            c.capacity = readInt(cpu + "/cpu_capacity", -1);
+            if (c.capacity < 0) c.capacity = readInt(cpu + "/cpufreq/cpuinfo_max_freq", 1024);
+            c.cluster = readInt(cpu + "/topology/cluster_id", -1);
+            if (c.cluster < 0) c.cluster = readInt(cpu + "/topology/physical_package_id", -1);
+            cpus_.push_back(c);
+        }
+        closedir(dir);
+        std::sort(cpus_.begin(), cpus_.end(), [](const Cpu& a, const Cpu& b) { return a.id < b.id; });
+        if (cpus_.empty()) return;
+
+        const auto [low, high] = std::minmax_element(cpus_.begin(), cpus_.end(),
+                                                     [](const Cpu& a, const Cpu& b) {
+            return a.capacity < b.capacity;
+        });
+        const int lowest = low->capacity, highest = high->capacity;
+        bool middle = false;
+        for (const auto& c : cpus_) {
+            (c.capacity > lowest ? big_ : little_).push_back(c.id);
+            middle = middle || (c.capacity > lowest && c.capacity < highest);
+        }
+
+        // Prime + big + little: the top tier is left to the callback
+        if (middle)
+            for (const auto& c : cpus_)
+                if (c.capacity == highest) prime_.push_back(c.id);
+
+        // Uniform parts: every core is both
+        if (big_.empty()) big_ = little_;
+    }
+
+    static int readInt(const std::string& path, int fallback) {
+        std::ifstream in(path);
+        int v;
+        return in >> v ? v : fallback;
+    }
+
+    static std::string list(const std::vector<int>& cores) {
+        std::string s;
+        for (int c : cores) s += (s.empty() ? "" : ",") + std::to_string(c);
+        return s.empty() ? "-" : s;
+    }
+
+    std::string root_;
+    std::vector<Cpu> cpus_;
+    std::vector<int> big_, little_, prime_;
+    std::mutex lock_;
+    std::vector<Placement> placements_;
+};
+
+#endif //OPIQO_THREADMANAGER_H
@@ -0,0 +1,104 @@
+/*
+ * sandbox_bench.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Per-block cost of the out-of-process transport against in-process
+ * hosting, for a unity-gain "plugin" so only the hosting is measured.
+ *
+ * The same binary is both sides: SandboxHost spawns /proc/self/exe with the
+ * sandbox argument list, which lands in sandbox_child() instead of main's
+ * benchmark loop. That child speaks the same protocol as sandbox_main.cpp
+ * but copies audio in to out instead of running an LV2 instance.
+ */
+
+#include "../SandboxHost.h"
+
+#include <sys/mman.h>
+#include <sys/prctl.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static int sandbox_child(int fd) {
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    void* mem = mmap(nullptr, sizeof(SandboxShm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) return 2;
+    auto* shm = static_cast<SandboxShm*>(mem);
+
+    uint32_t seen = shm->request.load(std::memory_order_acquire);
+    shm->reply.store(seen, std::memory_order_release);
+    shm->ready.store(1, std::memory_order_release);
+    sandbox_futex_wake(&shm->ready);
+
+    for (;;) {
+        const uint32_t request = shm->request.load(std::memory_order_acquire);
+        if (request == seen) {
+            if (!sandbox_futex_wait(&shm->request, seen, 1000000000) && getppid() == 1) return 0;
+            continue;
+        }
+        seen = request;
+        memcpy(shm->audio_out, shm->audio_in, sizeof(float) * shm->frames);
+        shm->reply.store(seen, std::memory_order_release);
+        sandbox_futex_wake(&shm->reply);
+    }
+}
+
+static double median(std::vector<double>& v) {
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+int main(int argc, char** argv) {
+    if (argc == 6 && !strcmp(argv[1], "3")) return sandbox_child(3);
+
+    const int blocks = 20000;
+    printf("%8s %14s %14s %14s %10s\n", "frames", "in-proc ns", "sandbox ns", "p99 ns", "missed");
+
+    for (uint32_t frames : {64u, 128u, 256u, 512u, 1024u}) {
+        std::vector<float> in(frames, 0.5f), out(frames);
+        std::vector<double> local, remote;
+
+        for (int b = 0; b < blocks; ++b) {
+            const auto t0 = std::chrono::steady_clock::now();
+            memcpy(out.data(), in.data(), sizeof(float) * frames);
+            local.push_back(std::chrono::duration<double, std::nano>(
+                    std::chrono::steady_clock::now() - t0).count());
+        }
+
+        SandboxHost::Config config;
+        config.executable = "/proc/self/exe";
+        config.lv2_path = "-";
+        config.uri = "unity";
+        config.max_frames = frames;
+        SandboxHost host(config);
+        if (!host.create() || !host.launch()) {
+            fprintf(stderr, "sandbox failed to start\n");
+            return 1;
+        }
+
+        for (int b = 0; b < blocks; ++b) {
+            const auto t0 = std::chrono::steady_clock::now();
+            if (host.begin()) {
+                SandboxShm* shm = host.shm();
+                shm->frames = frames;
+                memcpy(shm->audio_in, in.data(), sizeof(float) * frames);
+                host.submit();
+                if (host.wait(5000000))
+                    memcpy(out.data(), shm->audio_out, sizeof(float) * frames);
+            }
+            remote.push_back(std::chrono::duration<double, std::nano>(
+                    std::chrono::steady_clock::now() - t0).count());
+        }
+
+        const double p50_local = median(local);
+        const double p50_remote = median(remote);
+        const double p99_remote = remote[remote.size() * 99 / 100];
+        printf("%8u %14.0f %14.0f %14.0f %10llu\n", frames, p50_local, p50_remote, p99_remote,
+               (unsigned long long)host.missed());
+    }
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include <malloc.h>
+#include <chrono>
 #include "jalv.h"
 #include "jalv/state.h"
 #include "zix/zix.h"
@@ -35,19 +36,47 @@ jalv_apply_control_arg(Jalv* jalv, const char* s)
     return true;
 }
 
+static uint32_t
+jalv_next_power_of_two(uint32_t n)
+{
+    uint32_t p = 1U;
+    while (p < n) {
+        p <<= 1U;
+    }
+    return p;
+}
+
+/// Device cycles between two UI updates, with one cycle of slack
+static uint32_t
+jalv_ui_ring_cycles(const JalvSettings* const settings)
+{
+    const float cycles_per_update =
+            settings->sample_rate /
+            ((float)settings->block_length * MAX(1.0f, settings->ui_update_hz));
+    return MAX(2U, MIN((uint32_t)N_BUFFER_CYCLES, (uint32_t)cycles_per_update + 1U));
+}
+
+/**
+   Size sequence buffers for one device block.
+
+   A full MIDI stream is roughly one event per millisecond, so budgeting one
+   event every 8 frames is plenty even at 384 kHz, while a 192 frame burst
+   then needs a few hundred bytes instead of a fixed 4096.
+*/
+static size_t
+jalv_midi_buf_size(const uint32_t block_length)
+{
+    const size_t event = sizeof(LV2_Atom_Event) + sizeof(uint64_t);
+    const size_t size  = sizeof(LV2_Atom_Sequence) + (block_length / 8U + 1U) * event;
+    return MAX((size_t)1024U, (size_t)jalv_next_power_of_two((uint32_t)size));
+}
+
 static void
 jalv_init_ui_settings(Jalv* const jalv)
 {
     const JalvOptions* const opts     = &jalv->opts;
     JalvSettings* const      settings = &jalv->settings;
 
-    if (!settings->ring_size) {
-        /* The UI ring is fed by plugin output ports (usually one), and the UI
-           updates roughly once per cycle.  The ring size is a few times the size
-           of the MIDI output to give the UI a chance to keep up. */
-        settings->ring_size = settings->midi_buf_size * N_BUFFER_CYCLES;
-    }
-
     if (opts->update_rate <= 0.0f) {
         // Calculate a reasonable UI update frequency
         settings->ui_update_hz = jalv_frontend_refresh_rate(jalv);
@@ -60,7 +89,19 @@ jalv_init_ui_settings(Jalv* const jalv)
 
     // The UI can only go so fast, clamp to reasonable limits
     settings->ui_update_hz = MAX(1.0f, MIN(60.0f, settings->ui_update_hz));
-    settings->ring_size    = MAX(4096, settings->ring_size);
+
+    if (!settings->ring_size) {
+        /* The UI ring is fed by plugin output ports (usually one), and the UI
+           drains it once per update.  Size it for the number of device cycles
+           that actually run between two updates, rather than a fixed
+           N_BUFFER_CYCLES, so small bursts don't pay for a 4096 frame worst
+           case. */
+        const uint32_t cycles = jalv_ui_ring_cycles(settings);
+        const size_t   msg    = MAX(jalv->ui_msg_size, jalv->process.process_msg_size);
+        settings->ring_size   = jalv_next_power_of_two(
+                (uint32_t)(MAX(msg, settings->midi_buf_size) * cycles));
+    }
+    settings->ring_size = MAX(4096, settings->ring_size);
     LOGD ("Comm buffers: %u bytes\n", settings->ring_size);
     LOGD ("Update rate:  %.01f Hz\n", settings->ui_update_hz);
     LOGD ("Scale factor: %.01f\n", settings->ui_scale_factor);
@@ -227,6 +268,47 @@ jalv_create_ports(Jalv* jalv)
     return 0;
 }
 
+JalvBackend*
+jalv_backend_allocate_(void)
+{
+    JalvBackend* const backend = new JalvBackendImpl();
+    backend->port_bufs     = NULL;
+    backend->num_port_bufs = 0U;
+    return backend;
+}
+
+void
+jalv_backend_free_(JalvBackend* const backend)
+{
+    delete backend;
+}
+
+/// Open one direction of the duplex pair with low latency float settings
+static oboe::Result
+jalv_backend_open_stream(JalvBackend* const                    backend,
+                         const oboe::Direction                 direction,
+                         const int32_t                         sample_rate,
+                         const int32_t                         frames_per_callback,
+                         std::shared_ptr<oboe::AudioStream>&   stream)
+{
+    oboe::AudioStreamBuilder builder;
+    builder.setDirection(direction)
+        ->setPerformanceMode(oboe::PerformanceMode::LowLatency)
+        ->setSharingMode(oboe::SharingMode::Exclusive)
+        ->setFormat(oboe::AudioFormat::Float)
+        ->setFormatConversionAllowed(true)
+        ->setChannelCount(oboe::ChannelCount::Stereo)
+        ->setSampleRate(sample_rate);
+
+    if (direction == oboe::Direction::Output) {
+        // Fixed callback size, so plugins really get fixedBlockLength
+        builder.setDataCallback(backend->duplex.get())
+            ->setFramesPerDataCallback(frames_per_callback);
+    }
+
+    return builder.openStream(stream);
+}
+
 int
 jalv_backend_open_(JalvBackend* const     backend,
                   const JalvURIDs* const urids,
@@ -236,22 +318,228 @@ jalv_backend_open_(JalvBackend* const     backend,
                   const char* const      name,
                   const bool             exact_name)
 {
-    LOGD("[jalv_backend_open_] implement me: Initializing backend");
-    // Set audio engine properties
-    settings->sample_rate   = (float)48000;
-    settings->block_length  = 4096;
-    settings->midi_buf_size = 4096;
-    void* const arg = (void*)backend;
-
-//    backend->urids              = urids;
-//    backend->settings           = settings;
-//    backend->process            = process;
-//    backend->done               = done;
-//    backend->client             = NULL;
-//    backend->is_internal_client = false;
+    backend->urids              = urids;
+    backend->settings           = settings;
+    backend->process            = process;
+    backend->done               = done;
+    backend->is_internal_client = false;
+    backend->duplex             = std::make_unique<JalvOboeStream>(backend);
+
+    // Output first at the device's native rate and burst, then match the
+    // input to it for the fastest path
+    oboe::Result result = jalv_backend_open_stream(
+            backend, oboe::Direction::Output, oboe::kUnspecified,
+            oboe::DefaultStreamValues::FramesPerBurst, backend->output_stream);
+    if (result != oboe::Result::OK) {
+        LOGE("[jalv_backend_open_] Failed to open output stream: %s",
+             oboe::convertToText(result));
+        backend->duplex.reset();
+        return 1;
+    }
+
+    result = jalv_backend_open_stream(
+            backend, oboe::Direction::Input,
+            backend->output_stream->getSampleRate(), oboe::kUnspecified,
+            backend->input_stream);
+    if (result != oboe::Result::OK) {
+        LOGE("[jalv_backend_open_] Failed to open input stream: %s",
+             oboe::convertToText(result));
+        backend->output_stream->close();
+        backend->output_stream.reset();
+        backend->duplex.reset();
+        return 1;
+    }
+
+    // Size every port buffer, evbuf and ring from what was negotiated
+    int32_t block = backend->output_stream->getFramesPerDataCallback();
+    if (block <= 0) {
+        block = backend->output_stream->getFramesPerBurst();
+    }
+    settings->sample_rate   = (float)backend->output_stream->getSampleRate();
+    settings->block_length  = (uint32_t)block;
+    settings->midi_buf_size = jalv_midi_buf_size(settings->block_length);
+
+    backend->duplex->setSharedInputStream(backend->input_stream);
+    backend->duplex->setSharedOutputStream(backend->output_stream);
+    LOGD("[jalv_backend_open_] Opened Oboe streams for %s", name ? name : "jalv");
     return 0;
 }
 
+void
+jalv_backend_close_(JalvBackend* const backend)
+{
+    if (!backend) {
+        return;
+    }
+
+    // Playback must go before recording, its callback reads the input stream
+    std::shared_ptr<oboe::AudioStream>* const streams[] = {
+            &backend->output_stream, &backend->input_stream};
+    for (auto* stream : streams) {
+        if (*stream) {
+            (*stream)->stop();
+            (*stream)->close();
+            stream->reset();
+        }
+    }
+    backend->duplex.reset();
+
+    for (uint32_t i = 0; i < backend->num_port_bufs; ++i) {
+        zix_aligned_free(NULL, backend->port_bufs[i]);
+    }
+    free(backend->port_bufs);
+    backend->port_bufs     = NULL;
+    backend->num_port_bufs = 0U;
+}
+
+void
+jalv_backend_activate_(JalvBackend* const backend)
+{
+    if (backend->duplex) {
+        backend->duplex->start();
+    }
+}
+
+void
+jalv_backend_deactivate_(JalvBackend* const backend)
+{
+    if (backend->duplex) {
+        backend->duplex->stop();
+    }
+}
+
+/**
+   Run the plugin for one chunk of at most block_length frames.
+
+   This is the Oboe equivalent of the Jack backend's process callback: input
+   sequences are reset, jalv_run() applies pending UI messages and runs the
+   plugin, and output events and (periodically) control values are forwarded
+   to the UI ring.
+*/
+static void
+jalv_backend_run_chunk(JalvBackend* const backend, const uint32_t nframes)
+{
+    JalvProcess* const     proc  = backend->process;
+    const JalvURIDs* const urids = backend->urids;
+
+    for (uint32_t p = 0; p < proc->num_ports; ++p) {
+        JalvProcessPort* const port = &proc->ports[p];
+        if (port->type == TYPE_EVENT && port->evbuf) {
+            lv2_evbuf_reset(port->evbuf, port->flow == FLOW_INPUT);
+        }
+    }
+
+    if (proc->run_state != JALV_RUNNING) {
+        jalv_bypass(proc, nframes);
+        return;
+    }
+
+    const bool send_ui_updates =
+            jalv_run(proc, nframes) == JALV_PROCESS_SEND_UPDATES;
+
+    for (uint32_t p = 0; p < proc->num_ports; ++p) {
+        JalvProcessPort* const port = &proc->ports[p];
+        if (port->flow != FLOW_OUTPUT) {
+            continue;
+        }
+
+        if (port->type == TYPE_EVENT && port->evbuf && proc->plugin_to_ui) {
+            for (LV2_Evbuf_Iterator i = lv2_evbuf_begin(port->evbuf);
+                 lv2_evbuf_is_valid(i);
+                 i = lv2_evbuf_next(i)) {
+                uint32_t frames    = 0U;
+                uint32_t subframes = 0U;
+                uint32_t type      = 0U;
+                uint32_t size      = 0U;
+                void*    body      = NULL;
+                lv2_evbuf_get(i, &frames, &subframes, &type, &size, &body);
+                if (type != urids->midi_MidiEvent) {
+                    jalv_write_event(proc->plugin_to_ui, p, size, type, body);
+                }
+            }
+        } else if (send_ui_updates && port->type == TYPE_CONTROL &&
+                   proc->plugin_to_ui) {
+            jalv_write_control(proc->plugin_to_ui, p, proc->controls_buf[p]);
+        }
+    }
+}
+
+oboe::DataCallbackResult
+JalvOboeStream::onBothStreamsReady(const void* inputData,
+                                   int         numInputFrames,
+                                   void*       outputData,
+                                   int         numOutputFrames)
+{
+    const auto         start   = std::chrono::steady_clock::now();
+    JalvBackend* const backend = backend_;
+    JalvProcess* const proc    = backend->process;
+
+    const auto*   in          = static_cast<const float*>(inputData);
+    auto*         out         = static_cast<float*>(outputData);
+    const int32_t in_channels = getInputStream()->getChannelCount();
+    const int32_t out_channels = getOutputStream()->getChannelCount();
+
+    if (!proc->instance || !backend->port_bufs) {
+        memset(out, 0, sizeof(float) * numOutputFrames * out_channels);
+        return oboe::DataCallbackResult::Continue;
+    }
+
+    const uint32_t block = backend->settings->block_length;
+    for (uint32_t offset = 0; offset < (uint32_t)numOutputFrames; offset += block) {
+        const uint32_t nframes = MIN(block, (uint32_t)numOutputFrames - offset);
+
+        // Deinterleave into plugin inputs, the input may be short
+        uint32_t in_port = 0U;
+        for (uint32_t p = 0; p < backend->num_port_bufs; ++p) {
+            float* const buf = backend->port_bufs[p];
+            if (!buf || proc->ports[p].flow != FLOW_INPUT) {
+                continue;
+            }
+
+            const int32_t ch = MIN((int32_t)in_port++, in_channels - 1);
+            for (uint32_t i = 0; i < nframes; ++i) {
+                const uint32_t frame = offset + i;
+                buf[i] = frame < (uint32_t)numInputFrames
+                                 ? in[frame * in_channels + ch]
+                                 : 0.0f;
+            }
+        }
+
+        jalv_backend_run_chunk(backend, nframes);
+
+        // Interleave plugin outputs, a mono plugin feeds every channel
+        float*   dst      = out + offset * out_channels;
+        uint32_t out_port = 0U;
+        uint32_t last     = UINT32_MAX;
+        for (uint32_t p = 0; p < backend->num_port_bufs; ++p) {
+            const float* const buf = backend->port_bufs[p];
+            if (!buf || proc->ports[p].flow != FLOW_OUTPUT) {
+                continue;
+            }
+
+            if ((int32_t)out_port < out_channels) {
+                for (uint32_t i = 0; i < nframes; ++i) {
+                    dst[i * out_channels + out_port] = buf[i];
+                }
+            }
+            last = p;
+            ++out_port;
+        }
+
+        for (int32_t ch = (int32_t)out_port; ch < out_channels; ++ch) {
+            const float* const buf =
+                    last == UINT32_MAX ? NULL : backend->port_bufs[last];
+            for (uint32_t i = 0; i < nframes; ++i) {
+                dst[i * out_channels + ch] = buf ? buf[i] : 0.0f;
+            }
+        }
+    }
+
+    backend->stats.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    return oboe::DataCallbackResult::Continue;
+}
+
 /// Find the initial state and set jalv->plugin
 static LilvState*
 open_plugin_state(Jalv* const         jalv,
@@ -352,14 +640,45 @@ jalv_init_features(Jalv* const jalv)
                  &jalv->features.request_value);
 }
 
+/**
+   Append buf-size:nominalBlockLength to the options set by libjalv.
+
+   libjalv only passes min/max block length, but with a fixed device burst
+   the nominal length is known exactly and lets plugins size FFTs and
+   lookahead for the real block instead of the maximum.
+*/
+static void
+jalv_init_block_options(Jalv* const jalv)
+{
+    const LV2_Options_Option* const base = jalv->features.options;
+
+    size_t n = 0;
+    while (base[n].key) {
+        ++n;
+    }
+
+    auto* const options =
+            (LV2_Options_Option*)calloc(n + 2U, sizeof(LV2_Options_Option));
+    memcpy(options, base, n * sizeof(LV2_Options_Option));
+    options[n].context = LV2_OPTIONS_INSTANCE;
+    options[n].subject = 0;
+    options[n].key     = jalv_mapper_map_uri(jalv->mapper, LV2_BUF_SIZE__nominalBlockLength);
+    options[n].size    = sizeof(int32_t);
+    options[n].type    = jalv->urids.atom_Int;
+    options[n].value   = &jalv->settings.block_length;
+
+    jalv->features.options_feature.data = options;
+}
 
 int
-jalv_open_(Jalv* const jalv, const char* const load_arg)
+jalv_open_(Jalv* const jalv, const char* const load_arg, const char* const lv2_path)
 {
     JalvSettings* const settings = &jalv->settings;
 
-    settings->block_length    = 4096U;
-    settings->midi_buf_size   = 1024U;
+    // Block length and MIDI buffer size come from the device, see
+    // jalv_backend_open_()
+    settings->block_length    = 0U;
+    settings->midi_buf_size   = 0U;
     settings->ring_size       = jalv->opts.ring_size;
     settings->ui_update_hz    = jalv->opts.update_rate;
     settings->ui_scale_factor = jalv->opts.scale_factor;
@@ -367,6 +686,11 @@ jalv_open_(Jalv* const jalv, const char* const load_arg)
     // Load the LV2 world
     LilvWorld* const world = lilv_world_new();
     lilv_world_set_option(world, LILV_OPTION_OBJECT_INDEX, NULL);
+    if (lv2_path) {
+        LilvNode* const path = lilv_new_string(world, lv2_path);
+        lilv_world_set_option(world, LILV_OPTION_LV2_PATH, path);
+        lilv_node_free(path);
+    }
     lilv_world_load_all(world);
 
     jalv->world       = world;
@@ -426,13 +750,11 @@ jalv_open_(Jalv* const jalv, const char* const load_arg)
         LOGD ("[jalv_open] Implement me");
     }
 
-    // Initialize process thread
-    const uint32_t update_frames =
-            (uint32_t)(settings->sample_rate / settings->ui_update_hz);
+    // Initialize process thread (update_frames is set once the rate is known)
     jalv_process_init(&jalv->process,
                       &jalv->urids,
                       jalv->mapper,
-                      update_frames,
+                      0U,
                       jalv->opts.trace);
 
     // Create workers if necessary
@@ -447,6 +769,7 @@ jalv_open_(Jalv* const jalv, const char* const load_arg)
     }
 
     // Open backend (to set the sample rate, among other thigns)
+    jalv->backend = jalv_backend_allocate_();
     if (jalv_backend_open_(jalv->backend,
                           &jalv->urids,
                           &jalv->settings,
@@ -474,6 +797,9 @@ jalv_open_(Jalv* const jalv, const char* const load_arg)
 
     jalv_init_ui_settings(jalv);
     jalv_init_lv2_options(&jalv->features, &jalv->urids, settings);
+    jalv_init_block_options(jalv);
+    jalv->process.update_frames =
+            (uint32_t)(settings->sample_rate / settings->ui_update_hz);
 
     // Create Plugin => UI communication buffers
     jalv->ui_msg_size = MAX(jalv->ui_msg_size, settings->midi_buf_size);
@@ -488,7 +814,6 @@ jalv_open_(Jalv* const jalv, const char* const load_arg)
                                            &static_features[0],
                                            &static_features[1],
                                            &static_features[2],
-                                           &static_features[3],
                                            NULL};
 
     jalv->feature_list = (const LV2_Feature**)calloc(1, sizeof(features));
@@ -557,12 +882,108 @@ jalv_open_(Jalv* const jalv, const char* const load_arg)
 }
 
 
+int
+jalv_close_(Jalv* const jalv)
+{
+    // The caller is expected to have called jalv_deactivate_() already
+    jalv_backend_close_(jalv->backend);
+    jalv_backend_free_(jalv->backend);
+    jalv->backend = NULL;
+
+    if (jalv->process.worker) {
+        jalv_worker_free(jalv->process.worker);
+    }
+    if (jalv->process.state_worker) {
+        jalv_worker_free(jalv->process.state_worker);
+    }
+    jalv->process.worker       = NULL;
+    jalv->process.state_worker = NULL;
+
+    if (jalv->process.instance) {
+        lilv_instance_free(jalv->process.instance);
+        jalv->process.instance = NULL;
+    }
+
+    jalv_process_cleanup(&jalv->process);
+    if (jalv->features.options_feature.data != jalv->features.options) {
+        free(jalv->features.options_feature.data);
+        jalv->features.options_feature.data = NULL;
+    }
+    zix_aligned_free(NULL, jalv->ui_msg);
+    free(jalv->feature_list);
+    free(jalv->ports);
+    jalv->ui_msg       = NULL;
+    jalv->feature_list = NULL;
+    jalv->ports        = NULL;
+
+    if (jalv->world) {
+        lilv_world_free(jalv->world);
+        jalv->world = NULL;
+    }
+    return 0;
+}
+
+int
+jalv_activate_(Jalv* const jalv)
+{
+    if (!jalv->backend || !jalv->process.instance) {
+        return 1;
+    }
+
+    if (jalv->process.worker) {
+        jalv_worker_launch(jalv->process.worker);
+    }
+
+    lilv_instance_activate(jalv->process.instance);
+    jalv_backend_activate_(jalv->backend);
+    return 0;
+}
+
+int
+jalv_deactivate_(Jalv* const jalv)
+{
+    if (!jalv->backend || !jalv->process.instance) {
+        return 1;
+    }
+
+    jalv_backend_deactivate_(jalv->backend);
+    lilv_instance_deactivate(jalv->process.instance);
+    if (jalv->process.worker) {
+        jalv_worker_exit(jalv->process.worker);
+    }
+    return 0;
+}
+
+ZixStatus
+jalv_send_control_(Jalv* const jalv, const uint32_t port_index, const float value)
+{
+    if (!jalv->process.ui_to_plugin || port_index >= jalv->num_ports) {
+        return ZIX_STATUS_BAD_ARG;
+    }
+
+    return jalv_write_control(jalv->process.ui_to_plugin, port_index, value);
+}
+
+ZixStatus
+jalv_send_event_(Jalv* const    jalv,
+                 const uint32_t port_index,
+                 const uint32_t size,
+                 const LV2_URID type,
+                 const void*    body)
+{
+    if (!jalv->process.ui_to_plugin || port_index >= jalv->num_ports) {
+        return ZIX_STATUS_BAD_ARG;
+    }
+
+    return jalv_write_event(
+            jalv->process.ui_to_plugin, port_index, size, type, body);
+}
+
 void
 jalv_connect_ports (JalvBackend* const backend,
                            JalvProcess* const proc,
                            const uint32_t     port_index)
 {
-    LOGD("[jalv_connect_ports] implement me: Connecting ports");
     JalvProcessPort* const port   = &proc->ports[port_index];
 
     // Connect unsupported ports to NULL (known to be optional by this point)
@@ -571,31 +992,39 @@ jalv_connect_ports (JalvBackend* const backend,
         return;
     }
 
-    // Build Jack flags for port
-    enum JackPortFlags jack_flags =
-            (port->flow == FLOW_INPUT) ? JackPortIsInput : JackPortIsOutput;
+    if (!backend->port_bufs) {
+        backend->port_bufs     = (float**)calloc(proc->num_ports, sizeof(float*));
+        backend->num_port_bufs = proc->num_ports;
+    }
 
     // Connect the port based on its type
     switch (port->type) {
         case TYPE_UNKNOWN:
+        case TYPE_CV:
             break;
         case TYPE_CONTROL:
             LOGD("[jalv_connect_ports] Connect control port %u to buffer\n", port_index);
             lilv_instance_connect_port(
                     proc->instance, port_index, &proc->controls_buf[port_index]);
             break;
-        case TYPE_AUDIO:
-            LOGD("[jalv_connect_ports] Connect audio port %u to Jack\n", port_index);
-//            port->sys_port = jack_port_register(
-//                    client, port->symbol, JACK_DEFAULT_AUDIO_TYPE, jack_flags, 0);
+        case TYPE_AUDIO: {
+            // Planar buffer sized for the largest chunk run from the callback
+            const size_t size = sizeof(float) * backend->settings->block_length;
+            float* const buf  = (float*)zix_aligned_alloc(NULL, 64U, size);
+            memset(buf, 0, size);
+            zix_aligned_free(NULL, backend->port_bufs[port_index]);
+            backend->port_bufs[port_index] = buf;
+            port->sys_port                 = buf;
+            LOGD("[jalv_connect_ports] Connect audio port %u to planar buffer\n", port_index);
+            lilv_instance_connect_port(proc->instance, port_index, buf);
             break;
+        }
         case TYPE_EVENT:
-            LOGD("[jalv_connect_ports] Connect event port %u to Jack MIDI\n", port_index);
-//            if (port->supports_midi) {
-//                port->sys_port = jack_port_register(
-//                        client, port->symbol, JACK_DEFAULT_MIDI_TYPE, jack_flags, 0);
-//            }
+            // The evbuf was allocated by jalv_process_activate(), it is reset
+            // and scanned from the Oboe callback around every jalv_run()
+            LOGD("[jalv_connect_ports] Connect event port %u to evbuf\n", port_index);
+            lilv_instance_connect_port(
+                    proc->instance, port_index, lv2_evbuf_get_buffer(port->evbuf));
             break;
     }
-
 }
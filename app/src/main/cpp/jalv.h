@@ -3,19 +3,89 @@
 //
 
 #ifndef OPIQO_KITTY_JALV_H
+#define OPIQO_KITTY_JALV_H
+#include <oboe/Oboe.h>
 #include <jalv/jalv.h>
+#include <jalv/comm.h>
 #include "lv2/buf-size/buf-size.h"
+#include "CallbackStats.h"
+
+#include <memory>
 
 #define N_BUFFER_CYCLES 16
 /// These features have no data
 static const LV2_Feature static_features[] = {
         {LV2_STATE__loadDefaultState, NULL},
-        {LV2_BUF_SIZE__powerOf2BlockLength, NULL},
         {LV2_BUF_SIZE__fixedBlockLength, NULL},
         {LV2_BUF_SIZE__boundedBlockLength, NULL}};
 
+class JalvOboeStream;
+
+/**
+   Oboe audio backend for jalv.
+
+   This replaces the Jack backend built into libjalv: plugin audio ports are
+   connected to preallocated planar buffers which are (de)interleaved from the
+   Oboe full-duplex callback, and jalv_run() is driven from that callback in
+   chunks of at most settings->block_length frames.
+*/
+struct JalvBackendImpl {
+    const JalvURIDs* urids;              ///< Application vocabulary
+    JalvSettings*    settings;           ///< Run settings
+    JalvProcess*     process;            ///< Process thread state
+    ZixSem*          done;               ///< Shutdown semaphore
+    bool             is_internal_client; ///< Always false, kept for parity
+
+    std::unique_ptr<JalvOboeStream>    duplex;          ///< Full duplex callback
+    std::shared_ptr<oboe::AudioStream> input_stream;    ///< Recording stream
+    std::shared_ptr<oboe::AudioStream> output_stream;   ///< Playback stream
+    float**                            port_bufs;       ///< Planar buffers by port index
+    uint32_t                           num_port_bufs;   ///< Size of port_bufs
+    CallbackStats                      stats;           ///< Cost of each callback
+};
+
+/// Full duplex Oboe stream that runs a jalv process for every callback
+class JalvOboeStream : public oboe::FullDuplexStream {
+public:
+    explicit JalvOboeStream(JalvBackend* backend) : backend_(backend) {}
+
+    oboe::DataCallbackResult onBothStreamsReady(const void* inputData,
+                                                int numInputFrames,
+                                                void* outputData,
+                                                int numOutputFrames) override;
+
+private:
+    JalvBackend* backend_;
+};
+
+/// Load the plugin/state from lv2_path (the default LV2 path if NULL) and
+/// set up an Oboe backend (jalv must be zeroed)
+int jalv_open_(Jalv* const jalv, const char* const load_arg, const char* const lv2_path);
+/// Shut down everything set up by jalv_open_()
+int jalv_close_(Jalv* const jalv);
+/// Launch workers and start the Oboe streams
+int jalv_activate_(Jalv* const jalv);
+/// Stop the Oboe streams and workers
+int jalv_deactivate_(Jalv* const jalv);
+
+/// Send a control port change to the plugin through the UI→DSP ring
+ZixStatus jalv_send_control_(Jalv* const jalv, uint32_t port_index, float value);
+/// Send an atom to a plugin sequence port through the UI→DSP ring
+ZixStatus jalv_send_event_(Jalv* const jalv, uint32_t port_index,
+                           uint32_t size, LV2_URID type, const void* body);
 
-int jalv_open_(Jalv* const jalv, const char* const load_arg);
+JalvBackend* jalv_backend_allocate_(void);
+void jalv_backend_free_(JalvBackend* backend);
+int jalv_backend_open_(JalvBackend* const     backend,
+                       const JalvURIDs* const urids,
+                       JalvSettings* const    settings,
+                       JalvProcess* const     process,
+                       ZixSem* const          done,
+                       const char* const      name,
+                       const bool             exact_name);
+void jalv_backend_close_(JalvBackend* backend);
+void jalv_backend_activate_(JalvBackend* backend);
+void jalv_backend_deactivate_(JalvBackend* backend);
 void jalv_connect_ports(JalvBackend* const backend,
                          JalvProcess* const proc,
                          const uint32_t     port_index);
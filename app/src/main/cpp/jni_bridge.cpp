@@ -20,9 +20,13 @@
 #include <jalv/jalv.h>
 #include <jalv/backend.h>
 #include <lilv/lilv.h>
+#include <cmath>
 #include <fstream>
 #include "jalv.h"
 #include "LV2Plugin.hpp"
+#include "HostBenchmark.h"
+#include "RigFile.h"
+#include "SessionLoader.h"
 
 static const int kOboeApiAAudio = 0;
 static const int kOboeApiOpenSLES = 1;
@@ -71,6 +75,51 @@ Java_org_acoustixaudio_opiqo_multi_AudioEngine_setEffectOn(
     return engine->setEffectOn(isEffectOn) ? JNI_TRUE : JNI_FALSE;
 }
 
+// Engine switch: a plugin URI runs that plugin through jalv, null or empty
+// runs the chain. Takes effect the next time the effect is turned on.
+JNIEXPORT jboolean JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_setJalvPlugin(
+    JNIEnv *env, jclass, jstring uri) {
+    if (engine == nullptr) {
+        LOGE(
+            "Engine is null, you must call createEngine before calling this "
+            "method");
+        return JNI_FALSE;
+    }
+
+    std::string pluginUri;
+    if (uri != nullptr) {
+        const char *cstr = env->GetStringUTFChars(uri, nullptr);
+        if (cstr) {
+            pluginUri.assign(cstr);
+            env->ReleaseStringUTFChars(uri, cstr);
+        }
+    }
+    return engine->setJalvPlugin(pluginUri) ? JNI_TRUE : JNI_FALSE;
+}
+
+// Callback cost of the running engine: last, max and mean ns, callbacks.
+// Null when the effect is off.
+JNIEXPORT jlongArray JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_getCallbackStats(JNIEnv *env, jclass) {
+    if (engine == nullptr) {
+        LOGE(
+            "Engine is null, you must call createEngine before calling this "
+            "method");
+        return nullptr;
+    }
+
+    const CallbackStats *stats = engine->callbackStats();
+    if (stats == nullptr) return nullptr;
+    const uint64_t callbacks = stats->callbacks.load();
+    jlong out[4] = {stats->last_ns.load(), stats->max_ns.load(),
+                    callbacks ? (jlong)(stats->total_ns.load() / (int64_t)callbacks) : 0,
+                    (jlong)callbacks};
+    jlongArray ret = env->NewLongArray(4);
+    env->SetLongArrayRegion(ret, 0, 4, out);
+    return ret;
+}
+
 JNIEXPORT void JNICALL
 Java_org_acoustixaudio_opiqo_multi_AudioEngine_setRecordingDeviceId(
     JNIEnv *env, jclass, jint deviceId) {
@@ -183,12 +232,12 @@ Java_org_acoustixaudio_opiqo_multi_AudioEngine_test(JNIEnv *env, jclass clazz, j
     LV2Plugin * lv2Plugin = new LV2Plugin(world, "http://guitarix.sourceforge.net/plugins/gx_sloopyblue_#_sloopyblue_", 48000., 4096);
     lv2Plugin->initialize();
     lv2Plugin->start();
-    engine -> plugin1 = lv2Plugin ;
     lv2Plugin->getControl("GAIN")->setValue(0.f);
     lv2Plugin->getControl("VOLUME")->setValue(0.f);
     lv2Plugin->getControl("TONE")->setValue(0.f);
-//    lv2Plugin->ports_.at(3).control = 1.f;
-    lv2Plugin->ports_.at(4).control = 0.4f;
+//    lv2Plugin->setControlValue(3, 1.f);
+    lv2Plugin->setControlValue(4, 0.4f);
+    engine -> chain.replace(1, lv2Plugin);
 //    lv2Plugin->ports_.at(5).control = 0.f;
     return ;
 
@@ -254,8 +303,9 @@ Java_org_acoustixaudio_opiqo_multi_AudioEngine_setCacheDir(JNIEnv *env, jclass c
         return;
     }
 
-    engine->cacheDir = std::string (env->GetStringUTFChars(path, nullptr));
-    free((void*)env->GetStringUTFChars(path, nullptr));
+    const char * cstr = env->GetStringUTFChars(path, nullptr);
+    engine->cacheDir = std::string (cstr);
+    env->ReleaseStringUTFChars(path, cstr);
 
 }
 extern "C"
@@ -269,26 +319,9 @@ Java_org_acoustixaudio_opiqo_multi_AudioEngine_setValue(JNIEnv *env, jclass claz
         return;
     }
 
-    LV2Plugin * plugin = nullptr ;
-    switch (p) {
-        case 1:
-            plugin = engine->plugin1;
-            break;
-        case 2:
-            plugin = engine->plugin2;
-            break;
-        case 3:
-            plugin = engine->plugin3;
-            break;
-        case 4:
-            plugin = engine->plugin4;
-            break;
-        default:
-            LOGE("Unknown plugin index %d", p);
-            return;
+    if (!engine->chain.setValue(p, index, value)) {
+        LOGE("Cannot set plugin %d port %d", p, index);
     }
-
-    plugin->ports_.at (index).control = value;
 //    LOGD("[setValue] Set plugin %d port %d to value %f", p, index, value);
 //    switch (index) {
 //        case 0:
@@ -312,71 +345,250 @@ Java_org_acoustixaudio_opiqo_multi_AudioEngine_setValue(JNIEnv *env, jclass claz
 }
 
 
+static LV2Plugin* makePlugin(const char* pluginUri, bool sandboxed) {
+    LV2Plugin * plugin = new LV2Plugin(engine -> world, pluginUri, engine -> sampleRate, 4096);
+    if (sandboxed) {
+        SandboxHost::Config config;
+        config.executable = engine->nativeLibraryDir + "/libopiqo_sandbox.so";
+        config.lv2_path = engine->lv2Path;
+        config.uri = pluginUri;
+        config.sample_rate = engine->sampleRate;
+        config.max_frames = 4096;
+        plugin->setSandbox(config);
+    }
+    return plugin;
+}
+
+static jint addPlugin(JNIEnv *env, jint position, jstring uri, bool sandboxed) {
+    if (!PluginChain::isValidSlot(position)) {
+        LOGE("Unknown plugin index %d", position);
+        return -1;
+    }
+
+    const char * pluginUri = env->GetStringUTFChars(uri, nullptr);
+
+    // A warm instance from the pool if there is one, else build it here
+    LV2Plugin * plugin = sandboxed ? nullptr : engine->pool.take(pluginUri, engine->sampleRate);
+    if (plugin == nullptr) {
+        plugin = makePlugin(pluginUri, sandboxed);
+        if ( !plugin->initialize()) {
+            LOGE("Failed to initialize plugin %s", pluginUri);
+            delete plugin;
+            env->ReleaseStringUTFChars(uri, pluginUri);
+            return -1;
+        }
+        plugin->start();
+    }
+    LOGD("Successfully added plugin %s at position %d%s", pluginUri, position,
+         sandboxed ? " (sandboxed)" : "");
+    LOGD ("[plugininfo] %s", engine->pluginInfo[pluginUri].dump(4).c_str());
+
+    // Publishes the new slot and frees the old plugin once the audio
+    // callback can no longer be using it
+    engine->chain.replace(position, plugin);
+
+    env->ReleaseStringUTFChars(uri, pluginUri);
+    return 0 ;
+}
+
 extern "C"
 JNIEXPORT jint JNICALL
 Java_org_acoustixaudio_opiqo_multi_AudioEngine_addPlugin(JNIEnv *env, jclass clazz, jint position,
                                                          jstring uri) {
+    return addPlugin(env, position, uri, false);
+}
 
-    LV2Plugin * plugin = nullptr ;
-    switch (position) {
-        case 1:
-            plugin = engine->plugin1;
-            engine ->plugin1 = nullptr;
-            break;
-        case 2:
-            plugin = engine->plugin2;
-            engine ->plugin2 = nullptr;
-            break;
-        case 3:
-            plugin = engine->plugin3;
-            engine ->plugin3 = nullptr;
-            break;
-        case 4:
-            plugin = engine->plugin4;
-            engine ->plugin4 = nullptr;
-            break;
-        default:
-            LOGE("Unknown plugin index %d", position);
-            return -1;
+// Same as addPlugin, but the plugin runs in a separate process that is
+// restarted if it crashes
+extern "C"
+JNIEXPORT jint JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_addSandboxedPlugin(JNIEnv *env, jclass clazz,
+                                                                  jint position, jstring uri) {
+    if (engine->nativeLibraryDir.empty()) {
+        LOGE("Native library dir not set, cannot start a sandbox");
+        return -1;
     }
+    return addPlugin(env, position, uri, true);
+}
 
-    if (plugin != nullptr) {
-        plugin ->closePlugin();
-        free(plugin);
+static SessionLoader sessionLoader() {
+    return SessionLoader([](const SessionLoader::Slot& s) {
+        return makePlugin(s.uri.c_str(), s.sandboxed && !engine->nativeLibraryDir.empty());
+    }, oboe::DefaultStreamValues::FramesPerBurst);
+}
+
+// Duplicate slot `from` into slot `to`: the state is captured now, the copy
+// is built in the background and replaces `to` once it is ready
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_cloneSlot(JNIEnv *env, jclass clazz, jint from,
+                                                         jint to) {
+    if (engine == nullptr) {
+        LOGE("Engine is null, you must call createEngine before calling this method");
+        return false;
     }
+    return engine->cloner.clone(from, to);
+}
 
-    plugin = new LV2Plugin(engine -> world, env->GetStringUTFChars(uri, nullptr), engine -> sampleRate, 4096);
-    if ( !plugin->initialize()) {
-        LOGE("Failed to initialize plugin %s", env->GetStringUTFChars(uri, nullptr));
-        free ((void*)env->GetStringUTFChars(uri, nullptr));
-        return -1;
-    } else {
-        plugin->start();
-        LOGD("Successfully added plugin %s at position %d", env->GetStringUTFChars(uri, nullptr), position);
-        LOGD ("[plugininfo] %s", engine->pluginInfo[env->GetStringUTFChars(uri, nullptr)].dump(4).c_str());
+// Clones not yet in their slot
+extern "C"
+JNIEXPORT jint JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_getPendingClones(JNIEnv *env, jclass clazz) {
+    return engine == nullptr ? 0 : engine->cloner.pending();
+}
+
+// The picker highlighted uri: warm an instance before it is picked
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_prefetchPlugin(JNIEnv *env, jclass clazz,
+                                                              jstring uri) {
+    if (engine == nullptr || engine->world == nullptr) return;
+    const char * cstr = env->GetStringUTFChars(uri, nullptr);
+    engine->pool.prefetch(cstr, engine->sampleRate);
+    env->ReleaseStringUTFChars(uri, cstr);
+}
+
+// Most warm instances kept, 0 turns the pool off
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_setInstancePoolCapacity(JNIEnv *env, jclass clazz,
+                                                                       jint capacity) {
+    if (engine == nullptr) return;
+    engine->pool.setCapacity((size_t)std::max(0, capacity));
+}
+
+// {pooled, bytes, hits, misses, built, evicted}; bytes is the heap growth
+// seen while building the pooled instances, a hint only (see InstancePool.h)
+extern "C"
+JNIEXPORT jlongArray JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_getInstancePoolStats(JNIEnv *env, jclass clazz) {
+    if (engine == nullptr) return nullptr;
+    const InstancePool::Stats s = engine->pool.stats();
+    const jlong values[] = {(jlong)s.pooled, (jlong)s.bytes, (jlong)s.hits, (jlong)s.misses,
+                            (jlong)s.built, (jlong)s.evicted};
+    jlongArray out = env->NewLongArray(6);
+    env->SetLongArrayRegion(out, 0, 6, values);
+    return out;
+}
 
+// Replace the whole rig. session is
+// {"slots": [{"slot", "uri", "state"?, "sandboxed"?, "controls"?: {"<port>": value}}]};
+// every slot loads in parallel and the chain switches over in one step.
+// Returns the per-slot timings (see SessionLoader.h), or null.
+extern "C"
+JNIEXPORT jstring JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_loadSession(JNIEnv *env, jclass clazz,
+                                                           jstring session) {
+    if (engine == nullptr) {
+        LOGE("Engine is null, you must call createEngine before calling this method");
+        return nullptr;
     }
 
-    switch (position) {
-        case 1:
-            engine->plugin1 = plugin;
-            break;
-        case 2:
-            engine->plugin2 = plugin;
-            break;
-        case 3:
-            engine->plugin3 = plugin;
-            break;
-        case 4:
-            engine->plugin4 = plugin;
-            break;
-        default:
-            LOGE("Unknown plugin index %d", position);
-            return -1;
+    const char * cstr = env->GetStringUTFChars(session, nullptr);
+    json doc = json::parse(cstr, nullptr, false);
+    env->ReleaseStringUTFChars(session, cstr);
+    if (doc.is_discarded() || !doc.contains("slots") || !doc["slots"].is_array()) {
+        LOGE("loadSession: malformed session");
+        return nullptr;
     }
 
-    free ((void*)env->GetStringUTFChars(uri, nullptr));
-    return 0 ;
+    // value(), get() and stoul() throw on a wrong type or a bad port
+    // number, which must not unwind through JNI
+    std::vector<SessionLoader::Slot> slots;
+    try {
+        for (const auto& entry : doc["slots"]) {
+            SessionLoader::Slot s;
+            s.slot = entry.value("slot", 0);
+            s.uri = entry.value("uri", "");
+            s.state = entry.value("state", "");
+            s.sandboxed = entry.value("sandboxed", false);
+            if (entry.contains("controls") && entry["controls"].is_object()) {
+                for (const auto& [port, value] : entry["controls"].items())
+                    s.controls.emplace_back((uint32_t)std::stoul(port), value.get<float>());
+            }
+            slots.push_back(std::move(s));
+        }
+    } catch (const std::exception& e) {
+        LOGE("loadSession: malformed session: %s", e.what());
+        return nullptr;
+    }
+
+    SessionLoader loader = sessionLoader();
+    auto timings = loader.load(engine->chain, slots);
+    return env->NewStringUTF(SessionLoader::toJson(timings, loader.publishedMs()).dump().c_str());
+}
+
+// Binary rig files (see RigFile.h)
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_saveRig(JNIEnv *env, jclass clazz, jstring path) {
+    if (engine == nullptr) {
+        LOGE("Engine is null, you must call createEngine before calling this method");
+        return false;
+    }
+    const char * cstr = env->GetStringUTFChars(path, nullptr);
+    const bool ok = RigFile::save(engine->chain, cstr);
+    env->ReleaseStringUTFChars(path, cstr);
+    return ok;
+}
+
+// Replace the whole rig with the one in the file, same report as loadSession
+extern "C"
+JNIEXPORT jstring JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_loadRig(JNIEnv *env, jclass clazz, jstring path) {
+    if (engine == nullptr) {
+        LOGE("Engine is null, you must call createEngine before calling this method");
+        return nullptr;
+    }
+    RigFile rig;
+    const char * cstr = env->GetStringUTFChars(path, nullptr);
+    const bool opened = rig.open(cstr);
+    env->ReleaseStringUTFChars(path, cstr);
+    if (!opened) return nullptr;
+
+    SessionLoader loader = sessionLoader();
+    auto timings = rig.load(engine->chain, loader);
+    return env->NewStringUTF(SessionLoader::toJson(timings, loader.publishedMs()).dump().c_str());
+}
+
+// Controls only, into the plugins already loaded; returns the slots matched
+extern "C"
+JNIEXPORT jint JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_applyRigControls(JNIEnv *env, jclass clazz,
+                                                                jstring path) {
+    if (engine == nullptr) {
+        LOGE("Engine is null, you must call createEngine before calling this method");
+        return -1;
+    }
+    RigFile rig;
+    const char * cstr = env->GetStringUTFChars(path, nullptr);
+    const bool opened = rig.open(cstr);
+    env->ReleaseStringUTFChars(path, cstr);
+    return opened ? (jint)rig.applyControls(engine->chain) : -1;
+}
+
+// Turtle export: dir/slot-N.ttl and a dir/session.json for loadSession
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_exportRigTurtle(JNIEnv *env, jclass clazz,
+                                                               jstring dir) {
+    if (engine == nullptr) {
+        LOGE("Engine is null, you must call createEngine before calling this method");
+        return false;
+    }
+    const char * cstr = env->GetStringUTFChars(dir, nullptr);
+    const bool ok = RigFile::exportTurtle(engine->chain, cstr);
+    env->ReleaseStringUTFChars(dir, cstr);
+    return ok;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_setNativeLibraryDir(JNIEnv *env, jclass clazz,
+                                                                   jstring path) {
+    const char * cstr = env->GetStringUTFChars(path, nullptr);
+    engine->nativeLibraryDir = cstr;
+    env->ReleaseStringUTFChars(path, cstr);
 }
 
 
@@ -397,6 +609,7 @@ Java_org_acoustixaudio_opiqo_multi_AudioEngine_initPlugins(JNIEnv *env, jclass c
         return ;
     }
 
+    engine -> lv2Path = path;
     engine -> world = lilv_world_new();
     LOGD ("[test] LV2 path set to %s", path.c_str());
 
@@ -430,6 +643,7 @@ Java_org_acoustixaudio_opiqo_multi_AudioEngine_initPlugins(JNIEnv *env, jclass c
             }
             else if (lilv_port_is_a(p, port, lilv_new_uri(engine -> world, LV2_CORE__ControlPort))) {
                 pluginInfo["port"][i]["type"] = "control";
+                pluginInfo["port"][i]["output"] = lilv_port_is_a(p, port, lilv_new_uri(engine -> world, LV2_CORE__OutputPort));
                 LilvNode * def = lilv_new_float(engine -> world, 0.0f);
                 LilvNode * min = lilv_new_float(engine -> world, 0.0f);
                 LilvNode * max = lilv_new_float(engine -> world, 0.0f);
@@ -461,40 +675,521 @@ Java_org_acoustixaudio_opiqo_multi_AudioEngine_getPluginInfo(JNIEnv *env, jclass
         return env->NewStringUTF("{}");
     }
 
+    // Fold in whatever the background profiler has measured so far
+    json costs = engine->costProfiler.toJson();
+    for (auto it = costs.begin(); it != costs.end(); ++it) {
+        if (engine->pluginInfo.contains(it.key()))
+            engine->pluginInfo[it.key()]["cost"] = it.value();
+    }
+
     return env->NewStringUTF(to_string (engine -> pluginInfo).c_str());
 }
 extern "C"
 JNIEXPORT void JNICALL
 Java_org_acoustixaudio_opiqo_multi_AudioEngine_deletePlugin(JNIEnv *env, jclass clazz,
                                                             jint plugin) {
-    switch (plugin) {
-        case 1:
-            if (engine->plugin1) {
-                engine->plugin1 = nullptr;
-                engine->plugin1->closePlugin();
-                free(engine->plugin1);
-            }
-            break;
-        case 2:
-            if (engine->plugin2) {
-                engine->plugin2 = nullptr;
-                engine->plugin2->closePlugin();
-                free(engine->plugin2);
-            }
-            break ;
-        case 3:
-            if (engine->plugin3) {
-                engine->plugin3 = nullptr;
-                engine->plugin3->closePlugin();
-                free(engine->plugin3);
-            }
-            break ;
-        case 4:
-            if (engine->plugin4) {
-                engine->plugin4 = nullptr;
-                engine->plugin4->closePlugin();
-                free(engine->plugin4);
-            }
+    if (!engine->chain.remove(plugin)) {
+        LOGE("Unknown plugin index %d", plugin);
+    }
+}
+extern "C"
+JNIEXPORT jstring JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_benchmarkHost(JNIEnv *env, jclass clazz,
+                                                             jstring uri, jint frames,
+                                                             jint maxSlots) {
+    if (engine == nullptr || engine->world == nullptr) {
+        LOGE("Engine or plugins not initialized, call initPlugins first");
+        return env->NewStringUTF("{}");
+    }
+
+    const char * pluginUri = uri ? env->GetStringUTFChars(uri, nullptr) : nullptr;
+    HostBenchmark bench(engine->world, engine->sampleRate, frames, 2000);
+    json report = bench.run(pluginUri ? pluginUri : HostBenchmark::kReferenceUri, maxSlots);
+    if (pluginUri) env->ReleaseStringUTFChars(uri, pluginUri);
+
+    LOGD("[host benchmark] %s", report.dump().c_str());
+    return env->NewStringUTF(report.dump().c_str());
+}
+
+extern "C"
+JNIEXPORT jobject JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_getMeterBuffer(JNIEnv *env, jclass clazz) {
+    if (engine == nullptr) {
+        LOGE("Engine is null, you must call createEngine before calling this method");
+        return nullptr;
+    }
+
+    // Lives as long as the engine, MeterReader.java mirrors the layout
+    return env->NewDirectByteBuffer(engine->chain.meters(), PluginChain::metersSize());
+}
+
+// DSP→UI atoms: Java owns a buffer the size of the ring, and each poll
+// copies every complete atom pending into it and releases them, in one call
+// under the chain lock. Nothing outside that lock points into the ring, so a
+// slot replaced from any thread cannot free memory Java is still reading.
+extern "C"
+JNIEXPORT jint JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_getAtomRingSize(JNIEnv *env, jclass clazz,
+                                                               jint slot, jint port) {
+    if (engine == nullptr) {
+        LOGE("Engine is null, you must call createEngine before calling this method");
+        return -1;
+    }
+    jint size = -1;
+    engine->chain.withSlot(slot, [&](LV2Plugin* plugin) {
+        lv2_ringbuffer_t* rb = plugin->getAtomOutputRingbuffer((uint32_t) port);
+        if (rb) size = (jint) rb->size;
+    });
+    return size;
+}
+
+// Copy the complete atoms pending in rb, at most cap bytes, to dst and
+// release them from the ring; the writer only ever adds whole atoms, each
+// padded to 8 bytes, and they are copied with their padding
+static size_t readAtoms(lv2_ringbuffer_t* rb, uint8_t* dst, size_t cap) {
+    lv2_ringbuffer_data_t vec[2];
+    const size_t n = std::min(lv2_ringbuffer_get_read_vector(rb, vec), cap);
+    const size_t head = std::min(n, vec[0].len);
+    memcpy(dst, vec[0].buf, head);
+    memcpy(dst + head, vec[1].buf, n - head);
+
+    size_t used = 0;
+    while (n - used >= sizeof(LV2_Atom)) {
+        LV2_Atom atom;
+        memcpy(&atom, dst + used, sizeof(atom));
+        const size_t total = lv2_ringbuffer_padded(sizeof(LV2_Atom) + atom.size);
+        if (total > n - used) break;
+        used += total;
+    }
+    lv2_ringbuffer_read_advance(rb, used);
+    return used;
+}
+
+// Bytes copied into buffer, or -1 if the slot has no atom output at port.
+// info = { dropped messages, high-water mark }
+extern "C"
+JNIEXPORT jint JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_pollAtomRing(JNIEnv *env, jclass clazz,
+                                                            jint slot, jint port,
+                                                            jobject buffer, jlongArray info) {
+    if (engine == nullptr) {
+        LOGE("Engine is null, you must call createEngine before calling this method");
+        return -1;
+    }
+    auto* dst = (uint8_t*) env->GetDirectBufferAddress(buffer);
+    const jlong cap = env->GetDirectBufferCapacity(buffer);
+    if (!dst || cap <= 0) return -1;
+
+    jint bytes = -1;
+    engine->chain.withSlot(slot, [&](LV2Plugin* plugin) {
+        lv2_ringbuffer_t* rb = plugin->getAtomOutputRingbuffer((uint32_t) port);
+        if (!rb) return;
+        bytes = (jint) readAtoms(rb, dst, (size_t) cap);
+        const jlong values[2] = {
+                (jlong) rb->dropped.load(std::memory_order_relaxed),
+                (jlong) rb->high_water.load(std::memory_order_relaxed)
+        };
+        env->SetLongArrayRegion(info, 0, 2, values);
+    });
+    return bytes;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_startCostProfiler(JNIEnv *env, jclass clazz) {
+    if (engine == nullptr || engine->lv2Path.empty()) {
+        LOGE("Engine or plugins not initialized, call initPlugins first");
+        return;
+    }
+
+    std::vector<std::string> uris;
+    for (auto it = engine->pluginInfo.begin(); it != engine->pluginInfo.end(); ++it)
+        uris.push_back(it.key());
 
+    const std::string db = engine->cacheDir.empty() ? "" : engine->cacheDir + "/plugin_costs.json";
+    engine->costProfiler.start(engine->lv2Path, uris, engine->sampleRate,
+                               engine->getBlockSize(), engine->getChannelCount(), db);
+}
+
+// Predicted CPU load (fraction of one core) of the chain with uri placed in
+// slot, or of the current chain when uri is null. -1 if a cost is unknown.
+extern "C"
+JNIEXPORT jdouble JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_predictChainLoad(JNIEnv *env, jclass clazz,
+                                                                jint slot, jstring uri) {
+    if (engine == nullptr) return -1.0;
+
+    std::vector<std::string> uris;
+    for (int s = 1; s <= PluginChain::kSlots; ++s) {
+        if (uri && s == slot) continue;
+        engine->chain.withSlot(s, [&](LV2Plugin* plugin) { uris.push_back(plugin->uri()); });
     }
-}
\ No newline at end of file
+    if (uri) {
+        const char * cstr = env->GetStringUTFChars(uri, nullptr);
+        uris.push_back(cstr);
+        env->ReleaseStringUTFChars(uri, cstr);
+    }
+
+    return engine->costProfiler.predictLoad(uris, engine->sampleRate, engine->getChannelCount());
+}
+
+// Dry/wet (0..1), input and output trim in dB and pan (-1..1) of a slot
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_setSlotMix(JNIEnv *env, jclass clazz, jint slot,
+                                                          jfloat mix, jfloat inTrimDb,
+                                                          jfloat outTrimDb, jfloat pan) {
+    if (engine == nullptr) {
+        LOGE(
+                "Engine is null, you must call createEngine before calling this "
+                "method");
+        return;
+    }
+
+    PluginChain& chain = engine->chain;
+    if (!chain.setMix(slot, mix) ||
+        !chain.setInputTrim(slot, std::pow(10.0f, inTrimDb / 20.0f)) ||
+        !chain.setOutputTrim(slot, std::pow(10.0f, outTrimDb / 20.0f)) ||
+        !chain.setPan(slot, pan)) {
+        LOGE("Cannot set mix of slot %d", slot);
+    }
+}
+
+// The slot's mix as setSlotMix takes it, null for an unknown slot
+extern "C"
+JNIEXPORT jfloatArray JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_getSlotMix(JNIEnv *env, jclass clazz, jint slot) {
+    if (engine == nullptr) {
+        LOGE("Engine is null, you must call createEngine before calling this method");
+        return nullptr;
+    }
+    if (!PluginChain::isValidSlot(slot)) return nullptr;
+
+    const SlotMix& mix = engine->chain.slotMix(slot);
+    auto db = [](float gain) { return 20.0f * std::log10(std::max(gain, 1e-6f)); };
+    const float values[4] = {mix.mix.load(std::memory_order_relaxed),
+                             db(mix.in_trim.load(std::memory_order_relaxed)),
+                             db(mix.out_trim.load(std::memory_order_relaxed)),
+                             mix.pan.load(std::memory_order_relaxed)};
+    jfloatArray ret = env->NewFloatArray(4);
+    env->SetFloatArrayRegion(ret, 0, 4, values);
+    return ret;
+}
+
+// Input conditioning ahead of the chain, see InputStage.h
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_setInputStage(JNIEnv *env, jclass clazz,
+                                                             jboolean dcBlock, jboolean highPass,
+                                                             jfloat highPassHz, jboolean gate,
+                                                             jfloat thresholdDb, jfloat ratio,
+                                                             jfloat attackMs, jfloat releaseMs) {
+    if (engine == nullptr) {
+        LOGE(
+                "Engine is null, you must call createEngine before calling this "
+                "method");
+        return;
+    }
+
+    InputStage& input = engine->inputStage;
+    input.dc_block.store(dcBlock);
+    input.high_pass.store(highPass);
+    input.high_pass_hz.store(highPassHz);
+    input.threshold_db.store(thresholdDb);
+    input.ratio.store(ratio);
+    input.attack_ms.store(attackMs);
+    input.release_ms.store(releaseMs);
+    input.gate.store(gate);
+}
+
+// Output limiter after the last slot, see Limiter.h
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_setLimiter(JNIEnv *env, jclass clazz,
+                                                          jboolean enabled, jfloat ceilingDb,
+                                                          jfloat lookaheadMs, jfloat releaseMs) {
+    if (engine == nullptr) {
+        LOGE(
+                "Engine is null, you must call createEngine before calling this "
+                "method");
+        return;
+    }
+
+    Limiter& limiter = engine->limiter;
+    limiter.ceiling_db.store(std::min(0.0f, ceilingDb));
+    limiter.lookahead_ms.store(lookaheadMs);
+    limiter.release_ms.store(releaseMs);
+    limiter.enabled.store(enabled);
+}
+
+// Limiter gain of the last block, 1 when it is not limiting
+extern "C"
+JNIEXPORT jfloat JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_getLimiterGain(JNIEnv *env, jclass clazz) {
+    if (engine == nullptr) return 1.0f;
+    return engine->limiter.reduction();
+}
+
+// Frames of delay the engine adds on top of the stream latency
+extern "C"
+JNIEXPORT jint JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_getProcessingLatency(JNIEnv *env, jclass clazz) {
+    if (engine == nullptr) return 0;
+    return engine->getProcessingLatency();
+}
+
+// Frames from input to output, streams included
+extern "C"
+JNIEXPORT jint JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_getRoundTripLatency(JNIEnv *env, jclass clazz) {
+    if (engine == nullptr) return 0;
+    return engine->getRoundTripLatency();
+}
+
+// Frames the plugin in slot reported in its last run
+extern "C"
+JNIEXPORT jint JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_getSlotLatency(JNIEnv *env, jclass clazz, jint slot) {
+    if (engine == nullptr) return 0;
+    return (jint)engine->chain.slotLatency(slot);
+}
+
+// Raw MIDI bytes from an Android MidiReceiver, timestamp from System.nanoTime();
+// source tells device ports apart (0 is the file replay)
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_pushMidi(JNIEnv *env, jclass clazz, jint source,
+                                                        jbyteArray msg, jint offset, jint count,
+                                                        jlong timestamp) {
+    if (engine == nullptr || count <= 0) return;
+
+    std::vector<jbyte> bytes(count);
+    env->GetByteArrayRegion(msg, offset, count, bytes.data());
+    engine->midiInput.push((uint32_t) source, reinterpret_cast<const uint8_t *>(bytes.data()),
+                           count, timestamp);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_setMidiSubscribed(JNIEnv *env, jclass clazz,
+                                                                 jint slot, jboolean subscribed) {
+    if (engine == nullptr) return;
+    if (!engine->chain.setMidiSubscribed(slot, subscribed)) {
+        LOGE("Cannot set MIDI input of slot %d", slot);
+    }
+}
+
+// Replay a "<ms> <hex bytes>" script as if it came from a device
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_startMidiReplay(JNIEnv *env, jclass clazz,
+                                                               jstring path, jboolean loop) {
+    if (engine == nullptr) return false;
+    const char * cstr = env->GetStringUTFChars(path, nullptr);
+    const bool started = engine->midiInput.startReplay(cstr, loop);
+    env->ReleaseStringUTFChars(path, cstr);
+    return started;
+}
+
+// Route a modulation source (ModMatrix.h numbering) to a control port
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_addModRoute(JNIEnv *env, jclass clazz, jint source,
+                                                           jint slot, jint port, jfloat min,
+                                                           jfloat max, jfloat curve) {
+    if (engine == nullptr) return false;
+    ModRoute route;
+    route.source = source;
+    route.slot = slot;
+    route.port = (uint32_t)port;
+    route.min = min;
+    route.max = max;
+    route.curve = curve;
+    if (!engine->chain.addModRoute(route)) {
+        LOGE("Cannot add modulation route to slot %d port %d", slot, port);
+        return false;
+    }
+    return true;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_removeModRoutes(JNIEnv *env, jclass clazz, jint slot,
+                                                               jint port) {
+    if (engine == nullptr) return;
+    engine->chain.removeModRoutes(slot, (uint32_t)port);
+}
+
+// MIDI learn: the next CC received is routed to the port, poll for the result
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_learnModRoute(JNIEnv *env, jclass clazz, jint slot,
+                                                             jint port, jfloat min, jfloat max,
+                                                             jfloat curve) {
+    if (engine == nullptr) return;
+    ModRoute route;
+    route.slot = slot;
+    route.port = (uint32_t)port;
+    route.min = min;
+    route.max = max;
+    route.curve = curve;
+    engine->chain.learnModRoute(route);
+}
+
+extern "C"
+JNIEXPORT jint JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_pollModLearn(JNIEnv *env, jclass clazz) {
+    if (engine == nullptr) return -1;
+    return engine->chain.pollModLearn();
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_setLfo(JNIEnv *env, jclass clazz, jint index,
+                                                      jfloat hz, jint shape) {
+    if (engine == nullptr) return;
+    if (index < 0 || index >= ModMatrix::kLfos) {
+        LOGE("No LFO %d", index);
+        return;
+    }
+    ModMatrix::Lfo &lfo = engine->chain.modulation().lfo[index];
+    lfo.hz.store(std::max(0.0f, hz));
+    lfo.shape.store(shape);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_setEnvelope(JNIEnv *env, jclass clazz, jint index,
+                                                           jfloat attackMs, jfloat releaseMs,
+                                                           jfloat gain) {
+    if (engine == nullptr) return;
+    if (index < 0 || index >= ModMatrix::kEnvelopes) {
+        LOGE("No envelope follower %d", index);
+        return;
+    }
+    ModMatrix::Envelope &envelope = engine->chain.modulation().envelope[index];
+    envelope.attack_ms.store(attackMs);
+    envelope.release_ms.store(releaseMs);
+    envelope.gain.store(gain);
+}
+
+// Breakpoints for (slot, port): frames from the start of playback, ascending
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_setAutomationLane(JNIEnv *env, jclass clazz,
+                                                                 jint slot, jint port,
+                                                                 jboolean ramp, jlongArray frames,
+                                                                 jfloatArray values) {
+    if (engine == nullptr) return false;
+    const jsize n = env->GetArrayLength(frames);
+    if (env->GetArrayLength(values) != n) {
+        LOGE("Automation lane needs as many values as frames");
+        return false;
+    }
+    std::vector<jlong> f(n);
+    std::vector<float> v(n);
+    env->GetLongArrayRegion(frames, 0, n, f.data());
+    env->GetFloatArrayRegion(values, 0, n, v.data());
+    if (!engine->chain.setAutomationLane(slot, (uint32_t)port, ramp,
+                                         std::vector<uint64_t>(f.begin(), f.end()), v)) {
+        LOGE("Cannot set automation of slot %d port %d", slot, port);
+        return false;
+    }
+    return true;
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_armAutomation(JNIEnv *env, jclass clazz, jint slot,
+                                                             jint port, jboolean armed) {
+    if (engine == nullptr) return false;
+    return engine->chain.armAutomation(slot, (uint32_t)port, armed);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_clearAutomationLane(JNIEnv *env, jclass clazz,
+                                                                   jint slot, jint port) {
+    if (engine == nullptr) return;
+    engine->chain.clearAutomationLane(slot, (uint32_t)port);
+}
+
+extern "C"
+JNIEXPORT jlongArray JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_getAutomationFrames(JNIEnv *env, jclass clazz,
+                                                                   jint slot, jint port) {
+    std::vector<uint64_t> frames;
+    std::vector<float> values;
+    if (engine != nullptr) engine->chain.automationLane(slot, (uint32_t)port, frames, values);
+    std::vector<jlong> f(frames.begin(), frames.end());
+    jlongArray ret = env->NewLongArray((jsize)f.size());
+    env->SetLongArrayRegion(ret, 0, (jsize)f.size(), f.data());
+    return ret;
+}
+
+extern "C"
+JNIEXPORT jfloatArray JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_getAutomationValues(JNIEnv *env, jclass clazz,
+                                                                   jint slot, jint port) {
+    std::vector<uint64_t> frames;
+    std::vector<float> values;
+    if (engine != nullptr) engine->chain.automationLane(slot, (uint32_t)port, frames, values);
+    jfloatArray ret = env->NewFloatArray((jsize)values.size());
+    env->SetFloatArrayRegion(ret, 0, (jsize)values.size(), values.data());
+    return ret;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_setAutomationTransport(JNIEnv *env, jclass clazz,
+                                                                      jboolean playing,
+                                                                      jboolean recording) {
+    if (engine == nullptr) return;
+    Automation &automation = engine->chain.automation();
+    automation.playing.store(playing);
+    automation.recording.store(recording);
+    if (!recording) engine->chain.commitRecording();
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_locateAutomation(JNIEnv *env, jclass clazz,
+                                                                jlong frame) {
+    if (engine == nullptr) return;
+    engine->chain.automation().locate((uint64_t)std::max<jlong>(0, frame));
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_getAutomationPosition(JNIEnv *env, jclass clazz) {
+    if (engine == nullptr) return 0;
+    return (jlong)engine->chain.automation().position();
+}
+
+// Log counters of the plugin in slot: messages, suppressed, dropped, errors, warnings
+extern "C"
+JNIEXPORT jlongArray JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_getPluginLogStats(JNIEnv *env, jclass clazz,
+                                                                 jint slot) {
+    jlong out[5] = {};
+    if (engine != nullptr) {
+        engine->chain.withSlot(slot, [&](LV2Plugin *p) {
+            const PluginLog::Stats s = p->logStats();
+            out[0] = (jlong)s.messages;
+            out[1] = (jlong)s.suppressed;
+            out[2] = (jlong)s.dropped;
+            out[3] = (jlong)s.errors;
+            out[4] = (jlong)s.warnings;
+        });
+    }
+    jlongArray ret = env->NewLongArray(5);
+    env->SetLongArrayRegion(ret, 0, 5, out);
+    return ret;
+}
+
+// CPU topology and where each helper thread ended up
+extern "C"
+JNIEXPORT jstring JNICALL
+Java_org_acoustixaudio_opiqo_multi_AudioEngine_getThreadReport(JNIEnv *env, jclass clazz) {
+    return env->NewStringUTF(ThreadManager::get().report().c_str());
+}
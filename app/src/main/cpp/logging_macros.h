@@ -16,9 +16,11 @@
  */
 #ifndef __SAMPLE_ANDROID_DEBUG_H__
 #define __SAMPLE_ANDROID_DEBUG_H__
+#ifdef __ANDROID__
 #include <android/log.h>
+#endif
 
-#if 1
+#if defined(__ANDROID__)
 #ifndef MODULE_NAME
 #define MODULE_NAME  "AUDIO-APP"
 #endif
@@ -31,6 +33,18 @@
 #define LOGF(...) __android_log_print(ANDROID_LOG_FATAL,MODULE_NAME, __VA_ARGS__)
 
 #define ASSERT(cond, ...) if (!(cond)) {__android_log_assert(#cond, MODULE_NAME, __VA_ARGS__);}
+#elif defined(__linux__)
+// Host builds (benchmarks, sandbox tests) log to stderr
+#include <cstdio>
+#include <cstdlib>
+
+#define LOGV(...)
+#define LOGD(...) (fprintf(stderr, "D " __VA_ARGS__), fputc('\n', stderr))
+#define LOGI(...) (fprintf(stderr, "I " __VA_ARGS__), fputc('\n', stderr))
+#define LOGW(...) (fprintf(stderr, "W " __VA_ARGS__), fputc('\n', stderr))
+#define LOGE(...) (fprintf(stderr, "E " __VA_ARGS__), fputc('\n', stderr))
+#define LOGF(...) (fprintf(stderr, "F " __VA_ARGS__), fputc('\n', stderr))
+#define ASSERT(cond, ...) if (!(cond)) {LOGF(__VA_ARGS__); abort();}
 #else
 
 #define LOGV(...)
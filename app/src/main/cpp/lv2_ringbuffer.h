@@ -27,8 +27,18 @@ typedef struct {
 
     alignas(64) std::atomic<size_t> write_ptr;
     alignas(64) std::atomic<size_t> read_ptr;
+
+    // Writer-side statistics, readable from any thread
+    alignas(64) std::atomic<uint64_t> dropped;    // messages that did not fit, or were skipped
+    std::atomic<size_t> high_water;               // largest fill level seen
 } lv2_ringbuffer_t;
 
+// One contiguous readable region of the ring
+typedef struct {
+    const uint8_t* buf;
+    size_t len;
+} lv2_ringbuffer_data_t;
+
 static inline bool is_power_of_two(size_t x) {
     return x && !(x & (x - 1));
 }
@@ -52,6 +62,8 @@ static inline lv2_ringbuffer_t* lv2_ringbuffer_create(size_t sz) {
     rb->size_mask = sz - 1;
     rb->write_ptr.store(0, std::memory_order_relaxed);
     rb->read_ptr.store(0, std::memory_order_relaxed);
+    rb->dropped.store(0, std::memory_order_relaxed);
+    rb->high_water.store(0, std::memory_order_relaxed);
 
     return rb;
 }
@@ -102,6 +114,45 @@ static inline size_t lv2_ringbuffer_read(lv2_ringbuffer_t* rb,
     return cnt;
 }
 
+// Readable data as (up to) two segments, the second one non-empty only
+// when the data wraps. Nothing is copied; release with read_advance().
+static inline size_t lv2_ringbuffer_get_read_vector(const lv2_ringbuffer_t* rb,
+                                                    lv2_ringbuffer_data_t vec[2]) {
+
+    size_t avail = lv2_ringbuffer_read_space(rb);
+    size_t r = rb->read_ptr.load(std::memory_order_relaxed) & rb->size_mask;
+    size_t first = rb->size - r;
+    if (first > avail) first = avail;
+
+    vec[0].buf = rb->buf + r;
+    vec[0].len = first;
+    vec[1].buf = rb->buf;
+    vec[1].len = avail - first;
+    return avail;
+}
+
+static inline void lv2_ringbuffer_read_advance(lv2_ringbuffer_t* rb, size_t cnt) {
+
+    size_t avail = lv2_ringbuffer_read_space(rb);
+    if (cnt > avail) cnt = avail;
+    rb->read_ptr.fetch_add(cnt, std::memory_order_release);
+}
+
+// Count a message that was discarded: by the writer for lack of space, or
+// by a reader with no room to copy it
+static inline void lv2_ringbuffer_note_dropped(lv2_ringbuffer_t* rb) {
+
+    rb->dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Writer only: record the fill level after a write
+static inline void lv2_ringbuffer_note_fill(lv2_ringbuffer_t* rb) {
+
+    size_t fill = lv2_ringbuffer_read_space(rb);
+    if (fill > rb->high_water.load(std::memory_order_relaxed))
+        rb->high_water.store(fill, std::memory_order_relaxed);
+}
+
 static inline size_t lv2_ringbuffer_write(lv2_ringbuffer_t* rb,
                                         const char* src, size_t cnt) {
 
@@ -116,3 +167,27 @@ static inline size_t lv2_ringbuffer_write(lv2_ringbuffer_t* rb,
     return cnt;
 }
 
+// Size of a record of cnt bytes once padded to 8 bytes
+static inline size_t lv2_ringbuffer_padded(size_t cnt) {
+
+    return (cnt + 7) & ~(size_t)7;
+}
+
+// Write a whole record padded with zeros to 8 bytes, or nothing if it does
+// not fit. A ring written only this way keeps every record 8-byte aligned
+// (the buffer is 64-byte aligned and its size a power of two), so readers
+// can use a record in place as an LV2_Atom.
+static inline bool lv2_ringbuffer_write_padded(lv2_ringbuffer_t* rb,
+                                               const char* src, size_t cnt) {
+
+    const size_t total = lv2_ringbuffer_padded(cnt);
+    if (lv2_ringbuffer_write_space(rb) < total) return false;
+    size_t w = rb->write_ptr.load(std::memory_order_relaxed);
+
+    for (size_t i = 0; i < total; ++i)
+        rb->buf[(w + i) & rb->size_mask] = i < cnt ? src[i] : 0;
+
+    rb->write_ptr.fetch_add(total, std::memory_order_release);
+    return true;
+}
+
@@ -0,0 +1,515 @@
+/*
+ * opiqo_ref.c
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Reference plugins with known cost and behaviour.
+ *
+ * These exist to calibrate the host, not to be played through: the unity
+ * gain plugins measure pure hosting overhead, "burn" adds a configurable
+ * amount of work per sample, "worker" floods the worker extension, "echo"
+ * round-trips atoms, "alloc" breaks real-time rules on purpose so the
+ * safety checks have something to catch and "delay" reports latency. All of
+ * them pass audio through unchanged (delay only shifts it) so they can sit
+ * anywhere in a chain.
+ */
+
+#include "lv2/atom/atom.h"
+#include "lv2/atom/util.h"
+#include "lv2/core/lv2.h"
+#include "lv2/core/lv2_util.h"
+#include "lv2/urid/urid.h"
+#include "lv2/worker/worker.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define OPIQO_REF_URI "http://acoustixaudio.org/plugins/opiqo-ref"
+
+// ============================================================================
+// Shared
+// ============================================================================
+
+static void
+copy_audio(const float* in, float* out, uint32_t n_samples)
+{
+    if (in && out && in != out) {
+        memcpy(out, in, sizeof(float) * n_samples);
+    }
+}
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static float
+clamp_port(const float* port, float lo, float hi)
+{
+    const float v = port ? *port : lo;
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+// ============================================================================
+// unity / unity-stereo - copy in to out
+// ============================================================================
+
+typedef struct {
+    const float* in[2];
+    float*       out[2];
+    uint32_t     channels;
+} Unity;
+
+static LV2_Handle
+unity_instantiate(uint32_t channels)
+{
+    Unity* self = (Unity*)calloc(1, sizeof(Unity));
+    if (self) {
+        self->channels = channels;
+    }
+    return (LV2_Handle)self;
+}
+
+static LV2_Handle
+unity_mono_instantiate(const LV2_Descriptor*     descriptor,
+                       double                    rate,
+                       const char*               bundle_path,
+                       const LV2_Feature* const* features)
+{
+    return unity_instantiate(1);
+}
+
+static LV2_Handle
+unity_stereo_instantiate(const LV2_Descriptor*     descriptor,
+                         double                    rate,
+                         const char*               bundle_path,
+                         const LV2_Feature* const* features)
+{
+    return unity_instantiate(2);
+}
+
+// Ports: in[0..channels), out[channels..2*channels)
+static void
+unity_connect_port(LV2_Handle instance, uint32_t port, void* data)
+{
+    Unity* self = (Unity*)instance;
+    if (port < self->channels) {
+        self->in[port] = (const float*)data;
+    } else if (port < 2 * self->channels) {
+        self->out[port - self->channels] = (float*)data;
+    }
+}
+
+static void
+unity_run(LV2_Handle instance, uint32_t n_samples)
+{
+    Unity* self = (Unity*)instance;
+    for (uint32_t c = 0; c < self->channels; ++c) {
+        copy_audio(self->in[c], self->out[c], n_samples);
+    }
+}
+
+// ============================================================================
+// burn - busy-loop for a fixed number of nanoseconds per sample
+// ============================================================================
+
+typedef enum { BURN_IN = 0, BURN_OUT = 1, BURN_NS = 2 } BurnPort;
+
+typedef struct {
+    const float* in;
+    float*       out;
+    const float* ns_per_sample;
+} Burn;
+
+static LV2_Handle
+burn_instantiate(const LV2_Descriptor*     descriptor,
+                 double                    rate,
+                 const char*               bundle_path,
+                 const LV2_Feature* const* features)
+{
+    return (LV2_Handle)calloc(1, sizeof(Burn));
+}
+
+static void
+burn_connect_port(LV2_Handle instance, uint32_t port, void* data)
+{
+    Burn* self = (Burn*)instance;
+    switch ((BurnPort)port) {
+    case BURN_IN: self->in = (const float*)data; break;
+    case BURN_OUT: self->out = (float*)data; break;
+    case BURN_NS: self->ns_per_sample = (const float*)data; break;
+    }
+}
+
+static void
+burn_run(LV2_Handle instance, uint32_t n_samples)
+{
+    Burn*          self     = (Burn*)instance;
+    const uint64_t budget   = (uint64_t)clamp_port(self->ns_per_sample, 0.0f, 100000.0f) * n_samples;
+    const uint64_t deadline = now_ns() + budget;
+
+    copy_audio(self->in, self->out, n_samples);
+
+    // Spin on the clock rather than a calibrated loop count, so the cost
+    // is the same on every core type and frequency
+    while (budget && now_ns() < deadline) {
+    }
+}
+
+// ============================================================================
+// worker - schedule a batch of jobs every cycle
+// ============================================================================
+
+typedef enum {
+    WORKER_IN        = 0,
+    WORKER_OUT       = 1,
+    WORKER_JOBS      = 2,
+    WORKER_JOB_US    = 3,
+    WORKER_RESPONSES = 4,
+    WORKER_DROPPED   = 5
+} WorkerPort;
+
+typedef struct {
+    uint64_t sequence;
+    uint32_t job_us;
+} WorkerJob;
+
+typedef struct {
+    LV2_Worker_Schedule* schedule;
+
+    const float* in;
+    float*       out;
+    const float* jobs;
+    const float* job_us;
+    float*       responses_port;
+    float*       dropped_port;
+
+    uint64_t sequence;
+    uint64_t responses;
+    uint64_t dropped;
+} Worker;
+
+static LV2_Handle
+worker_instantiate(const LV2_Descriptor*     descriptor,
+                   double                    rate,
+                   const char*               bundle_path,
+                   const LV2_Feature* const* features)
+{
+    LV2_Worker_Schedule* schedule = NULL;
+    const char* missing = lv2_features_query(
+        features, LV2_WORKER__schedule, &schedule, true, NULL);
+    if (missing) {
+        return NULL;
+    }
+
+    Worker* self = (Worker*)calloc(1, sizeof(Worker));
+    if (self) {
+        self->schedule = schedule;
+    }
+    return (LV2_Handle)self;
+}
+
+static void
+worker_connect_port(LV2_Handle instance, uint32_t port, void* data)
+{
+    Worker* self = (Worker*)instance;
+    switch ((WorkerPort)port) {
+    case WORKER_IN: self->in = (const float*)data; break;
+    case WORKER_OUT: self->out = (float*)data; break;
+    case WORKER_JOBS: self->jobs = (const float*)data; break;
+    case WORKER_JOB_US: self->job_us = (const float*)data; break;
+    case WORKER_RESPONSES: self->responses_port = (float*)data; break;
+    case WORKER_DROPPED: self->dropped_port = (float*)data; break;
+    }
+}
+
+static void
+worker_run(LV2_Handle instance, uint32_t n_samples)
+{
+    Worker*        self   = (Worker*)instance;
+    const uint32_t jobs   = (uint32_t)clamp_port(self->jobs, 0.0f, 64.0f);
+    const uint32_t job_us = (uint32_t)clamp_port(self->job_us, 0.0f, 10000.0f);
+
+    copy_audio(self->in, self->out, n_samples);
+
+    for (uint32_t i = 0; i < jobs; ++i) {
+        const WorkerJob job = {self->sequence++, job_us};
+        if (self->schedule->schedule_work(
+                self->schedule->handle, sizeof(job), &job) != LV2_WORKER_SUCCESS) {
+            ++self->dropped;
+        }
+    }
+
+    if (self->responses_port) {
+        *self->responses_port = (float)self->responses;
+    }
+    if (self->dropped_port) {
+        *self->dropped_port = (float)self->dropped;
+    }
+}
+
+// Non-realtime: burn job_us on the worker thread and echo the job back
+static LV2_Worker_Status
+worker_work(LV2_Handle                  instance,
+            LV2_Worker_Respond_Function respond,
+            LV2_Worker_Respond_Handle   handle,
+            uint32_t                    size,
+            const void*                 data)
+{
+    if (size != sizeof(WorkerJob)) {
+        return LV2_WORKER_ERR_UNKNOWN;
+    }
+
+    const WorkerJob* job      = (const WorkerJob*)data;
+    const uint64_t   deadline = now_ns() + (uint64_t)job->job_us * 1000u;
+    while (now_ns() < deadline) {
+    }
+
+    return respond(handle, size, data);
+}
+
+static LV2_Worker_Status
+worker_work_response(LV2_Handle instance, uint32_t size, const void* data)
+{
+    Worker* self = (Worker*)instance;
+    ++self->responses;
+    return LV2_WORKER_SUCCESS;
+}
+
+static const void*
+worker_extension_data(const char* uri)
+{
+    static const LV2_Worker_Interface worker = {
+        worker_work, worker_work_response, NULL};
+    return strcmp(uri, LV2_WORKER__interface) ? NULL : &worker;
+}
+
+// ============================================================================
+// echo - copy every input atom event to the output sequence
+// ============================================================================
+
+typedef enum { ECHO_IN = 0, ECHO_OUT = 1, ECHO_EVENTS_IN = 2, ECHO_EVENTS_OUT = 3 } EchoPort;
+
+typedef struct {
+    LV2_URID atom_Sequence;
+
+    const float*             in;
+    float*                   out;
+    const LV2_Atom_Sequence* events_in;
+    LV2_Atom_Sequence*       events_out;
+} Echo;
+
+static LV2_Handle
+echo_instantiate(const LV2_Descriptor*     descriptor,
+                 double                    rate,
+                 const char*               bundle_path,
+                 const LV2_Feature* const* features)
+{
+    LV2_URID_Map* map = NULL;
+    const char* missing = lv2_features_query(
+        features, LV2_URID__map, &map, true, NULL);
+    if (missing) {
+        return NULL;
+    }
+
+    Echo* self = (Echo*)calloc(1, sizeof(Echo));
+    if (self) {
+        self->atom_Sequence = map->map(map->handle, LV2_ATOM__Sequence);
+    }
+    return (LV2_Handle)self;
+}
+
+static void
+echo_connect_port(LV2_Handle instance, uint32_t port, void* data)
+{
+    Echo* self = (Echo*)instance;
+    switch ((EchoPort)port) {
+    case ECHO_IN: self->in = (const float*)data; break;
+    case ECHO_OUT: self->out = (float*)data; break;
+    case ECHO_EVENTS_IN: self->events_in = (const LV2_Atom_Sequence*)data; break;
+    case ECHO_EVENTS_OUT: self->events_out = (LV2_Atom_Sequence*)data; break;
+    }
+}
+
+static void
+echo_run(LV2_Handle instance, uint32_t n_samples)
+{
+    Echo* self = (Echo*)instance;
+
+    copy_audio(self->in, self->out, n_samples);
+
+    if (!self->events_out) {
+        return;
+    }
+
+    // The host sets atom.size to the capacity of the output buffer
+    const uint32_t capacity = self->events_out->atom.size;
+    lv2_atom_sequence_clear(self->events_out);
+    self->events_out->atom.type = self->atom_Sequence;
+
+    if (!self->events_in) {
+        return;
+    }
+
+    LV2_ATOM_SEQUENCE_FOREACH (self->events_in, ev) {
+        if (!lv2_atom_sequence_append_event(self->events_out, capacity, ev)) {
+            break;
+        }
+    }
+}
+
+// ============================================================================
+// alloc - allocate and free on the audio thread (deliberately unsafe)
+// ============================================================================
+
+typedef enum { ALLOC_IN = 0, ALLOC_OUT = 1, ALLOC_BYTES = 2 } AllocPort;
+
+typedef struct {
+    const float* in;
+    float*       out;
+    const float* bytes;
+} Alloc;
+
+static LV2_Handle
+alloc_instantiate(const LV2_Descriptor*     descriptor,
+                  double                    rate,
+                  const char*               bundle_path,
+                  const LV2_Feature* const* features)
+{
+    return (LV2_Handle)calloc(1, sizeof(Alloc));
+}
+
+static void
+alloc_connect_port(LV2_Handle instance, uint32_t port, void* data)
+{
+    Alloc* self = (Alloc*)instance;
+    switch ((AllocPort)port) {
+    case ALLOC_IN: self->in = (const float*)data; break;
+    case ALLOC_OUT: self->out = (float*)data; break;
+    case ALLOC_BYTES: self->bytes = (const float*)data; break;
+    }
+}
+
+static void
+alloc_run(LV2_Handle instance, uint32_t n_samples)
+{
+    Alloc*       self  = (Alloc*)instance;
+    const size_t bytes = (size_t)clamp_port(self->bytes, 1.0f, 16777216.0f);
+
+    // Touch every page so the allocator cannot hand back untouched memory
+    volatile char* scratch = (volatile char*)malloc(bytes);
+    if (scratch) {
+        for (size_t i = 0; i < bytes; i += 4096) {
+            scratch[i] = (char)i;
+        }
+        free((void*)scratch);
+    }
+
+    copy_audio(self->in, self->out, n_samples);
+}
+
+// ============================================================================
+// delay - pure delay of a whole number of frames, reported as latency
+// ============================================================================
+
+#define DELAY_MAX 8192
+
+typedef enum {
+    DELAY_IN      = 0,
+    DELAY_OUT     = 1,
+    DELAY_FRAMES  = 2,
+    DELAY_LATENCY = 3
+} DelayPort;
+
+typedef struct {
+    const float* in;
+    float*       out;
+    const float* frames;
+    float*       latency;
+    uint32_t     pos;
+    float        line[DELAY_MAX];
+} Delay;
+
+static LV2_Handle
+delay_instantiate(const LV2_Descriptor*     descriptor,
+                  double                    rate,
+                  const char*               bundle_path,
+                  const LV2_Feature* const* features)
+{
+    return (LV2_Handle)calloc(1, sizeof(Delay));
+}
+
+static void
+delay_connect_port(LV2_Handle instance, uint32_t port, void* data)
+{
+    Delay* self = (Delay*)instance;
+    switch ((DelayPort)port) {
+    case DELAY_IN: self->in = (const float*)data; break;
+    case DELAY_OUT: self->out = (float*)data; break;
+    case DELAY_FRAMES: self->frames = (const float*)data; break;
+    case DELAY_LATENCY: self->latency = (float*)data; break;
+    }
+}
+
+static void
+delay_run(LV2_Handle instance, uint32_t n_samples)
+{
+    Delay*         self   = (Delay*)instance;
+    const uint32_t frames = (uint32_t)clamp_port(self->frames, 0.0f, DELAY_MAX - 1);
+
+    for (uint32_t i = 0; i < n_samples; ++i) {
+        self->line[self->pos] = self->in[i];
+        self->out[i] = self->line[(self->pos + DELAY_MAX - frames) % DELAY_MAX];
+        self->pos = (self->pos + 1) % DELAY_MAX;
+    }
+
+    if (self->latency) {
+        *self->latency = (float)frames;
+    }
+}
+
+// ============================================================================
+// Descriptors
+// ============================================================================
+
+static void
+ref_cleanup(LV2_Handle instance)
+{
+    free(instance);
+}
+
+static const void*
+ref_extension_data(const char* uri)
+{
+    return NULL;
+}
+
+static const LV2_Descriptor descriptors[] = {
+    {OPIQO_REF_URI "#unity", unity_mono_instantiate, unity_connect_port,
+     NULL, unity_run, NULL, ref_cleanup, ref_extension_data},
+    {OPIQO_REF_URI "#unity-stereo", unity_stereo_instantiate, unity_connect_port,
+     NULL, unity_run, NULL, ref_cleanup, ref_extension_data},
+    {OPIQO_REF_URI "#burn", burn_instantiate, burn_connect_port,
+     NULL, burn_run, NULL, ref_cleanup, ref_extension_data},
+    {OPIQO_REF_URI "#worker", worker_instantiate, worker_connect_port,
+     NULL, worker_run, NULL, ref_cleanup, worker_extension_data},
+    {OPIQO_REF_URI "#echo", echo_instantiate, echo_connect_port,
+     NULL, echo_run, NULL, ref_cleanup, ref_extension_data},
+    {OPIQO_REF_URI "#alloc", alloc_instantiate, alloc_connect_port,
+     NULL, alloc_run, NULL, ref_cleanup, ref_extension_data},
+    {OPIQO_REF_URI "#delay", delay_instantiate, delay_connect_port,
+     NULL, delay_run, NULL, ref_cleanup, ref_extension_data},
+};
+
+LV2_SYMBOL_EXPORT const LV2_Descriptor*
+lv2_descriptor(uint32_t index)
+{
+    return index < sizeof(descriptors) / sizeof(descriptors[0])
+               ? &descriptors[index]
+               : NULL;
+}
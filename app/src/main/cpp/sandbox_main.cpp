@@ -0,0 +1,140 @@
+/*
+ * sandbox_main.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Out-of-process plugin host, spawned by SandboxHost.
+ *
+ *   libopiqo_sandbox.so <shm fd> <lv2 path> <plugin uri> <rate> <max frames>
+ *
+ * Instantiates one plugin with LV2Plugin, exactly as the app would, then
+ * serves blocks from the shared memory until the app goes away. A crash in
+ * the plugin ends only this process; the app's watchdog starts a new one.
+ */
+
+#include "logging_macros.h"
+#include "LV2Plugin.hpp"
+#include "SandboxShm.h"
+
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <signal.h>
+
+#include <cstdlib>
+#include <cstring>
+
+static SandboxShm* map_shm(int fd) {
+    void* mem = mmap(nullptr, sizeof(SandboxShm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) return nullptr;
+    auto* shm = static_cast<SandboxShm*>(mem);
+    if (shm->magic != SandboxShm::kMagic || shm->version != SandboxShm::kVersion) return nullptr;
+    return shm;
+}
+
+// UI→DSP atoms the app queued for this block
+static void read_atoms_in(SandboxShm* shm, LV2Plugin& plugin) {
+    uint32_t offset = 0;
+    while (offset + sizeof(SandboxShm::AtomRecord) <= shm->atom_in_bytes) {
+        const auto* rec = (const SandboxShm::AtomRecord*)(shm->atom_in + offset);
+        plugin.queueAtom(rec->port, rec->type, rec + 1, rec->size);
+        offset += (sizeof(*rec) + rec->size + 7) & ~7u;
+    }
+}
+
+// DSP→UI atoms the plugin produced in this block
+static void write_atoms_out(SandboxShm* shm, LV2Plugin& plugin) {
+    uint32_t offset = 0;
+    for (const auto& p : plugin.ports_) {
+        if (!p.is_atom || p.is_input) continue;
+        LV2Plugin::readAtomMessages(p.atom_state->dsp_to_ui, [&](const LV2_Atom* atom) {
+            const uint32_t total = (sizeof(SandboxShm::AtomRecord) + atom->size + 7) & ~7u;
+            if (offset + total > SandboxShm::kAtomBytes) return;
+            auto* rec = (SandboxShm::AtomRecord*)(shm->atom_out + offset);
+            rec->port = p.index;
+            rec->pad = 0;
+            rec->size = atom->size;
+            rec->type = atom->type;
+            memcpy(rec + 1, atom + 1, atom->size);
+            offset += total;
+        });
+    }
+    shm->atom_out_bytes = offset;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 6) {
+        LOGE("[sandbox] usage: %s <fd> <lv2 path> <uri> <rate> <max frames>", argv[0]);
+        return 2;
+    }
+
+    // Never outlive the app
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if (getppid() == 1) return 0;
+
+    SandboxShm* shm = map_shm(atoi(argv[1]));
+    if (!shm) {
+        LOGE("[sandbox] Bad shared memory on fd %s", argv[1]);
+        return 2;
+    }
+
+    LilvWorld* world = lilv_world_new();
+    LilvNode* path = lilv_new_string(world, argv[2]);
+    lilv_world_set_option(world, LILV_OPTION_LV2_PATH, path);
+    lilv_node_free(path);
+    lilv_world_load_all(world);
+
+    const uint32_t max_frames = std::min<uint32_t>(atoi(argv[5]), SandboxShm::kMaxFrames);
+    LV2Plugin plugin(world, argv[3], atof(argv[4]), max_frames);
+    if (!plugin.initialize()) {
+        LOGE("[sandbox] Failed to initialize %s", argv[3]);
+        return 1;
+    }
+
+    // Start from the controls in the block: the defaults on first launch,
+    // the slot's last settings after a restart
+    for (const auto& p : plugin.ports_) {
+        if (p.is_control && p.is_input && p.index < SandboxShm::kMaxPorts)
+            plugin.setControlValue(p.index, shm->controls[p.index]);
+    }
+    plugin.start();
+
+    // Whatever the previous sandbox left unanswered is dropped
+    uint32_t seen = shm->request.load(std::memory_order_acquire);
+    shm->reply.store(seen, std::memory_order_release);
+    shm->ready.store(1, std::memory_order_release);
+    sandbox_futex_wake(&shm->ready);
+    LOGD("[sandbox] %s ready", argv[3]);
+
+    for (;;) {
+        uint32_t request = shm->request.load(std::memory_order_acquire);
+        if (request == seen) {
+            if (!sandbox_futex_wait(&shm->request, seen, 1000000000) && getppid() == 1) break;
+            continue;
+        }
+        seen = request;
+
+        for (const auto& p : plugin.ports_) {
+            if (p.is_control && p.is_input && p.index < SandboxShm::kMaxPorts)
+                plugin.setControlValue(p.index, shm->controls[p.index]);
+        }
+        read_atoms_in(shm, plugin);
+        plugin.setMidiInput(shm->midi, std::min(shm->midi_count, SandboxShm::kMaxMidi));
+
+        const uint32_t frames = std::min(shm->frames, max_frames);
+        plugin.process(shm->audio_in, shm->audio_out, (int)frames);
+
+        for (const auto& p : plugin.ports_) {
+            if (p.is_control && !p.is_input && p.index < SandboxShm::kMaxPorts)
+                shm->controls[p.index] = p.control;
+        }
+        write_atoms_out(shm, plugin);
+
+        shm->blocks.fetch_add(1, std::memory_order_relaxed);
+        shm->reply.store(seen, std::memory_order_release);
+        sandbox_futex_wake(&shm->reply);
+    }
+
+    plugin.closePlugin();
+    lilv_world_free(world);
+    return 0;
+}
@@ -0,0 +1,254 @@
+/*
+ * chain_stress.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * PluginChain mutated from several threads while a callback thread runs
+ * process() at real-time cadence, to check the in_cycle_/cycle_ grace
+ * period: no plugin or snapshot is freed while the callback can still be
+ * using it, and the callback never waits on a writer.
+ *
+ * The writers replace, remove and reorder slots, swap whole rigs, move
+ * controls and load presets: a preset file into a running plugin
+ * (loadState), a control-only rig preset (RigFile::applyControls) and a
+ * whole rig through SessionLoader (RigFile::load).
+ *
+ * Built twice, with ThreadSanitizer (chain_stress_tsan) and with
+ * AddressSanitizer (chain_stress_asan); a data race or a use after free is
+ * reported by the sanitizer and fails the test. So does a callback whose
+ * CPU time exceeds its period, or, when the callback thread got
+ * SCHED_FIFO and so cannot be preempted by the writers, whose wall time
+ * does. Wall time is not checked under ThreadSanitizer: its runtime routes
+ * atomics and allocation through locks of its own, which a preempted writer
+ * may hold while the callback waits for it. The plugins are the reference unity and delay plugins behind
+ * FakeLilv.h.
+ *
+ *   chain_stress [seconds]
+ */
+
+#include "PluginChain.h"
+#include "RigFile.h"
+#include "SessionLoader.h"
+#include "ThreadManager.h"
+#include "fake/FakeLilv.h"
+
+#include <time.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr double kRate = 48000;
+constexpr int kChannels = 2;
+constexpr int kFrames = 128;
+constexpr int64_t kPeriodNs = (int64_t)(1e9 * kFrames / kRate);
+
+#if defined(__SANITIZE_THREAD__)
+constexpr bool kCheckWall = false;
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+constexpr bool kCheckWall = false;
+#else
+constexpr bool kCheckWall = true;
+#endif
+#else
+constexpr bool kCheckWall = true;
+#endif
+
+LilvWorld* world = nullptr;
+
+LV2Plugin* load(std::mt19937& rng) {
+    const bool delay = rng() & 1;
+    auto* plugin = new LV2Plugin(world, delay ? fakelilv::kDelay : fakelilv::kUnity, kRate, 4096);
+    if (!plugin->initialize()) {
+        delete plugin;
+        return nullptr;
+    }
+    plugin->start();
+    if (delay) plugin->setControlValue(2, (float)(rng() % 256));
+    return plugin;
+}
+
+int64_t threadCpuNs() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+
+    world = fakelilv::newWorld();
+    fakelilv::addOpiqoRef(world, OPIQO_REF_LIB);
+
+    char dir[] = "/tmp/opiqo-stress-XXXXXX";
+    const std::string tmp = mkdtemp(dir);
+    const std::string delayPreset = tmp + "/delay.preset";
+    fakelilv::writeState(delayPreset, fakelilv::kDelay, {{"frames", 48.0f}});
+
+    std::atomic<bool> running{true};
+    std::atomic<uint64_t> blocks{0}, mutations{0}, presets{0};
+    std::atomic<int64_t> maxCpuNs{0}, maxWallNs{0};
+    bool finite = true, fifo = false, rigSaved = false;
+    {
+        PluginChain chain;
+        chain.modulation().prepare(kRate);
+
+        // The rig the preset writer loads: a delay with its mix, then unity
+        RigFile rig;
+        {
+            std::mt19937 rng(0);
+            PluginChain::Slots initial;
+            while (!(initial.plugin[0] = load(rng)) || strcmp(initial.plugin[0]->uri(), fakelilv::kDelay))
+                delete initial.plugin[0];
+            initial.plugin[1] = new LV2Plugin(world, fakelilv::kUnity, kRate, 4096);
+            initial.plugin[1]->initialize();
+            initial.plugin[1]->start();
+            chain.replaceAll(initial);
+            chain.setMix(1, 0.5f);
+            rigSaved = RigFile::save(chain, tmp + "/rig.opqr") && rig.open(tmp + "/rig.opqr");
+        }
+
+        // The callback: one block per period, as a device at its burst size.
+        // A late callback is not made up for with a burst of early ones.
+        std::thread audio([&] {
+            fifo = ThreadManager::get().place(ThreadManager::Role::Realtime, "stress-callback").fifo;
+            std::vector<float> in(kFrames * kChannels), out(kFrames * kChannels);
+            uint64_t t = 0;
+            auto deadline = std::chrono::steady_clock::now();
+            while (running.load(std::memory_order_relaxed)) {
+                deadline += std::chrono::nanoseconds(kPeriodNs);
+                const auto now = std::chrono::steady_clock::now();
+                if (deadline < now) deadline = now;
+                std::this_thread::sleep_until(deadline);
+
+                for (int i = 0; i < kFrames * kChannels; ++i, ++t)
+                    in[i] = (float)std::sin(0.01 * (double)t);
+                const int64_t cpu = threadCpuNs();
+                const auto start = std::chrono::steady_clock::now();
+                chain.process(in.data(), out.data(), kFrames * kChannels, kChannels);
+                const int64_t wall = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start).count();
+                maxCpuNs.store(std::max(maxCpuNs.load(), threadCpuNs() - cpu));
+                maxWallNs.store(std::max(maxWallNs.load(), wall));
+
+                for (float s : out) finite = finite && std::isfinite(s);
+                blocks.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+
+        // Slot by slot: replace, remove, swap
+        auto slots = [&](unsigned seed) {
+            std::mt19937 rng(seed);
+            while (running.load(std::memory_order_relaxed)) {
+                const int slot = 1 + (int)(rng() % PluginChain::kSlots);
+                switch (rng() % 4) {
+                    case 0:
+                    case 1:
+                        chain.replace(slot, load(rng));
+                        break;
+                    case 2:
+                        chain.remove(slot);
+                        break;
+                    default:
+                        chain.swap(slot, 1 + (int)(rng() % PluginChain::kSlots));
+                        break;
+                }
+                mutations.fetch_add(1, std::memory_order_relaxed);
+            }
+        };
+
+        // The whole rig at once, as a session or rig load does
+        auto rigs = [&](unsigned seed) {
+            std::mt19937 rng(seed);
+            while (running.load(std::memory_order_relaxed)) {
+                PluginChain::Slots rig;
+                for (auto*& p : rig.plugin) p = rng() % 3 ? load(rng) : nullptr;
+                chain.replaceAll(rig);
+                mutations.fetch_add(1, std::memory_order_relaxed);
+            }
+        };
+
+        // Everything else the UI does while playing
+        auto controls = [&](unsigned seed) {
+            std::mt19937 rng(seed);
+            while (running.load(std::memory_order_relaxed)) {
+                const int slot = 1 + (int)(rng() % PluginChain::kSlots);
+                chain.setMix(slot, (float)(rng() % 100) / 100.0f);
+                chain.setPan(slot, (float)(rng() % 200) / 100.0f - 1.0f);
+                chain.setValue(slot, 2, (float)(rng() % 256));
+                chain.withSlot(slot, [](LV2Plugin* p) { (void)p->latency(); });
+                (void)chain.latency();
+                mutations.fetch_add(1, std::memory_order_relaxed);
+            }
+        };
+
+        // Presets: into a running plugin, controls only, and the whole rig
+        auto preset = [&](unsigned seed) {
+            std::mt19937 rng(seed);
+            SessionLoader loader([](const SessionLoader::Slot& s) {
+                return new LV2Plugin(world, s.uri.c_str(), kRate, 4096);
+            }, kFrames);
+            while (running.load(std::memory_order_relaxed)) {
+                switch (rng() % 3) {
+                    case 0:
+                        chain.withSlot(1 + (int)(rng() % PluginChain::kSlots), [&](LV2Plugin* p) {
+                            if (strcmp(p->uri(), fakelilv::kDelay) == 0) p->loadState(delayPreset);
+                        });
+                        break;
+                    case 1:
+                        rig.applyControls(chain);
+                        break;
+                    default:
+                        rig.load(chain, loader);
+                        break;
+                }
+                presets.fetch_add(1, std::memory_order_relaxed);
+            }
+        };
+
+        std::vector<std::thread> writers;
+        writers.emplace_back(slots, 1u);
+        writers.emplace_back(slots, 2u);
+        writers.emplace_back(rigs, 3u);
+        writers.emplace_back(controls, 4u);
+        writers.emplace_back(preset, 5u);
+
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        running.store(false);
+        for (auto& w : writers) w.join();
+        audio.join();
+    }
+    lilv_world_free(world);
+    std::filesystem::remove_all(tmp);
+
+    printf("chain_stress: %llu blocks, %llu mutations, %llu presets, callback max %.1f us cpu, "
+           "%.1f us wall%s, period %.1f us\n",
+           (unsigned long long)blocks.load(), (unsigned long long)mutations.load(),
+           (unsigned long long)presets.load(), maxCpuNs.load() / 1e3, maxWallNs.load() / 1e3,
+           fifo ? " (SCHED_FIFO)" : "", kPeriodNs / 1e3);
+    int failures = 0;
+    auto check = [&](bool ok, const char* what) {
+        if (!ok) {
+            fprintf(stderr, "FAIL: %s\n", what);
+            ++failures;
+        }
+    };
+    check(rigSaved, "rig preset written and mapped");
+    check(finite, "output is finite");
+    check(blocks.load() && mutations.load() && presets.load(), "every thread ran");
+    check(maxCpuNs.load() < kPeriodNs, "callback CPU time within its period");
+    check(!fifo || !kCheckWall || maxWallNs.load() < kPeriodNs, "callback wall time within its period");
+    return failures ? 1 : 0;
+}
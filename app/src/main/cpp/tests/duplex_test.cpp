@@ -0,0 +1,260 @@
+/*
+ * duplex_test.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * FullDuplexPass driven by scripted sequences of callbacks, as a device
+ * would: steady blocks, jitter, less input than output and the other way
+ * round, each scenario on a fresh engine. The chain is the real one, with
+ * reference plugins behind FakeLilv.h: a delay reporting its latency at
+ * half mix, then a unity plugin with output trim and pan, between the input
+ * stage and the limiter.
+ *
+ * The output of every callback is compared with golden/duplex_<scenario>.txt,
+ * one sample per line. The first line of that file is the scenario's cost
+ * baseline: median ns per frame of a callback divided by the ns per sample
+ * of a fixed calibration loop, so it carries over between hosts and load.
+ * A scenario fails when it costs kRegression times its baseline.
+ *
+ *   duplex_test <golden dir> <scenario>            compare
+ *   duplex_test <golden dir> <scenario> --update   rewrite the golden file
+ */
+
+#include <oboe/Oboe.h>
+
+#include "FullDuplexPass.h"
+#include "fake/FakeLilv.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr double kRate = 48000;
+constexpr int kChannels = 2;
+constexpr float kTolerance = 1e-5f;
+constexpr uint32_t kDelaySamples = 32;  // of the interleaved stream
+constexpr double kRegression = 2.0;     // of the baseline cost
+constexpr int kTimingRuns = 200;        // of the script, after the checked one
+
+struct Callback {
+    int input;      // frames
+    int output;
+};
+
+struct Scenario {
+    const char* name;
+    std::vector<Callback> script;
+};
+
+// What a device might do: a steady burst, jitter, and the two streams
+// briefly out of step
+const Scenario kScenarios[] = {
+        {"steady", {{192, 192}, {192, 192}, {192, 192}, {192, 192}, {192, 192}, {192, 192}}},
+        {"jitter", {{192, 192}, {64, 64}, {256, 256}, {96, 96}, {288, 288}, {192, 192}}},
+        {"short_input", {{192, 192}, {128, 192}, {192, 192}, {128, 192}}},
+        {"short_output", {{192, 192}, {192, 160}, {192, 192}, {192, 160}}},
+};
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+double median(std::vector<double> v) {
+    if (v.empty()) return 0.0;
+    std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+    return v[v.size() / 2];
+}
+
+// ns per sample of a fixed one-pole filter: the unit scenario costs are
+// expressed in, so they compare across hosts and across load on one host
+double calibrate() {
+    std::vector<float> buf(4096, 0.5f);
+    std::vector<double> runs;
+    volatile float sink = 0.0f;
+    for (int r = 0; r < 31; ++r) {
+        const auto start = std::chrono::steady_clock::now();
+        float z = 0.0f;
+        for (float& s : buf) {
+            z += 0.01f * (s - z);
+            s = z * 0.999f + 0.001f;
+        }
+        sink = sink + z;
+        runs.push_back((double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::steady_clock::now() - start).count() / buf.size());
+    }
+    return median(runs);
+}
+
+// Deterministic stereo input: a tone with a DC offset on the left, a hot
+// tone on the right for the limiter
+void fill(std::vector<float>& in, int frames, uint64_t& t) {
+    for (int i = 0; i < frames; ++i, ++t) {
+        in[i * kChannels] = (float)(0.1 + 0.7 * std::sin(2 * M_PI * 440.0 * t / kRate));
+        in[i * kChannels + 1] = (float)(1.3 * std::sin(2 * M_PI * 1000.0 * t / kRate));
+    }
+}
+
+LV2Plugin* load(LilvWorld* world, const char* uri) {
+    auto* plugin = new LV2Plugin(world, uri, kRate, 4096);
+    if (!plugin->initialize()) {
+        delete plugin;
+        return nullptr;
+    }
+    plugin->start();
+    return plugin;
+}
+
+struct Result {
+    std::vector<float> output;  // of the first run of the script
+    double cost = 0.0;          // median ns per frame over the timing runs
+};
+
+Result run(LilvWorld* world, const Scenario& scenario) {
+    Result result;
+    PluginChain chain;
+    chain.modulation().prepare(kRate);
+    InputStage input;
+    input.prepare(kRate, kChannels);
+    Limiter limiter;
+    limiter.prepare(kRate, kChannels);
+
+    LV2Plugin* delay = load(world, fakelilv::kDelay);
+    LV2Plugin* unity = load(world, fakelilv::kUnity);
+    check(delay && unity, "reference plugins load");
+    if (!delay || !unity) return result;
+    delay->setControlValue(2, kDelaySamples);
+    chain.replace(1, delay);
+    chain.setMix(1, 0.5f);
+    chain.replace(2, unity);
+    chain.setOutputTrim(2, 0.5f);
+    chain.setPan(2, 0.25f);
+
+    FullDuplexPass pass;
+    pass.chain = &chain;
+    pass.input = &input;
+    pass.limiter = &limiter;
+    pass.sampleRate = kRate;
+    pass.setSharedOutputStream(std::make_shared<oboe::AudioStream>(kChannels));
+
+    std::vector<float> in, out;
+    std::vector<double> costs;
+    uint64_t t = 0;
+    for (int r = 0; r <= kTimingRuns; ++r) {
+        for (const Callback& cb : scenario.script) {
+            in.assign((size_t)cb.input * kChannels, 0.0f);
+            out.assign((size_t)cb.output * kChannels, NAN);
+            fill(in, cb.input, t);
+
+            pass.onBothStreamsReady(in.data(), cb.input, out.data(), cb.output);
+
+            if (r == 0)
+                result.output.insert(result.output.end(), out.begin(), out.end());
+            else
+                costs.push_back((double)pass.stats.last_ns.load() / cb.output);
+        }
+    }
+    result.cost = median(costs);
+
+    check(pass.stats.callbacks.load() == (kTimingRuns + 1) * scenario.script.size(),
+          "every callback is counted");
+    check(chain.slotLatency(1) == kDelaySamples / kChannels, "slot latency is reported in frames");
+    return result;
+}
+
+bool writeGolden(const std::string& path, double cost, const std::vector<float>& samples) {
+    std::ofstream out(path);
+    char line[32];
+    snprintf(line, sizeof(line), "# cost %.3f\n", cost);
+    out << line;
+    for (float s : samples) {
+        snprintf(line, sizeof(line), "%.9g\n", s);
+        out << line;
+    }
+    return (bool)out;
+}
+
+bool readGolden(const std::string& path, double& cost, std::vector<float>& samples) {
+    std::ifstream in(path);
+    std::string hash, key;
+    if (!(in >> hash >> key >> cost) || hash != "#" || key != "cost") return false;
+    for (float s; in >> s;) samples.push_back(s);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <golden dir> <scenario> [--update]\n", argv[0]);
+        return 2;
+    }
+    const Scenario* scenario = nullptr;
+    for (const Scenario& s : kScenarios)
+        if (strcmp(s.name, argv[2]) == 0) scenario = &s;
+    if (!scenario) {
+        fprintf(stderr, "unknown scenario %s\n", argv[2]);
+        return 2;
+    }
+    const std::string golden = std::string(argv[1]) + "/duplex_" + scenario->name + ".txt";
+    const bool update = argc > 3 && strcmp(argv[3], "--update") == 0;
+
+    LilvWorld* world = fakelilv::newWorld();
+    fakelilv::addOpiqoRef(world, OPIQO_REF_LIB);
+    const Result result = run(world, *scenario);
+    lilv_world_free(world);
+    const double cost = result.cost / calibrate();
+
+    for (float s : result.output) {
+        if (!std::isfinite(s)) {
+            check(false, "every output sample is written");
+            break;
+        }
+    }
+
+    if (update) {
+        check(writeGolden(golden, cost, result.output), "golden file written");
+        printf("%s: %zu samples, cost %.3f written to %s\n", scenario->name,
+               result.output.size(), cost, golden.c_str());
+    } else {
+        double baseline = 0.0;
+        std::vector<float> expected;
+        check(readGolden(golden, baseline, expected), "golden file has a cost baseline");
+        check(expected.size() == result.output.size(), "output length matches the golden file");
+        size_t worst = 0;
+        float err = 0.0f;
+        for (size_t i = 0; i < std::min(expected.size(), result.output.size()); ++i) {
+            const float e = std::fabs(expected[i] - result.output[i]);
+            if (e > err) {
+                err = e;
+                worst = i;
+            }
+        }
+        if (err > kTolerance) {
+            fprintf(stderr, "sample %zu (frame %zu) is %g, golden %g\n", worst,
+                    worst / kChannels, result.output[worst], expected[worst]);
+            check(false, "output matches the golden file");
+        }
+        if (cost > kRegression * baseline) {
+            fprintf(stderr, "cost %.3f, baseline %.3f\n", cost, baseline);
+            check(false, "callback cost within its baseline");
+        }
+    }
+
+    if (failures) return 1;
+    if (!update)
+        printf("duplex_test %s: %zu samples OK, cost %.3f\n", scenario->name,
+               result.output.size(), cost);
+    return 0;
+}
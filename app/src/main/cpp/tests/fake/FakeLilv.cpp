@@ -0,0 +1,250 @@
+/*
+ * FakeLilv.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * The lilv functions LV2Plugin calls, over the plugins of FakeLilv.h, and
+ * port-only presets in the format of fakelilv::writeState(). Anything else
+ * (saving state, scanning Turtle) is not provided; a test that needs it
+ * fails to link rather than running against a silent stub.
+ */
+
+#include "FakeLilv.h"
+
+#include <lv2/atom/atom.h>
+#include <lv2/core/lv2.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+struct LilvNodeImpl {
+    std::string str;
+    float num = 0.0f;
+};
+
+struct LilvPortImpl {
+    LilvNode symbol;
+    std::vector<std::string> classes;
+    bool has_range = false;
+    float def = 0.0f, min = 0.0f, max = 1.0f;
+};
+
+struct LilvPluginImpl {
+    LilvNode uri, library, bundle;
+    std::vector<LilvPortImpl> ports;
+    int latency_port = -1;
+};
+
+struct LilvWorldImpl {
+    std::vector<LilvPlugin*> plugins;
+};
+
+struct LilvStateImpl {
+    std::string uri;
+    std::vector<std::pair<std::string, float>> values;
+    LV2_URID float_type = 0;
+};
+
+namespace {
+
+using Nodes = std::vector<LilvNode*>;
+
+LilvNode* newNode(const std::string& str, float num = 0.0f) {
+    return new LilvNode{str, num};
+}
+
+uintptr_t index(const LilvIter* i) { return (uintptr_t)i; }
+
+} // namespace
+
+namespace fakelilv {
+
+LilvWorld* newWorld() { return new LilvWorld(); }
+
+void addPlugin(LilvWorld* world, const std::string& uri, const std::string& library,
+               const std::vector<PortSpec>& ports, int latencyPort) {
+    auto* plugin = new LilvPlugin();
+    plugin->uri.str = uri;
+    plugin->library.str = "file://" + library;
+    plugin->bundle.str = "file://" + library.substr(0, library.rfind('/') + 1);
+    plugin->latency_port = latencyPort;
+    for (const auto& spec : ports) {
+        LilvPortImpl port;
+        port.symbol.str = spec.symbol;
+        port.classes.push_back(spec.audio ? LV2_CORE__AudioPort : LV2_CORE__ControlPort);
+        port.classes.push_back(spec.input ? LV2_CORE__InputPort : LV2_CORE__OutputPort);
+        port.has_range = !spec.audio;
+        port.def = spec.def;
+        port.min = spec.min;
+        port.max = spec.max;
+        plugin->ports.push_back(port);
+    }
+    world->plugins.push_back(plugin);
+}
+
+void addOpiqoRef(LilvWorld* world, const std::string& library) {
+    addPlugin(world, kUnity, library, {{"in", true, true}, {"out", true, false}});
+    addPlugin(world, kDelay, library,
+              {{"in", true, true}, {"out", true, false},
+               {"frames", false, true, 64.0f, 0.0f, 8191.0f},
+               {"latency", false, false, 0.0f, 0.0f, 8191.0f}},
+              3);
+}
+
+bool writeState(const std::string& path, const std::string& uri,
+                const std::vector<std::pair<std::string, float>>& values) {
+    std::ofstream out(path);
+    out << uri << "\n";
+    for (const auto& [symbol, value] : values) out << symbol << " " << value << "\n";
+    return (bool)out;
+}
+
+} // namespace fakelilv
+
+extern "C" {
+
+void lilv_world_free(LilvWorld* world) {
+    if (!world) return;
+    for (auto* p : world->plugins) delete p;
+    delete world;
+}
+
+const LilvPlugins* lilv_world_get_all_plugins(const LilvWorld* world) {
+    return &world->plugins;
+}
+
+const LilvPlugin* lilv_plugins_get_by_uri(const LilvPlugins* plugins, const LilvNode* uri) {
+    for (auto* p : *static_cast<const std::vector<LilvPlugin*>*>(plugins))
+        if (p->uri.str == uri->str) return p;
+    return nullptr;
+}
+
+void lilv_free(void* ptr) { free(ptr); }
+
+char* lilv_file_uri_parse(const char* uri, char** hostname) {
+    if (hostname) *hostname = nullptr;
+    if (strncmp(uri, "file://", 7) != 0) return nullptr;
+    return strdup(uri + 7);
+}
+
+LilvNode* lilv_new_uri(LilvWorld*, const char* uri) { return newNode(uri); }
+
+void lilv_node_free(LilvNode* node) { delete node; }
+
+const char* lilv_node_as_uri(const LilvNode* node) { return node->str.c_str(); }
+const char* lilv_node_as_string(const LilvNode* node) { return node->str.c_str(); }
+float lilv_node_as_float(const LilvNode* node) { return node->num; }
+int lilv_node_as_int(const LilvNode* node) { return (int)node->num; }
+
+void lilv_nodes_free(LilvNodes* nodes) {
+    auto* v = static_cast<Nodes*>(nodes);
+    if (!v) return;
+    for (auto* n : *v) delete n;
+    delete v;
+}
+
+unsigned lilv_nodes_size(const LilvNodes* nodes) {
+    return nodes ? (unsigned)static_cast<const Nodes*>(nodes)->size() : 0;
+}
+
+LilvIter* lilv_nodes_begin(const LilvNodes*) { return (LilvIter*)(uintptr_t)0; }
+
+LilvIter* lilv_nodes_next(const LilvNodes*, LilvIter* i) {
+    return (LilvIter*)(index(i) + 1);
+}
+
+bool lilv_nodes_is_end(const LilvNodes* nodes, const LilvIter* i) {
+    return index(i) >= lilv_nodes_size(nodes);
+}
+
+const LilvNode* lilv_nodes_get(const LilvNodes* nodes, const LilvIter* i) {
+    return (*static_cast<const Nodes*>(nodes))[index(i)];
+}
+
+LilvNode* lilv_nodes_get_first(const LilvNodes* nodes) {
+    return lilv_nodes_size(nodes) ? (*static_cast<const Nodes*>(nodes))[0] : nullptr;
+}
+
+const LilvNode* lilv_plugin_get_uri(const LilvPlugin* plugin) { return &plugin->uri; }
+const LilvNode* lilv_plugin_get_library_uri(const LilvPlugin* plugin) { return &plugin->library; }
+const LilvNode* lilv_plugin_get_bundle_uri(const LilvPlugin* plugin) { return &plugin->bundle; }
+
+uint32_t lilv_plugin_get_num_ports(const LilvPlugin* plugin) {
+    return (uint32_t)plugin->ports.size();
+}
+
+const LilvPort* lilv_plugin_get_port_by_index(const LilvPlugin* plugin, uint32_t index) {
+    return index < plugin->ports.size() ? &plugin->ports[index] : nullptr;
+}
+
+bool lilv_plugin_has_latency(const LilvPlugin* plugin) { return plugin->latency_port >= 0; }
+
+uint32_t lilv_plugin_get_latency_port_index(const LilvPlugin* plugin) {
+    return (uint32_t)plugin->latency_port;
+}
+
+// The reference plugins require nothing beyond what LV2Plugin offers
+LilvNodes* lilv_plugin_get_required_features(const LilvPlugin*) { return new Nodes(); }
+
+// Only reached when the library has no lv2_descriptor, which ours all have
+LilvInstance* lilv_plugin_instantiate(const LilvPlugin*, double, const LV2_Feature* const*) {
+    return nullptr;
+}
+
+void lilv_instance_free(LilvInstance* instance) {
+    if (!instance) return;
+    instance->lv2_descriptor->cleanup(instance->lv2_handle);
+    free(instance);
+}
+
+bool lilv_port_is_a(const LilvPlugin*, const LilvPort* port, const LilvNode* port_class) {
+    for (const auto& c : port->classes)
+        if (c == port_class->str) return true;
+    return false;
+}
+
+bool lilv_port_supports_event(const LilvPlugin*, const LilvPort*, const LilvNode*) {
+    return false;
+}
+
+const LilvNode* lilv_port_get_symbol(const LilvPlugin*, const LilvPort* port) {
+    return &port->symbol;
+}
+
+// No port has properties beyond its range
+LilvNodes* lilv_port_get_value(const LilvPlugin*, const LilvPort*, const LilvNode*) {
+    return nullptr;
+}
+
+void lilv_port_get_range(const LilvPlugin*, const LilvPort* port, LilvNode** def, LilvNode** min,
+                         LilvNode** max) {
+    if (def) *def = port->has_range ? newNode("", port->def) : nullptr;
+    if (min) *min = port->has_range ? newNode("", port->min) : nullptr;
+    if (max) *max = port->has_range ? newNode("", port->max) : nullptr;
+}
+
+LilvState* lilv_state_new_from_file(LilvWorld*, LV2_URID_Map* map, const LilvNode*,
+                                    const char* path) {
+    std::ifstream in(path);
+    auto* state = new LilvState();
+    if (!(in >> state->uri)) {
+        delete state;
+        return nullptr;
+    }
+    std::string symbol;
+    for (float value; in >> symbol >> value;) state->values.emplace_back(symbol, value);
+    state->float_type = map->map(map->handle, LV2_ATOM__Float);
+    return state;
+}
+
+void lilv_state_restore(const LilvState* state, LilvInstance*, LilvSetPortValueFunc set_value,
+                        void* user_data, uint32_t, const LV2_Feature* const*) {
+    for (const auto& [symbol, value] : state->values)
+        set_value(symbol.c_str(), user_data, &value, sizeof(float), state->float_type);
+}
+
+void lilv_state_free(LilvState* state) { delete state; }
+
+} // extern "C"
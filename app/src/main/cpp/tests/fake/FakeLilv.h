@@ -0,0 +1,55 @@
+/*
+ * FakeLilv.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Just enough of the lilv API for LV2Plugin on a Linux host, where there is
+ * no lilv library: a world whose plugins are described in code instead of
+ * being read from Turtle.
+ *
+ * Each plugin names a real LV2 library and its URI, so LV2Plugin loads it
+ * through its own dlopen path and the plugin's run() is the real one. The
+ * tests use the reference plugins (plugins/opiqo_ref.c); addOpiqoRef()
+ * describes the ones they need with the same ports as opiqo_ref.ttl.
+ */
+
+#ifndef OPIQO_FAKELILV_H
+#define OPIQO_FAKELILV_H
+
+#include <lilv/lilv.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fakelilv {
+
+struct PortSpec {
+    const char* symbol;
+    bool audio;                 // else control
+    bool input;
+    float def = 0.0f, min = 0.0f, max = 1.0f;
+};
+
+// A new, empty world; free it with lilv_world_free()
+LilvWorld* newWorld();
+
+void addPlugin(LilvWorld* world, const std::string& uri, const std::string& library,
+               const std::vector<PortSpec>& ports, int latencyPort = -1);
+
+// #unity (mono pass-through) and #delay (delay by `frames` samples,
+// reported as latency) from the reference library at `library`
+void addOpiqoRef(LilvWorld* world, const std::string& library);
+
+// A preset for lilv_state_new_from_file(): the plugin URI, then one
+// "symbol value" line per control port. lilv_state_restore() sets those
+// ports; there are no state:interface properties.
+bool writeState(const std::string& path, const std::string& uri,
+                const std::vector<std::pair<std::string, float>>& values);
+
+constexpr const char* kUnity = "http://acoustixaudio.org/plugins/opiqo-ref#unity";
+constexpr const char* kDelay = "http://acoustixaudio.org/plugins/opiqo-ref#delay";
+
+} // namespace fakelilv
+
+#endif //OPIQO_FAKELILV_H
@@ -0,0 +1,49 @@
+/*
+ * Oboe.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * The part of Oboe's full-duplex API that FullDuplexPass.h builds on, so the
+ * callback can be driven on a Linux host without a device. Streams only
+ * report a channel count; the test calls onBothStreamsReady() itself with
+ * the buffers it scripted.
+ */
+
+#ifndef OPIQO_FAKE_OBOE_H
+#define OPIQO_FAKE_OBOE_H
+
+#include <cstdint>
+#include <memory>
+
+namespace oboe {
+
+enum class DataCallbackResult { Continue, Stop };
+
+class AudioStream {
+public:
+    explicit AudioStream(int32_t channels) : channels_(channels) {}
+    int32_t getChannelCount() const { return channels_; }
+
+private:
+    int32_t channels_;
+};
+
+class FullDuplexStream {
+public:
+    virtual ~FullDuplexStream() = default;
+
+    void setSharedInputStream(std::shared_ptr<AudioStream> stream) { input_ = std::move(stream); }
+    void setSharedOutputStream(std::shared_ptr<AudioStream> stream) { output_ = std::move(stream); }
+    AudioStream* getInputStream() { return input_.get(); }
+    AudioStream* getOutputStream() { return output_.get(); }
+
+    virtual DataCallbackResult onBothStreamsReady(const void* inputData, int numInputFrames,
+                                                  void* outputData, int numOutputFrames) = 0;
+
+private:
+    std::shared_ptr<AudioStream> input_, output_;
+};
+
+} // namespace oboe
+
+#endif //OPIQO_FAKE_OBOE_H
@@ -0,0 +1,207 @@
+/*
+ * thread_manager_test.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * ThreadManager over fake sysfs trees built in a temporary directory:
+ * the big/little split, the affinity each role is given, and what place()
+ * achieves on this host with the fake topology.
+ *
+ * The trees are what Android kernels expose: cpu_capacity and cluster_id
+ * where the kernel has them, cpufreq and physical_package_id where it does
+ * not, offline cores, and the cpufreq/cpuidle directories next to cpuN.
+ */
+
+#include "ThreadManager.h"
+
+#include <sched.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using Role = ThreadManager::Role;
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+std::string list(const std::vector<int>& cores) {
+    std::string s;
+    for (int c : cores) s += (s.empty() ? "" : ",") + std::to_string(c);
+    return "{" + s + "}";
+}
+
+void expect(const std::vector<int>& got, const std::vector<int>& want, const std::string& what) {
+    check(got == want, what + ": " + list(got) + ", expected " + list(want));
+}
+
+// A sysfs cpu directory under a temporary root, removed with it
+class FakeSys {
+public:
+    FakeSys() {
+        char dir[] = "/tmp/opiqo-sysfs-XXXXXX";
+        root_ = mkdtemp(dir);
+        // Always present next to the cpuN directories
+        fs::create_directories(root_ / "cpufreq" / "policy0");
+        fs::create_directories(root_ / "cpuidle");
+        write("online", "0-7");
+    }
+
+    ~FakeSys() { fs::remove_all(root_); }
+
+    std::string root() const { return root_.string(); }
+
+    // A core with the kernel's capacity scale and cluster id
+    void cpu(int id, int capacity, int cluster, bool online = true) {
+        const std::string cpu = "cpu" + std::to_string(id);
+        write(cpu + "/cpu_capacity", std::to_string(capacity));
+        write(cpu + "/topology/cluster_id", std::to_string(cluster));
+        if (id > 0) write(cpu + "/online", online ? "1" : "0");
+    }
+
+    // An older kernel: no capacity, only cpufreq and the package id
+    void legacyCpu(int id, int max_khz, int package) {
+        const std::string cpu = "cpu" + std::to_string(id);
+        write(cpu + "/cpufreq/cpuinfo_max_freq", std::to_string(max_khz));
+        write(cpu + "/topology/physical_package_id", std::to_string(package));
+    }
+
+private:
+    void write(const std::string& path, const std::string& value) {
+        const fs::path file = root_ / path;
+        fs::create_directories(file.parent_path());
+        std::ofstream(file) << value << "\n";
+    }
+
+    fs::path root_;
+};
+
+// place() on a thread of its own, and the affinity the thread ended up with
+ThreadManager::Placement placeOnThread(ThreadManager& tm, Role role, cpu_set_t& actual) {
+    ThreadManager::Placement p;
+    std::thread([&] {
+        p = tm.place(role, "test");
+        sched_getaffinity(0, sizeof(actual), &actual);
+    }).join();
+    return p;
+}
+
+// A pinned thread runs only where it was pinned. Pinning must succeed when
+// the mask holds a core this process may use, and on such a core only.
+void checkPlacement(ThreadManager& tm, Role role, const char* name) {
+    const std::vector<int> mask = tm.affinity(role);
+    cpu_set_t allowed;
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    bool usable = false;
+    for (int c : mask) usable = usable || CPU_ISSET(c, &allowed);
+
+    cpu_set_t actual;
+    const ThreadManager::Placement p = placeOnThread(tm, role, actual);
+    const std::string what = std::string(name) + " placement";
+    check(p.pinned == usable, what + (usable ? " is pinned" : " is left unpinned"));
+    if (p.pinned) {
+        expect(p.cpus, mask, what + " cpus");
+        for (int c = 0; c < CPU_SETSIZE; ++c) {
+            if (CPU_ISSET(c, &actual))
+                check(std::find(mask.begin(), mask.end(), c) != mask.end(),
+                      what + " runs on cpu " + std::to_string(c) + " outside its mask");
+        }
+    }
+    check(!p.fifo || role == Role::Realtime, what + " is SCHED_FIFO only when realtime");
+}
+
+// Prime + big + little: three capacities, one offline core
+void bigLittle() {
+    FakeSys sys;
+    for (int id = 0; id < 4; ++id) sys.cpu(id, 325, 0);
+    sys.cpu(4, 820, 1);
+    sys.cpu(5, 820, 1);
+    sys.cpu(6, 820, 1, false);
+    sys.cpu(7, 1024, 2);
+
+    ThreadManager tm(sys.root());
+    check(tm.cpus().size() == 7, "offline cpu6 and the non-cpu directories are skipped");
+    expect(tm.bigCores(), {4, 5, 7}, "big cores");
+    expect(tm.littleCores(), {0, 1, 2, 3}, "little cores");
+    expect(tm.primeCores(), {7}, "prime cores");
+    expect(tm.affinity(Role::Realtime), {4, 5}, "realtime affinity leaves the prime core");
+    expect(tm.affinity(Role::Foreground), {4, 5, 7}, "foreground affinity");
+    expect(tm.affinity(Role::Background), {0, 1, 2, 3}, "background affinity");
+    for (const auto& c : tm.cpus()) {
+        const int cluster = c.id < 4 ? 0 : c.id < 7 ? 1 : 2;
+        check(c.cluster == cluster, "cpu" + std::to_string(c.id) + " cluster");
+    }
+
+    checkPlacement(tm, Role::Realtime, "realtime");
+    checkPlacement(tm, Role::Foreground, "foreground");
+    checkPlacement(tm, Role::Background, "background");
+    check(tm.placements().size() == 3, "every placement is recorded");
+}
+
+// No cpu_capacity: cpufreq decides, the package id is the cluster
+void legacy() {
+    FakeSys sys;
+    sys.legacyCpu(0, 1800000, 0);
+    sys.legacyCpu(1, 1800000, 0);
+    sys.legacyCpu(2, 2400000, 1);
+    sys.legacyCpu(3, 2400000, 1);
+
+    ThreadManager tm(sys.root());
+    expect(tm.bigCores(), {2, 3}, "big cores from cpufreq");
+    expect(tm.littleCores(), {0, 1}, "little cores from cpufreq");
+    expect(tm.primeCores(), {}, "no prime tier with two capacities");
+    expect(tm.affinity(Role::Realtime), {2, 3}, "realtime affinity with two capacities");
+    check(tm.cpus().size() == 4 && tm.cpus()[2].cluster == 1, "cluster from physical_package_id");
+}
+
+// One kind of core: every role may run anywhere, nothing is pinned
+void uniform() {
+    FakeSys sys;
+    for (int id = 0; id < 4; ++id) sys.cpu(id, 1024, 0);
+
+    ThreadManager tm(sys.root());
+    expect(tm.bigCores(), {0, 1, 2, 3}, "uniform big cores");
+    expect(tm.littleCores(), {0, 1, 2, 3}, "uniform little cores");
+    expect(tm.affinity(Role::Realtime), {}, "uniform realtime affinity");
+    expect(tm.affinity(Role::Background), {}, "uniform background affinity");
+
+    cpu_set_t actual;
+    check(!placeOnThread(tm, Role::Background, actual).pinned, "uniform placement is not pinned");
+}
+
+// No sysfs at all: no topology, nothing pinned
+void missing() {
+    ThreadManager tm("/nonexistent/sys/devices/system/cpu");
+    check(tm.cpus().empty() && tm.bigCores().empty() && tm.littleCores().empty(),
+          "no topology without sysfs");
+    expect(tm.affinity(Role::Foreground), {}, "affinity without sysfs");
+}
+
+} // namespace
+
+int main() {
+    bigLittle();
+    legacy();
+    uniform();
+    missing();
+
+    if (failures) return 1;
+    printf("thread_manager_test: OK\n");
+    return 0;
+}
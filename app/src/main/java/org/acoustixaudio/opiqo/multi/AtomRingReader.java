@@ -0,0 +1,63 @@
+package org.acoustixaudio.opiqo.multi;
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+
+/**
+ * Batched reader for the atoms one plugin output port sends to the UI.
+ *
+ * The reader owns a direct buffer as large as the plugin's ring. Each poll()
+ * makes one native call that copies every complete pending atom into it,
+ * unwrapped and each padded to 8 bytes as in the ring, and releases them
+ * from the ring, then hands the atoms to the handler in place. The native side never keeps a pointer into the ring, so
+ * the slot may be replaced from any thread at any time; the reader then
+ * reads whatever plugin is in the slot, or reports -1 if it has no atom
+ * output at port.
+ */
+public class AtomRingReader {
+    public interface Handler {
+        /** body holds the atom body at [offset, offset + size) */
+        void onAtom(int type, ByteBuffer body, int offset, int size);
+    }
+
+    static final int ATOM_HEADER = 8;
+
+    final int slot;
+    final int port;
+    private final ByteBuffer buffer;
+    private final long[] info = new long[2];
+
+    long dropped = 0;
+    long highWater = 0;
+
+    private AtomRingReader(int slot, int port, int size) {
+        this.slot = slot;
+        this.port = port;
+        this.buffer = ByteBuffer.allocateDirect(size).order(ByteOrder.nativeOrder());
+    }
+
+    /** Returns null if slot has no atom output at port */
+    static AtomRingReader open(int slot, int port) {
+        int size = AudioEngine.getAtomRingSize(slot, port);
+        return size <= 0 ? null : new AtomRingReader(slot, port, size);
+    }
+
+    /** Deliver all pending atoms, returns how many, or -1 if the slot has no such port */
+    int poll(Handler handler) {
+        final int avail = AudioEngine.pollAtomRing(slot, port, buffer, info);
+        if (avail < 0)
+            return -1;
+        dropped = info[0];
+        highWater = info[1];
+
+        int pos = 0, count = 0;
+        while (avail - pos >= ATOM_HEADER) {
+            final int size = buffer.getInt(pos);
+            final int type = buffer.getInt(pos + 4);
+            handler.onAtom(type, buffer, pos + ATOM_HEADER, size);
+            pos += (ATOM_HEADER + size + 7) & ~7;
+            count++;
+        }
+        return count;
+    }
+}
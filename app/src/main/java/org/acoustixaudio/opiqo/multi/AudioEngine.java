@@ -5,20 +5,79 @@ import android.media.AudioManager;
 import android.os.Build;
 
 public class AudioEngine {
+    private static MeterReader meterReader = null;
+
+    static synchronized MeterReader meters() {
+        if (meterReader == null) {
+            java.nio.ByteBuffer buffer = getMeterBuffer();
+            if (buffer != null)
+                meterReader = new MeterReader(buffer);
+        }
+        return meterReader;
+    }
+
     static native boolean create();
     static native boolean isAAudioRecommended();
     static native boolean setAPI(int apiType);
     static native boolean setEffectOn(boolean isEffectOn);
+    static native boolean setJalvPlugin (String uri);
+    static native long[] getCallbackStats ();
     static native void setValue ( int plugin, int index, float value);
     static native int addPlugin (int position, String uri) ;
+    static native int addSandboxedPlugin (int position, String uri) ;
+    static native void setNativeLibraryDir (String path);
     static native void deletePlugin (int plugin);
     static native String getPluginInfo ();
+    static native java.nio.ByteBuffer getMeterBuffer ();
+    static native int getAtomRingSize (int slot, int port);
+    static native int pollAtomRing (int slot, int port, java.nio.ByteBuffer buffer, long[] info);
     static native void initPlugins (String lv2Path);
     static native void setRecordingDeviceId(int deviceId);
     static native void setPlaybackDeviceId(int deviceId);
     static native void delete();
 
     static native void test (String dir);
+    static native String benchmarkHost (String uri, int frames, int maxSlots);
+    static native void startCostProfiler ();
+    static native double predictChainLoad (int slot, String uri);
+    static native void setSlotMix (int slot, float mix, float inTrimDb, float outTrimDb, float pan);
+    static native float[] getSlotMix (int slot);
+    static native void setInputStage (boolean dcBlock, boolean highPass, float highPassHz, boolean gate,
+                                      float thresholdDb, float ratio, float attackMs, float releaseMs);
+    static native void setLimiter (boolean enabled, float ceilingDb, float lookaheadMs, float releaseMs);
+    static native float getLimiterGain ();
+    static native int getProcessingLatency ();
+    static native int getRoundTripLatency ();
+    static native int getSlotLatency (int slot);
+    static native void pushMidi (int source, byte[] msg, int offset, int count, long timestamp);
+    static native void setMidiSubscribed (int slot, boolean subscribed);
+    static native boolean startMidiReplay (String path, boolean loop);
+    static native boolean addModRoute (int source, int slot, int port, float min, float max, float curve);
+    static native void removeModRoutes (int slot, int port);
+    static native void learnModRoute (int slot, int port, float min, float max, float curve);
+    static native int pollModLearn ();
+    static native void setLfo (int index, float hz, int shape);
+    static native void setEnvelope (int index, float attackMs, float releaseMs, float gain);
+    static native boolean setAutomationLane (int slot, int port, boolean ramp, long[] frames, float[] values);
+    static native boolean armAutomation (int slot, int port, boolean armed);
+    static native void clearAutomationLane (int slot, int port);
+    static native long[] getAutomationFrames (int slot, int port);
+    static native float[] getAutomationValues (int slot, int port);
+    static native void setAutomationTransport (boolean playing, boolean recording);
+    static native void locateAutomation (long frame);
+    static native long getAutomationPosition ();
+    static native long[] getPluginLogStats (int slot);
+    static native String getThreadReport ();
+    static native String loadSession (String session);
+    static native boolean saveRig (String path);
+    static native String loadRig (String path);
+    static native int applyRigControls (String path);
+    static native boolean exportRigTurtle (String dir);
+    static native void prefetchPlugin (String uri);
+    static native void setInstancePoolCapacity (int capacity);
+    static native long[] getInstancePoolStats ();
+    static native boolean cloneSlot (int from, int to);
+    static native int getPendingClones ();
 
     static native void setCacheDir(String path);
     static native void native_setDefaultStreamValues(int defaultSampleRate, int defaultFramesPerBurst);
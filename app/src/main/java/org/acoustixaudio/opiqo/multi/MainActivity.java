@@ -11,10 +11,13 @@ import android.content.pm.PackageManager;
 import android.os.Build;
 import android.os.Bundle;
 import android.util.Log;
+import android.view.MotionEvent;
 import android.view.View;
+import android.widget.AdapterView;
 import android.widget.CompoundButton;
 import android.widget.FrameLayout;
 import android.widget.LinearLayout;
+import android.widget.ListView;
 import android.widget.ScrollView;
 import android.widget.TextView;
 import android.widget.Toast;
@@ -52,6 +55,14 @@ public class MainActivity extends AppCompatActivity {
     ArrayList <String> pluginUris;
     ScrollView pluginUIContainer1, pluginUIContainer2, pluginUIContainer3, pluginUIContainer4;
     private CollectionFragment collectionFragment;
+    private MidiInputService midiInputService;
+
+    @Override
+    protected void onDestroy() {
+        if (midiInputService != null)
+            midiInputService.stop();
+        super.onDestroy();
+    }
 
     @Override
     protected void onCreate(Bundle savedInstanceState) {
@@ -81,9 +92,15 @@ public class MainActivity extends AppCompatActivity {
         String path = getFilesDir() + "/lv2";
         Log.d(TAG, "onCreate: [lv2 path] " + path);
         copyAssetsToFiles("lv2");
+        linkBundleBinary("opiqo_ref.lv2", "libopiqo_ref.so");
 
         AudioEngine.create();
+        AudioEngine.setCacheDir(getFilesDir().getAbsolutePath());
+        AudioEngine.setNativeLibraryDir(getApplicationInfo().nativeLibraryDir);
         AudioEngine.initPlugins(path);
+        AudioEngine.startCostProfiler();
+        midiInputService = new MidiInputService(this);
+        midiInputService.start();
         try {
             pluginInfo = new JSONObject(AudioEngine.getPluginInfo());
 //            Log.d(TAG, "onCreate: [plugin info] " + pluginInfo.toString(2));
@@ -162,6 +179,23 @@ public class MainActivity extends AppCompatActivity {
         return baseDir.getAbsolutePath();
     }
 
+    // Plugins built with the app are packaged as native libraries, not as
+    // assets, so point the copied bundle at the extracted library
+    private void linkBundleBinary(String bundle, String library) {
+        File target = new File(getApplicationInfo().nativeLibraryDir, library);
+        File link = new File(getFilesDir(), "lv2/" + bundle + "/" + library);
+        if (!target.exists()) {
+            Log.w(TAG, "linkBundleBinary: " + target + " not found");
+            return;
+        }
+        try {
+            link.delete();
+            android.system.Os.symlink(target.getAbsolutePath(), link.getAbsolutePath());
+        } catch (android.system.ErrnoException e) {
+            Log.e(TAG, "linkBundleBinary failed", e);
+        }
+    }
+
     private void copyAssetDir(android.content.res.AssetManager am, String assetPath, File outDir) throws java.io.IOException {
         String[] list = am.list(assetPath);
         if (list == null || list.length == 0) {
@@ -191,6 +225,17 @@ public class MainActivity extends AppCompatActivity {
         }
     }
 
+    // Predicted share of one core above which a chain is likely to glitch
+    static final double LOAD_BUDGET = 0.7;
+
+    void warnIfOverBudget(int position, String pluginUri) {
+        double load = AudioEngine.predictChainLoad(position, pluginUri);
+        if (load > LOAD_BUDGET) {
+            Toast.makeText(this, String.format("This chain may overload the CPU (%.0f%% predicted). " +
+                    "Try lower quality or oversampling settings.", load * 100), Toast.LENGTH_LONG).show();
+        }
+    }
+
     public void showAddPluginDialog(View root, TextView add, int position) {
         AlertDialog.Builder builder = new AlertDialog.Builder(this);
         CharSequence [] pluginNamesArray = pluginNames.toArray(new CharSequence[0]);
@@ -199,6 +244,7 @@ public class MainActivity extends AppCompatActivity {
                     public void onClick(DialogInterface dialog, int which) {
                         // The 'which' argument contains the index position of the selected item.
                         String pluginUri = pluginUris.get(which);
+                        warnIfOverBudget(position, pluginUri);
                         AudioEngine.addPlugin(position, pluginUri);
                         Log.d(TAG, "[add plugin]: " + position + ":" + pluginUri);
                         UI pluginUI = new UI(context, pluginInfo.optJSONObject(pluginUri).toString(), position);
@@ -212,6 +258,45 @@ public class MainActivity extends AppCompatActivity {
                     }
                 });
 
-        builder.show();
+        AlertDialog dialog = builder.show();
+        prefetchOnHighlight(dialog.getListView());
+    }
+
+    // Warm an instance of whichever plugin the picker highlights (keyboard
+    // focus, hover or a finger going down), so picking it is instant
+    void prefetchOnHighlight(ListView list) {
+        lastPrefetch = ListView.INVALID_POSITION;
+        list.setOnItemSelectedListener(new AdapterView.OnItemSelectedListener() {
+            @Override
+            public void onItemSelected(AdapterView<?> parent, View view, int which, long id) {
+                prefetch(which);
+            }
+
+            @Override
+            public void onNothingSelected(AdapterView<?> parent) {
+            }
+        });
+
+        View.OnGenericMotionListener hover = (v, event) -> {
+            if (event.getActionMasked() == MotionEvent.ACTION_HOVER_ENTER ||
+                    event.getActionMasked() == MotionEvent.ACTION_HOVER_MOVE)
+                prefetch(list.pointToPosition((int) event.getX(), (int) event.getY()));
+            return false;
+        };
+        list.setOnGenericMotionListener(hover);
+        list.setOnTouchListener((v, event) -> {
+            if (event.getActionMasked() == MotionEvent.ACTION_DOWN)
+                prefetch(list.pointToPosition((int) event.getX(), (int) event.getY()));
+            return false;
+        });
+    }
+
+    int lastPrefetch = ListView.INVALID_POSITION;
+
+    void prefetch(int which) {
+        if (which == ListView.INVALID_POSITION || which == lastPrefetch || which >= pluginUris.size())
+            return;
+        lastPrefetch = which;
+        AudioEngine.prefetchPlugin(pluginUris.get(which));
     }
 }
\ No newline at end of file
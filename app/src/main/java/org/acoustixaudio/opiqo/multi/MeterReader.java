@@ -0,0 +1,89 @@
+package org.acoustixaudio.opiqo.multi;
+
+import java.lang.invoke.MethodHandles;
+import java.lang.invoke.VarHandle;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+
+/**
+ * Reads the output control snapshots the audio thread publishes per slot.
+ *
+ * The buffer is native memory shared with the engine (MeterBank.h): per
+ * slot a sequence number followed by two banks of (count, port index[],
+ * value[]). The bank at seq & 1 is complete; if seq changes while copying
+ * it, the copy is retried. Nothing here calls into native code.
+ */
+public class MeterReader {
+    static final int MAX_METERS = 32;
+    static final int BANK_OFFSET = 8;
+    static final int BANK_SIZE = 4 + MAX_METERS * 4 * 2;
+    static final int SLOT_SIZE = BANK_OFFSET + BANK_SIZE * 2;
+    static final int MAX_RETRIES = 4;
+
+    private static final VarHandle INT =
+            MethodHandles.byteBufferViewVarHandle(int[].class, ByteOrder.nativeOrder());
+
+    private final ByteBuffer buffer;
+
+    MeterReader(ByteBuffer buffer) {
+        this.buffer = buffer.order(ByteOrder.nativeOrder());
+    }
+
+    int slots() {
+        return buffer.capacity() / SLOT_SIZE;
+    }
+
+    /**
+     * Copy the latest snapshot of slot (1-based) into index/value.
+     * Returns the number of meters, or -1 if no consistent copy was made.
+     */
+    int read(int slot, int[] index, float[] value) {
+        if (slot < 1 || slot > slots())
+            return -1;
+
+        final int base = (slot - 1) * SLOT_SIZE;
+        for (int attempt = 0; attempt < MAX_RETRIES; attempt++) {
+            final int seq = (int) INT.getAcquire(buffer, base);
+            final int bank = base + BANK_OFFSET + (seq & 1) * BANK_SIZE;
+
+            int count = Math.min(buffer.getInt(bank), Math.min(index.length, value.length));
+            count = Math.min(count, MAX_METERS);
+            for (int i = 0; i < count; i++) {
+                index[i] = buffer.getInt(bank + 4 + i * 4);
+                value[i] = buffer.getFloat(bank + 4 + MAX_METERS * 4 + i * 4);
+            }
+
+            VarHandle.acquireFence();
+            if ((int) INT.getAcquire(buffer, base) == seq)
+                return count;
+        }
+
+        return -1;
+    }
+
+    /**
+     * One slot's meters as of the last refresh. Preallocated, so the UI can
+     * read a slot once per refresh and then look up each of its ports.
+     */
+    static final class Snapshot {
+        final int[] index = new int[MAX_METERS];
+        final float[] value = new float[MAX_METERS];
+        int count = 0;
+
+        /** Copy the latest snapshot of slot; keeps the previous one on failure */
+        void refresh(MeterReader reader, int slot) {
+            int n = reader.read(slot, index, value);
+            if (n >= 0)
+                count = n;
+        }
+
+        /** Value of one output port, or fallback if absent */
+        float value(int portIndex, float fallback) {
+            for (int i = 0; i < count; i++) {
+                if (index[i] == portIndex)
+                    return value[i];
+            }
+            return fallback;
+        }
+    }
+}
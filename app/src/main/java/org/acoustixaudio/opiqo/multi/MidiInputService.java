@@ -0,0 +1,113 @@
+package org.acoustixaudio.opiqo.multi;
+
+import android.content.Context;
+import android.content.pm.PackageManager;
+import android.media.midi.MidiDevice;
+import android.media.midi.MidiDeviceInfo;
+import android.media.midi.MidiManager;
+import android.media.midi.MidiOutputPort;
+import android.media.midi.MidiReceiver;
+import android.os.Handler;
+import android.os.Looper;
+import android.util.Log;
+
+import java.util.ArrayList;
+import java.util.concurrent.Executor;
+
+/**
+ * Connects every MIDI source on the device to the engine.
+ *
+ * Messages go straight from the MIDI framework's thread into the native
+ * ring (MidiInput.h) with their System.nanoTime() timestamps; the audio
+ * thread places them in the block. Each output port gets a receiver with a
+ * source id of its own, so the native parser keeps running status per port.
+ * Devices plugged in later are picked up through the device callback.
+ */
+public class MidiInputService {
+    static final String TAG = "MidiInputService";
+
+    private final MidiManager manager;
+    private final Handler handler = new Handler(Looper.getMainLooper());
+    private final Executor executor = handler::post;
+    private final ArrayList<MidiDevice> devices = new ArrayList<>();
+    private final ArrayList<MidiOutputPort> ports = new ArrayList<>();
+    private final ArrayList<MidiReceiver> receivers = new ArrayList<>();
+    private int nextSource = 1;     // 0 is the file replay
+
+    private static final class Receiver extends MidiReceiver {
+        final int source;
+
+        Receiver(int source) {
+            this.source = source;
+        }
+
+        @Override
+        public void onSend(byte[] msg, int offset, int count, long timestamp) {
+            AudioEngine.pushMidi(source, msg, offset, count, timestamp);
+        }
+    }
+
+    private final MidiManager.DeviceCallback callback = new MidiManager.DeviceCallback() {
+        @Override
+        public void onDeviceAdded(MidiDeviceInfo info) {
+            open(info);
+        }
+    };
+
+    public MidiInputService(Context context) {
+        MidiManager midi = null;
+        if (context.getPackageManager().hasSystemFeature(PackageManager.FEATURE_MIDI))
+            midi = (MidiManager) context.getSystemService(Context.MIDI_SERVICE);
+        manager = midi;
+    }
+
+    public void start() {
+        if (manager == null) return;
+        for (MidiDeviceInfo info : manager.getDevicesForTransport(MidiManager.TRANSPORT_MIDI_BYTE_STREAM))
+            open(info);
+        manager.registerDeviceCallback(MidiManager.TRANSPORT_MIDI_BYTE_STREAM, executor, callback);
+    }
+
+    public void stop() {
+        if (manager == null) return;
+        manager.unregisterDeviceCallback(callback);
+        for (int i = 0; i < ports.size(); i++) {
+            ports.get(i).disconnect(receivers.get(i));
+            close(ports.get(i));
+        }
+        for (MidiDevice device : devices)
+            close(device);
+        ports.clear();
+        receivers.clear();
+        devices.clear();
+    }
+
+    // A device's output ports are what it sends to us
+    private void open(MidiDeviceInfo info) {
+        if (info.getOutputPortCount() == 0) return;
+        manager.openDevice(info, device -> {
+            if (device == null) {
+                Log.w(TAG, "open: cannot open " + info);
+                return;
+            }
+            devices.add(device);
+            for (int i = 0; i < info.getOutputPortCount(); i++) {
+                MidiOutputPort port = device.openOutputPort(i);
+                if (port == null) continue;
+                MidiReceiver receiver = new Receiver(nextSource++);
+                port.connect(receiver);
+                ports.add(port);
+                receivers.add(receiver);
+            }
+            Log.d(TAG, "open: " + info.getProperties().getString(MidiDeviceInfo.PROPERTY_NAME));
+        }, handler);
+    }
+
+    private static void close(AutoCloseable closeable) {
+        try {
+            closeable.close();
+        } catch (Exception e) {
+            Log.w(TAG, "close: " + e.getMessage());
+        }
+    }
+}
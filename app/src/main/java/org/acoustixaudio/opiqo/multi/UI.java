@@ -6,6 +6,7 @@ import android.view.Gravity;
 import android.view.View;
 import android.widget.Button;
 import android.widget.LinearLayout;
+import android.widget.ProgressBar;
 import android.widget.ScrollView;
 import android.widget.TextView;
 import android.widget.Toast;
@@ -16,6 +17,7 @@ import org.json.JSONArray;
 import org.json.JSONException;
 import org.json.JSONObject;
 
+import java.util.ArrayList;
 import java.util.Iterator;
 
 public class UI extends LinearLayout {
@@ -24,6 +26,21 @@ public class UI extends LinearLayout {
     Context context;
     static final String TAG = "UI";
     public View add = null ;
+    static final int METER_REFRESH_MS = 33;
+    final ArrayList<Runnable> meters = new ArrayList<>();
+    MeterReader meterReader = null;
+    final MeterReader.Snapshot meterSnapshot = new MeterReader.Snapshot();
+
+    // The slot is read once per refresh, then each meter finds its port
+    final Runnable refreshMeters = new Runnable() {
+        @Override
+        public void run() {
+            meterSnapshot.refresh(meterReader, position);
+            for (Runnable meter : meters)
+                meter.run();
+            postDelayed(this, METER_REFRESH_MS);
+        }
+    };
 
     public UI(Context _context, String _pluginInfo, int _position) {
         super(_context);
@@ -45,6 +62,84 @@ public class UI extends LinearLayout {
     }
 
 
+    // Output control ports: label plus bar, refreshed from the meter snapshot
+    void addMeter(JSONObject port) throws JSONException {
+        final int index = port.getInt("index");
+        final float min = (float) port.optDouble("min", 0);
+        final float max = (float) port.optDouble("max", 1);
+
+        TextView label = new TextView(context);
+        label.setTextSize(16);
+        label.setPadding(0, 0, 0, 10);
+
+        ProgressBar bar = new ProgressBar(context, null, android.R.attr.progressBarStyleHorizontal);
+        bar.setMax(1000);
+
+        String name = port.getString("name");
+        meters.add(() -> {
+            float value = meterSnapshot.value(index, min);
+            float span = max > min ? max - min : 1;
+            bar.setProgress((int) (1000 * Math.max(0, Math.min(1, (value - min) / span))));
+            label.setText(String.format("%s: %.2f", name, value));
+        });
+
+        addView(bar);
+        addView(label);
+    }
+
+    // Dry/wet, trims and pan of the slot itself, whatever plugin is in it
+    final float[] slotMix = {1, 0, 0, 0};
+
+    void addSlotMix() {
+        String[] names = {"Mix", "In trim (dB)", "Out trim (dB)", "Pan"};
+        float[] from = {0, -24, -24, -1};
+        float[] to = {1, 24, 24, 1};
+
+        // Start from what the slot has now, e.g. after a session or rig load
+        float[] current = AudioEngine.getSlotMix(position);
+        if (current != null) {
+            for (int i = 0; i < slotMix.length; i++)
+                slotMix[i] = Math.max(from[i], Math.min(to[i], current[i]));
+        }
+
+        for (int i = 0; i < names.length; i++) {
+            final int which = i;
+            Slider slider = new Slider(context);
+            slider.setValueFrom(from[i]);
+            slider.setValueTo(to[i]);
+            slider.setValue(slotMix[i]);
+            slider.setLabelFormatter(value -> String.format("%.2f", value));
+            slider.addOnChangeListener((s, value, fromUser) -> {
+                if (fromUser) {
+                    slotMix[which] = value;
+                    AudioEngine.setSlotMix(position, slotMix[0], slotMix[1], slotMix[2], slotMix[3]);
+                }
+            });
+
+            TextView label = new TextView(context);
+            label.setText(names[i]);
+            label.setTextSize(16);
+            label.setPadding(0, 0, 0, 20);
+
+            addView(slider);
+            addView(label);
+        }
+    }
+
+    @Override
+    protected void onAttachedToWindow() {
+        super.onAttachedToWindow();
+        meterReader = AudioEngine.meters();
+        if (meterReader != null && !meters.isEmpty())
+            post(refreshMeters);
+    }
+
+    @Override
+    protected void onDetachedFromWindow() {
+        removeCallbacks(refreshMeters);
+        super.onDetachedFromWindow();
+    }
+
     void build () throws JSONException {
         try {
             JSONArray ports = pluginInfo.getJSONArray("port");
@@ -62,6 +157,11 @@ public class UI extends LinearLayout {
                 if (! port.getString("type").equals("control"))
                     continue;
 
+                if (port.optBoolean("output")) {
+                    addMeter(port);
+                    continue;
+                }
+
                 Slider slider = new Slider(context);
                 slider.setValueFrom((float) port.getDouble("min"));
                 slider.setValueTo((float) port.getDouble("max"));
@@ -91,6 +191,8 @@ public class UI extends LinearLayout {
             Toast.makeText(context, e.getMessage(), Toast.LENGTH_SHORT).show();
         }
 
+        addSlotMix();
+
         Button del = new Button(context);
         LayoutParams params = new LayoutParams(LayoutParams.WRAP_CONTENT, LayoutParams.WRAP_CONTENT);
         params.setMargins(0, 40, 0, 0);